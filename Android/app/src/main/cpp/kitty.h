@@ -1,8 +0,0 @@
-// kitty.h 
-#pragma once
-#include <string>
-
-const std::string KITTY_MAGIC_V1 = "KP01";
-const std::string KITTY_MAGIC_V2 = "KP02";
-const std::string KITTY_MAGIC_V3 = "KP03"; 
-const std::string KITTY_MAGIC_V4 = "KP04";
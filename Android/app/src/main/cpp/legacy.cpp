@@ -0,0 +1,150 @@
+// legacy.cpp
+#include "legacy.h"
+#include <zlib.h>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct LegacyMember {
+    string path;         // with the stored extension applied
+    uint64_t origSize = 0;
+    uint64_t offset = 0;  // payload: the old KP03 wrapper
+    uint64_t dataSize = 0;
+};
+
+// Old KP03 wrapper: "KP03", u8 compressed, u64 extLen, ext (with dot),
+// u64 size, then a zlib stream (compressed) or the bytes themselves
+const uint64_t WRAPPER_FIXED = 4 + 1 + 8 + 8;
+
+bool safePath(const string& path) {
+    if (path.empty() || path.find('\0') != string::npos) return false;
+    fs::path p(path);
+    if (p.has_root_name() || p.has_root_directory()) return false;
+    for (const fs::path& part : p)
+        if (part == "..") return false;
+    return true;
+}
+
+// Parses the member table and checks that each payload is exactly one old
+// KP03 wrapper and the last one ends the file; throws otherwise
+vector<LegacyMember> readLegacyMembers(const string& archivePath) {
+    ifstream in(archivePath, ios::binary);
+    if (!in) throw runtime_error("Cannot open archive: " + archivePath);
+    in.seekg(0, ios::end);
+    uint64_t size = (uint64_t)in.tellg(), pos = 0;
+    in.seekg(0);
+    auto bad = [&archivePath]() { return runtime_error("Not a legacy KittyPress app archive: " + archivePath); };
+    auto take = [&](void* dst, uint64_t n) {
+        if (size - pos < n || !in.read(static_cast<char*>(dst), (streamsize)n)) throw bad();
+        pos += n;
+    };
+    auto skip = [&](uint64_t n) {
+        if (size - pos < n) throw bad();
+        pos += n;
+        in.seekg((streamoff)pos);
+    };
+
+    char magic[4];
+    uint8_t version;
+    uint32_t count;
+    take(magic, 4);
+    take(&version, 1);
+    if (memcmp(magic, "KP04", 4) != 0 || version != 4) throw bad();
+    take(&count, 4);
+
+    vector<LegacyMember> members;
+    for (uint32_t i = 0; i < count; ++i) {
+        LegacyMember m;
+        uint16_t pathLen, extLen;
+        uint8_t flags;
+        take(&pathLen, 2);
+        m.path.resize(pathLen);
+        if (pathLen) take(&m.path[0], pathLen);
+        take(&flags, 1);
+        take(&m.origSize, 8);
+        take(&m.dataSize, 8);
+        take(&extLen, 2);
+        string ext(extLen, '\0');
+        if (extLen) take(&ext[0], extLen);
+        if (flags != 1 || m.dataSize < WRAPPER_FIXED || size - pos < m.dataSize) throw bad();
+
+        m.offset = pos;
+        char wrapper[4];
+        uint64_t innerExtLen, payloadSize;
+        take(wrapper, 4);
+        skip(1);
+        take(&innerExtLen, 8);
+        if (memcmp(wrapper, "KP03", 4) != 0 || innerExtLen > m.dataSize - WRAPPER_FIXED) throw bad();
+        skip(innerExtLen);
+        take(&payloadSize, 8);
+        if (payloadSize != m.dataSize - WRAPPER_FIXED - innerExtLen) throw bad();
+        skip(payloadSize);
+        if (!ext.empty()) m.path = fs::path(m.path).replace_extension("." + ext).string();
+        if (!safePath(m.path)) throw bad();
+        members.push_back(move(m));
+    }
+    if (pos != size) throw bad();
+    return members;
+}
+
+void extractMember(ifstream& in, const LegacyMember& m, const fs::path& outPath) {
+    vector<uint8_t> wrapper(m.dataSize);
+    in.seekg((streamoff)m.offset);
+    if (!in.read(reinterpret_cast<char*>(wrapper.data()), (streamsize)m.dataSize))
+        throw runtime_error("Unexpected EOF in " + m.path);
+    bool compressed = wrapper[4] != 0;
+    uint64_t innerExtLen;
+    memcpy(&innerExtLen, wrapper.data() + 5, 8);
+    const uint8_t* payload = wrapper.data() + WRAPPER_FIXED + innerExtLen;
+    uint64_t payloadSize = m.dataSize - WRAPPER_FIXED - innerExtLen;
+
+    vector<uint8_t> data;
+    if (compressed) {
+        // the old decoder guessed the output size; the member header has it
+        data.resize((size_t)m.origSize);
+        uLongf destLen = (uLongf)m.origSize;
+        int zrc = uncompress(data.data(), &destLen, payload, (uLong)payloadSize);
+        if (zrc != Z_OK || destLen != m.origSize)
+            throw runtime_error("zlib uncompress failed (" + to_string(zrc) + "): " + m.path);
+    } else {
+        if (payloadSize != m.origSize) throw runtime_error("Corrupted archive (size mismatch): " + m.path);
+        data.assign(payload, payload + payloadSize);
+    }
+
+    fs::create_directories(outPath.parent_path());
+    ofstream out(outPath, ios::binary);
+    if (!out) throw runtime_error("Cannot open output file: " + outPath.string());
+    out.write(reinterpret_cast<const char*>(data.data()), (streamsize)data.size());
+    if (!out) throw runtime_error("Write failed: " + outPath.string());
+}
+
+}  // namespace
+
+bool isLegacyAppArchive(const string& archivePath) {
+    try {
+        readLegacyMembers(archivePath);
+        return true;
+    } catch (const exception&) {
+        return false;
+    }
+}
+
+vector<string> legacyAppArchivePaths(const string& archivePath) {
+    vector<string> paths;
+    for (const LegacyMember& m : readLegacyMembers(archivePath)) paths.push_back(m.path);
+    return paths;
+}
+
+void extractLegacyAppArchive(const string& archivePath, const string& outputFolder) {
+    vector<LegacyMember> members = readLegacyMembers(archivePath);
+    ifstream in(archivePath, ios::binary);
+    if (!in) throw runtime_error("Cannot open archive: " + archivePath);
+    for (const LegacyMember& m : members) extractMember(in, m, fs::path(outputFolder) / m.path);
+}
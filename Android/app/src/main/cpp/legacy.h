@@ -0,0 +1,19 @@
+// legacy.h
+#pragma once
+#include <string>
+#include <vector>
+
+// Read-only support for archives written by the app before its native code
+// moved onto core/. Those are KP04 version 4, but every member header has a
+// u16 extension length and the extension (no dot) after dataSize, and every
+// payload is the app's old KP03 wrapper around a zlib stream or raw bytes,
+// neither of which core's reader understands. New archives are always
+// written by core/archive.h.
+
+// True when the file parses as that layout to its last byte
+bool isLegacyAppArchive(const std::string& archivePath);
+
+// Member paths as extractLegacyAppArchive writes them (stored extension applied)
+std::vector<std::string> legacyAppArchivePaths(const std::string& archivePath);
+
+void extractLegacyAppArchive(const std::string& archivePath, const std::string& outputFolder);
@@ -1,14 +1,17 @@
 #include <jni.h>
 #include <string>
+#include <vector>
+#include <filesystem>
 #include <android/log.h>
 #include "archive.h"
-#include "huffman.h"
-#include "lz77.h"
-#include "bitstream.h"
+#include "codec.h"
+#include "legacy.h"
 
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, "KittyPress", __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, "KittyPress", __VA_ARGS__)
 
+namespace fs = std::filesystem;
+
 static std::string toStr(JNIEnv* env, jstring js) {
     const char* c = env->GetStringUTFChars(js, nullptr);
     std::string s(c);
@@ -23,10 +26,38 @@ static std::vector<std::string> toStrArray(JNIEnv* env, jobjectArray arr) {
     for (jsize i = 0; i < len; i++) {
         jstring js = (jstring)env->GetObjectArrayElement(arr, i);
         out.push_back(toStr(env, js));
+        env->DeleteLocalRef(js);
     }
     return out;
 }
 
+static std::vector<uint8_t> toBytes(JNIEnv* env, jbyteArray arr) {
+    std::vector<uint8_t> out(env->GetArrayLength(arr));
+    env->GetByteArrayRegion(arr, 0, (jsize)out.size(), reinterpret_cast<jbyte*>(out.data()));
+    return out;
+}
+
+static jbyteArray fromBytes(JNIEnv* env, const std::vector<uint8_t>& data) {
+    jbyteArray arr = env->NewByteArray((jsize)data.size());
+    if (arr) env->SetByteArrayRegion(arr, 0, (jsize)data.size(), reinterpret_cast<const jbyte*>(data.data()));
+    return arr;
+}
+
+// Folder (or, for a single member, file) the app shows after extraction:
+// KittyPress_<file> for one member, KittyPress_<dir> when every member sits
+// under the same top-level folder, KittyPress_Files otherwise
+static std::string extractionRootName(const std::vector<std::string>& paths) {
+    if (paths.empty()) return "KittyPress_Empty";
+    if (paths.size() == 1) return "KittyPress_" + fs::path(paths[0]).filename().string();
+
+    size_t pos = paths[0].find('/');
+    if (pos == std::string::npos) return "KittyPress_Files";
+    std::string top = paths[0].substr(0, pos + 1);
+    for (const std::string& p : paths)
+        if (p.compare(0, top.size(), top) != 0) return "KittyPress_Files";
+    return "KittyPress_" + top.substr(0, pos);
+}
+
 extern "C" JNIEXPORT jint JNICALL
 Java_com_deepion_kittypress_KittyPressNative_compressNative(
         JNIEnv* env, jobject, jobjectArray inputArray, jstring outPath) {
@@ -42,16 +73,69 @@ Java_com_deepion_kittypress_KittyPressNative_compressNative(
     }
 }
 
+// Extracts into outputFolder/<extractionRootName> and returns that name.
+// Archives from app versions before the move onto core/ go through legacy.h.
 extern "C" JNIEXPORT jstring JNICALL
 Java_com_deepion_kittypress_KittyPressNative_decompressNative(
         JNIEnv* env, jobject, jstring archivePath, jstring outputFolder) {
     try {
         std::string in = toStr(env, archivePath);
-        std::string out = toStr(env, outputFolder);
+        fs::path out = toStr(env, outputFolder);
+
+        bool legacy = isLegacyAppArchive(in);
+        auto extract = [&](const fs::path& folder) {
+            if (legacy) extractLegacyAppArchive(in, folder.string());
+            else extractArchive(in, folder.string());
+        };
 
-        std::string extractedName = extractArchive(in, out);
-        return env->NewStringUTF(extractedName.c_str());
+        std::vector<std::string> paths;
+        if (legacy) {
+            LOGI("Reading legacy app archive: %s", in.c_str());
+            paths = legacyAppArchivePaths(in);
+        } else {
+            ArchiveReader reader(in);
+            for (const ArchiveEntry& e : reader.entries())
+                if (!e.deleted()) paths.push_back(e.path);
+        }
+        std::string root = extractionRootName(paths);
 
+        if (paths.size() == 1) {
+            // the single file itself becomes the root: extract beside it, then rename
+            fs::path staging = out / (root + ".tmpkitty");
+            fs::remove_all(staging);
+            extract(staging);
+            fs::rename(staging / fs::path(paths[0]), out / root);
+            fs::remove_all(staging);
+        } else {
+            fs::path rootOut = out / root;
+            fs::create_directories(rootOut);
+            extract(rootOut);
+        }
+        return env->NewStringUTF(root.c_str());
+
+    } catch (const std::exception& e) {
+        LOGE("Error: %s", e.what());
+        return nullptr;
+    }
+}
+
+// In-memory KP03 streams (codec.h), for callers that never touch a file
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_deepion_kittypress_KittyPressNative_compressBytesNative(
+        JNIEnv* env, jobject, jbyteArray input, jint level) {
+    try {
+        return fromBytes(env, compressBuffer(toBytes(env, input), "", level));
+    } catch (const std::exception& e) {
+        LOGE("Error: %s", e.what());
+        return nullptr;
+    }
+}
+
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_deepion_kittypress_KittyPressNative_decompressBytesNative(
+        JNIEnv* env, jobject, jbyteArray input) {
+    try {
+        return fromBytes(env, decompressBuffer(toBytes(env, input)));
     } catch (const std::exception& e) {
         LOGE("Error: %s", e.what());
         return nullptr;
@@ -8,4 +8,8 @@ object KittyPressNative {
     // returns 0 on success, non-zero on error (matches your native implementation)
     external fun compressNative(inputArray: Array<String>, outPath: String): Int
     external fun decompressNative(archive: String, outDir: String): String?
+
+    // in-memory KittyPress streams; null on error
+    external fun compressBytesNative(input: ByteArray, level: Int): ByteArray?
+    external fun decompressBytesNative(input: ByteArray): ByteArray?
 }
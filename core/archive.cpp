@@ -1,125 +1,1180 @@
 //archive.cpp
 #include "archive.h"
-#include "huffman.h"
+#include "chunker.h"
+#include "codec.h"
+#include "crc32c.h"
+#include "dict.h"
+#include "filter.h"
 #include "kitty.h"
+#include "trace.h"
+#include "memtrack.h"
+#include "xxhash.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <cstdint>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 namespace fs = std::filesystem;
 
-static void gatherFiles(const fs::path& base, const fs::path& p,
-                        vector<ArchiveInput>& list) {
-    if (fs::is_directory(p)) {
-        for (auto& e : fs::recursive_directory_iterator(p))
-            if (fs::is_regular_file(e.path()))
-                list.push_back({ e.path().string(),
-                                 fs::relative(e.path(), base).string() });
-    } else if (fs::is_regular_file(p)) {
-        list.push_back({ p.string(), p.filename().string() });
+// Hands exactly n bytes of in to sink through a bounded buffer
+static void readBytes(istream& in, uint64_t n, const KittySink& sink, const string& what) {
+    size_t chunk = (size_t)min<uint64_t>(n, mem_plan().ioChunk);
+    MemCharge charge(MemSubsystem::Archive, chunk);
+    vector<uint8_t> buf(chunk);
+    while (n > 0) {
+        size_t want = (size_t)min<uint64_t>(n, buf.size());
+        in.read(reinterpret_cast<char*>(buf.data()), (streamsize)want);
+        if ((size_t)in.gcount() != want) throw runtime_error("Unexpected end of " + what);
+        sink(buf.data(), want);
+        n -= want;
     }
 }
 
-void createArchive(const vector<string>& inputs, const string& outputArchive) {
-    vector<ArchiveInput> files;
-    for (auto& in : inputs)
-        gatherFiles(fs::absolute(in).parent_path(), fs::absolute(in), files);
+static KittySink streamSink(ostream& out) {
+    return [&out](const uint8_t* data, size_t n) {
+        out.write(reinterpret_cast<const char*>(data), (streamsize)n);
+    };
+}
+
+// sink, keeping crc as the CRC32C of everything passed through
+static KittySink crcSink(KittySink sink, uint32_t& crc) {
+    return [sink, &crc](const uint8_t* data, size_t n) {
+        crc = crc32c(data, n, crc);
+        sink(data, n);
+    };
+}
+
+// CRC32C of the first size bytes of the file at path
+static uint32_t fileCrc(const string& path, uint64_t size) {
+    KITTY_TRACE("file crc", path);
+    ifstream in(path, ios::binary);
+    if (!in) throw runtime_error("Cannot open input: " + path);
+    uint32_t crc = 0;
+    readBytes(in, size, [&crc](const uint8_t* data, size_t n) { crc = crc32c(data, n, crc); }, "input " + path);
+    return crc;
+}
+
+static string crcHex(uint32_t crc) {
+    char text[9];
+    snprintf(text, sizeof(text), "%08x", crc);
+    return text;
+}
+
+vector<ArchiveInput> collectArchiveInputs(const vector<string>& inputs) {
+    return scanAll(inputs);
+}
+
+bool parseArchiveOrder(const string& name, ArchiveOrder& out) {
+    if (name == "scan") out = ArchiveOrder::Scan;
+    else if (name == "name") out = ArchiveOrder::Name;
+    else if (name == "size") out = ArchiveOrder::Size;
+    else if (name == "ext") out = ArchiveOrder::Extension;
+    else return false;
+    return true;
+}
+
+static void sortInputs(vector<ArchiveInput>& files, ArchiveOrder order) {
+    KITTY_TRACE("sort inputs");
+    auto byName = [](const ArchiveInput& a, const ArchiveInput& b) { return a.relPath < b.relPath; };
+    if (order == ArchiveOrder::Name) {
+        sort(files.begin(), files.end(), byName);
+    } else if (order == ArchiveOrder::Extension) {
+        sort(files.begin(), files.end(), [&](const ArchiveInput& a, const ArchiveInput& b) {
+            string ea = fs::path(a.relPath).extension().string(), eb = fs::path(b.relPath).extension().string();
+            return ea != eb ? ea < eb : byName(a, b);
+        });
+    } else if (order == ArchiveOrder::Size) {
+        vector<pair<uint64_t, size_t>> keys(files.size());
+        for (size_t i = 0; i < files.size(); ++i) {
+            error_code ec;
+            uint64_t size = (uint64_t)fs::file_size(files[i].absPath, ec);
+            keys[i] = { ec ? 0 : size, i };
+        }
+        sort(keys.begin(), keys.end(), [&](const pair<uint64_t, size_t>& a, const pair<uint64_t, size_t>& b) {
+            return a.first != b.first ? a.first > b.first : byName(files[a.second], files[b.second]);
+        });
+        vector<ArchiveInput> sorted;
+        sorted.reserve(files.size());
+        for (auto& k : keys) sorted.push_back(move(files[k.second]));
+        files.swap(sorted);
+    }
+}
+
+// ---- whole-file dedup ----
+
+// Members stored so far, keyed by size; a member is hashed only once another
+// file of its size turns up
+class DedupIndex {
+public:
+    // Index of an earlier member with exactly the content of path, or -1
+    int64_t find(const string& path, uint64_t size);
+    void add(const string& path, uint64_t size, uint32_t index);
+
+private:
+    struct Member {
+        string path;
+        uint32_t index;
+        bool hashed = false;
+        uint64_t hash = 0;
+    };
+    unordered_map<uint64_t, vector<Member>> bySize;
+    string lastPath;  // file hashed by the last find(), reused by add()
+    uint64_t lastHash = 0;
+};
+
+static uint64_t hashFile(const string& path, uint64_t size) {
+    KITTY_TRACE("dedup hash", path);
+    ifstream in(path, ios::binary);
+    if (!in) throw runtime_error("Cannot open input: " + path);
+    XXH64 h;
+    readBytes(in, size, [&h](const uint8_t* data, size_t n) { h.update(data, n); }, "input " + path);
+    return h.digest();
+}
+
+static bool sameContent(const string& a, const string& b, uint64_t size) {
+    KITTY_TRACE("dedup compare", b);
+    ifstream inA(a, ios::binary), inB(b, ios::binary);
+    if (!inA || !inB) return false;
+    size_t chunk = (size_t)min<uint64_t>(size, mem_plan().ioChunk);
+    MemCharge charge(MemSubsystem::Archive, 2 * chunk);
+    vector<char> bufA(chunk), bufB(chunk);
+    for (uint64_t left = size; left > 0;) {
+        size_t want = (size_t)min<uint64_t>(left, chunk);
+        inA.read(bufA.data(), (streamsize)want);
+        inB.read(bufB.data(), (streamsize)want);
+        if ((size_t)inA.gcount() != want || (size_t)inB.gcount() != want) return false;
+        if (memcmp(bufA.data(), bufB.data(), want) != 0) return false;
+        left -= want;
+    }
+    return true;
+}
+
+int64_t DedupIndex::find(const string& path, uint64_t size) {
+    auto it = bySize.find(size);
+    if (size == 0 || it == bySize.end()) return -1;
+    lastPath = path;
+    lastHash = hashFile(path, size);
+    for (Member& m : it->second) {
+        if (!m.hashed) {
+            m.hash = hashFile(m.path, size);
+            m.hashed = true;
+        }
+        if (m.hash == lastHash && sameContent(m.path, path, size)) return m.index;
+    }
+    return -1;
+}
+
+void DedupIndex::add(const string& path, uint64_t size, uint32_t index) {
+    if (size == 0) return;
+    Member m{ path, index };
+    if (path == lastPath) {
+        m.hashed = true;
+        m.hash = lastHash;
+    }
+    bySize[size].push_back(move(m));
+}
+
+// ---- chunk-level dedup ----
+
+// Distinct chunks of the members written so far, keyed by XXH64. A hash hit
+// is confirmed against the first copy, re-read from its input file, before
+// the chunk becomes a reference.
+class ChunkIndex {
+public:
+    // Where an identical chunk is stored, or false
+    bool find(uint64_t hash, const uint8_t* data, uint32_t length, ChunkRecord& where);
+    void add(uint64_t hash, const ChunkRecord& where);
+    void setPath(uint32_t member, const string& path) { paths[member] = path; }
+
+private:
+    unordered_map<uint64_t, ChunkRecord> chunks;
+    unordered_map<uint32_t, string> paths;
+    ifstream file;  // last input re-read for a confirmation
+    uint32_t fileMember = CHUNK_NEW;
+    vector<uint8_t> scratch;
+    MemCharge charge{ MemSubsystem::Archive };
+};
+
+bool ChunkIndex::find(uint64_t hash, const uint8_t* data, uint32_t length, ChunkRecord& where) {
+    auto it = chunks.find(hash);
+    if (it == chunks.end() || it->second.length != length) return false;
+    const ChunkRecord& first = it->second;
+    if (fileMember != first.source) {
+        file.close();
+        file.open(paths[first.source], ios::binary);
+        fileMember = first.source;
+    }
+    scratch.resize(length);
+    file.clear();
+    file.seekg((streamoff)first.offset);
+    file.read(reinterpret_cast<char*>(scratch.data()), length);
+    if ((uint32_t)file.gcount() != length || memcmp(scratch.data(), data, length) != 0) return false;
+    where = first;
+    return true;
+}
+
+void ChunkIndex::add(uint64_t hash, const ChunkRecord& where) {
+    chunks.emplace(hash, where);  // on a hash collision the first chunk stays
+    // rough node cost: key, record, bucket and list pointers
+    charge.set(chunks.size() * 48 + scratch.capacity());
+}
+
+// Reads size bytes of src and cuts them into content-defined chunks, calling
+// onChunk(data, length, offset) for each; crc becomes the CRC32C of the input
+static void cutChunks(istream& src, const string& path, uint64_t size, uint32_t& crc,
+                      const function<void(const uint8_t*, uint32_t, uint64_t)>& onChunk) {
+    const size_t bufSize = max(mem_plan().ioChunk, 2 * CDC_MAX_CHUNK);
+    MemCharge charge(MemSubsystem::Archive, bufSize);
+    vector<uint8_t> buf(bufSize);
+    size_t have = 0, pos = 0;
+    uint64_t left = size, fileOffset = 0;
+    while (true) {
+        memmove(buf.data(), buf.data() + pos, have - pos);
+        have -= pos;
+        pos = 0;
+        size_t want = (size_t)min<uint64_t>(bufSize - have, left);
+        src.read(reinterpret_cast<char*>(buf.data() + have), (streamsize)want);
+        if ((size_t)src.gcount() != want) throw runtime_error("Unexpected end of input " + path);
+        crc = crc32c(buf.data() + have, want, crc);
+        have += want;
+        left -= want;
+
+        while (pos < have && (left == 0 || have - pos >= CDC_MAX_CHUNK)) {
+            uint32_t length = (uint32_t)cdc_cut(buf.data() + pos, have - pos);
+            onChunk(buf.data() + pos, length, fileOffset);
+            pos += length;
+            fileOffset += length;
+        }
+        if (left == 0 && pos == have) break;
+    }
+}
+
+// Splits the input into content-defined chunks: chunks seen before become
+// references, the rest go through enc. Returns the member's chunk table;
+// crc becomes the CRC32C of the whole input, streamCrc that of the new chunks.
+static vector<ChunkRecord> encodeChunks(istream& src, const string& path, uint64_t size, uint32_t member,
+                                        ChunkIndex& index, KittyEncoder& enc, KittyStats* stats,
+                                        uint32_t& crc, uint32_t& streamCrc) {
+    KITTY_TRACE("chunk dedup", path);
+    vector<ChunkRecord> records;
+    auto append = [&records](uint32_t length, uint32_t source, uint64_t offset) {
+        if (!records.empty()) {
+            ChunkRecord& last = records.back();
+            bool adjacent = source == CHUNK_NEW || last.offset + last.length == offset;
+            if (last.source == source && adjacent && (uint64_t)last.length + length <= UINT32_MAX) {
+                last.length += length;
+                return;
+            }
+        }
+        records.push_back({ length, source, source == CHUNK_NEW ? 0 : offset });
+    };
+
+    cutChunks(src, path, size, crc, [&](const uint8_t* chunk, uint32_t length, uint64_t fileOffset) {
+        uint64_t hash = xxh64(chunk, length);
+        ChunkRecord where;
+        if (index.find(hash, chunk, length, where)) {
+            append(length, where.source, where.offset);
+            if (stats) {
+                stats->chunkHits++;
+                stats->chunkHitBytes += length;
+            }
+        } else {
+            enc.update(chunk, length);
+            streamCrc = crc32c(chunk, length, streamCrc);
+            append(length, CHUNK_NEW, 0);
+            index.add(hash, { length, member, fileOffset });
+        }
+        if (stats) stats->chunks++;
+    });
+    return records;
+}
+
+// True if f is the archive at archivePath (or its spill file): a walk may run into it
+static bool isArchiveFile(const ArchiveInput& f, const string& archivePath) {
+    const string archiveName = fs::path(archivePath).filename().string();
+    string name = fs::path(f.absPath).filename().string();
+    if (name != archiveName && name != archiveName + ".spill.tmp") return false;
+    error_code ec;
+    return fs::equivalent(f.absPath, fs::path(archivePath).parent_path() / name, ec);
+}
+
+// Writes members at the current position of an archive stream: each member
+// is encoded straight into the archive and its dataSize and CRC patched in
+// afterwards. Members are numbered from firstIndex on; whole-file and chunk
+// dedup only reference members written by this writer. With a base archive,
+// a file whose path, size and CRC32C match a live base member gets that
+// member's payload copied instead.
+class MemberWriter {
+public:
+    MemberWriter(ostream& out, const string& archivePath, const ArchiveOptions& options, uint32_t firstIndex,
+                 const ArchiveReader* base = nullptr);
+    void add(const ArchiveInput& f);  // prints the member's "+", "=" or "~" line
+    uint32_t written() const { return next - first; }
+    uint64_t reusedFiles() const { return reusedCount; }
+    uint64_t reusedBytes() const { return reusedOrig; }    // original bytes of the reused members
+    uint64_t encodedBytes() const { return encodedOrig; }  // original bytes that went through the encoder
+
+private:
+    ostream& out;
+    string archivePath;
+    const ArchiveOptions& options;
+    KittyEncoderOptions opts;
+    DedupIndex dedup;
+    ChunkIndex chunks;
+    vector<uint32_t> crcs;  // per member written, for duplicates
+    uint32_t first, next;
+    const ArchiveReader* base;
+    unordered_map<string, uint32_t> baseLive;   // path -> live base member
+    unordered_map<uint32_t, uint32_t> reused;   // base member holding the data -> member written with it
+    uint64_t reusedCount = 0, reusedOrig = 0, encodedOrig = 0;
+
+    bool reuse(const ArchiveInput& f, uint64_t origSize);
+};
+
+MemberWriter::MemberWriter(ostream& out, const string& archivePath, const ArchiveOptions& options, uint32_t firstIndex,
+                           const ArchiveReader* base)
+    : out(out), archivePath(archivePath), options(options), first(firstIndex), next(firstIndex), base(base) {
+    opts.level = options.level;
+    opts.spillPath = archivePath + ".spill.tmp";
+    opts.stats = options.stats;
+    opts.dict = options.dict;
+    opts.filters = options.filters;
+    if (base)
+        for (uint32_t i = 0; i < base->entries().size(); ++i)
+            if (!base->entries()[i].deleted()) baseLive[base->entries()[i].path] = i;
+}
+
+// Copies the base member for f when it holds the same bytes. A duplicate
+// brings its source's payload; a chunked payload qualifies when every range
+// it copies lies in itself or in a base member already reused, and a KP06
+// stream when this run has the same dictionary.
+bool MemberWriter::reuse(const ArchiveInput& f, uint64_t origSize) {
+    auto it = baseLive.find(f.relPath);
+    if (it == baseLive.end()) return false;
+    const ArchiveEntry& e = base->entries()[it->second];
+    if (e.origSize != origSize) return false;
+    uint32_t holder = e.duplicate() ? e.source : it->second;
+    const ArchiveEntry& data = base->entries()[holder];
+    const uint8_t* payload = base->payload(data);
+    for (const ChunkRecord& r : data.chunks)
+        if (r.source != CHUNK_NEW && r.source != holder && !reused.count(r.source)) return false;
+    if (data.streamSize >= 8 && memcmp(payload, KITTY_MAGIC_V6.data(), 4) == 0) {
+        uint32_t id;
+        memcpy(&id, payload + 4, 4);
+        if (!options.dict || options.dict->id() != id) return false;
+    }
+    // with chunk dedup the same read cuts the file, so members written after
+    // it can share its chunks as they would a freshly encoded member's
+    vector<pair<uint64_t, ChunkRecord>> cuts;
+    uint32_t crc = 0;
+    if (options.chunkDedup && origSize >= CHUNK_DEDUP_MIN_SIZE) {
+        KITTY_TRACE("file crc", f.absPath);
+        ifstream in(f.absPath, ios::binary);
+        if (!in) throw runtime_error("Cannot open input: " + f.absPath);
+        cutChunks(in, f.absPath, origSize, crc, [&](const uint8_t* chunk, uint32_t length, uint64_t offset) {
+            cuts.push_back({ xxh64(chunk, length), { length, next, offset } });
+        });
+    } else {
+        crc = fileCrc(f.absPath, origSize);
+    }
+    if (crc != e.crc) return false;
+
+    KITTY_TRACE("reuse base member", f.relPath);
+    uint16_t pathLen = (uint16_t)f.relPath.size();
+    uint8_t flags = (uint8_t)(data.flags & ~ARCHIVE_DELETED);  // a duplicate's source may be superseded
+    uint64_t dataSize = data.dataSize;
+    out.write(reinterpret_cast<char*>(&pathLen), 2);
+    out.write(f.relPath.c_str(), pathLen);
+    out.write(reinterpret_cast<char*>(&flags), 1);
+    out.write(reinterpret_cast<char*>(&origSize), 8);
+    out.write(reinterpret_cast<char*>(&dataSize), 8);
+    out.write(reinterpret_cast<char*>(&crc), 4);
+    // straight from the base mapping: no decode, no intermediate buffer
+    if (data.chunked()) {
+        out.write(reinterpret_cast<const char*>(payload), (streamsize)data.streamSize);
+        for (ChunkRecord r : data.chunks) {
+            if (r.source != CHUNK_NEW) r.source = r.source == holder ? next : reused[r.source];
+            out.write(reinterpret_cast<char*>(&r.length), 4);
+            out.write(reinterpret_cast<char*>(&r.source), 4);
+            out.write(reinterpret_cast<char*>(&r.offset), 8);
+        }
+        out.write(reinterpret_cast<const char*>(payload + data.dataSize - 8), 8);  // stream CRC32C, record count
+    } else {
+        out.write(reinterpret_cast<const char*>(payload), (streamsize)dataSize);
+    }
+    if (!out) throw runtime_error("Failed to write archive " + archivePath);
+
+    if (options.stats) {
+        options.stats->baseFiles++;
+        options.stats->baseBytes += origSize;
+    }
+    cout << "  ~ " << f.relPath << " (" << origSize << " → " << dataSize << ", from base)\n";
+    if (!cuts.empty()) {
+        chunks.setPath(next, f.absPath);
+        for (auto& c : cuts) chunks.add(c.first, c.second);
+    }
+    reused[holder] = next;
+    crcs.push_back(crc);
+    dedup.add(f.absPath, origSize, next);
+    ++reusedCount;
+    reusedOrig += origSize;
+    ++next;
+    return true;
+}
+
+void MemberWriter::add(const ArchiveInput& f) {
+    KittyStats* stats = options.stats;
+    KITTY_TRACE("archive member", f.relPath);
+    if (!fs::is_regular_file(f.absPath)) throw runtime_error("Cannot open input: " + f.absPath);
+    uint64_t origSize = (uint64_t)fs::file_size(f.absPath);
+    int64_t source = dedup.find(f.absPath, origSize);
+    if (source < 0 && base && reuse(f, origSize)) return;
+    bool chunked = options.chunkDedup && source < 0 && origSize >= CHUNK_DEDUP_MIN_SIZE;
+
+    uint16_t pathLen = (uint16_t)f.relPath.size();
+    uint8_t flags = source >= 0 ? ARCHIVE_DUPLICATE : chunked ? ARCHIVE_CHUNKED : ARCHIVE_COMPRESSED;
+    uint64_t dataSize = source >= 0 ? 4 : 0;
+    uint32_t crc = source >= 0 ? crcs[(size_t)source - first] : 0, streamCrc = 0;
+
+    out.write(reinterpret_cast<char*>(&pathLen), 2);
+    out.write(f.relPath.c_str(), pathLen);
+    out.write(reinterpret_cast<char*>(&flags), 1);
+    out.write(reinterpret_cast<char*>(&origSize), 8);
+    streampos sizeAt = out.tellp();
+    out.write(reinterpret_cast<char*>(&dataSize), 8);
+    out.write(reinterpret_cast<char*>(&crc), 4);
+    crcs.push_back(crc);
+
+    if (source >= 0) {
+        uint32_t index = (uint32_t)source;
+        out.write(reinterpret_cast<char*>(&index), 4);
+        if (!out) throw runtime_error("Failed to write archive " + archivePath);
+        if (stats) {
+            stats->dedupFiles++;
+            stats->dedupBytes += origSize;
+        }
+        cout << "  = " << f.relPath << " (" << origSize << ", duplicate)\n";
+        ++next;
+        return;
+    }
+
+    ifstream src(f.absPath, ios::binary);
+    if (!src) throw runtime_error("Cannot open input: " + f.absPath);
+    opts.ext = fs::path(f.absPath).extension().string();
+    opts.sizeHint = origSize;
+    opts.sizeHintSet = !chunked;  // a chunked member's stream holds only its new chunks
+    opts.peek = chunked ? KittyPeek() : kitty_file_peek(f.absPath);
+    KittyEncoder enc(streamSink(out), opts);
+    vector<ChunkRecord> records;
+    if (chunked) {
+        chunks.setPath(next, f.absPath);
+        records = encodeChunks(src, f.absPath, origSize, next, chunks, enc, stats, crc, streamCrc);
+    } else {
+        readBytes(src, origSize, [&enc, &crc](const uint8_t* data, size_t n) {
+            crc = crc32c(data, n, crc);
+            enc.update(data, n);
+        }, "input " + f.absPath);
+    }
+    crcs.back() = crc;
+    enc.finish();
+    dataSize = enc.bytesOut();
+    encodedOrig += origSize;
+
+    if (chunked) {
+        for (ChunkRecord& r : records) {
+            out.write(reinterpret_cast<char*>(&r.length), 4);
+            out.write(reinterpret_cast<char*>(&r.source), 4);
+            out.write(reinterpret_cast<char*>(&r.offset), 8);
+        }
+        uint32_t recordCount = (uint32_t)records.size();
+        out.write(reinterpret_cast<char*>(&streamCrc), 4);
+        out.write(reinterpret_cast<char*>(&recordCount), 4);
+        dataSize += 16 * (uint64_t)recordCount + 8;
+    }
+
+    streampos endAt = out.tellp();
+    out.seekp(sizeAt);
+    out.write(reinterpret_cast<char*>(&dataSize), 8);
+    out.write(reinterpret_cast<char*>(&crc), 4);
+    out.seekp(endAt);
+    if (!out) throw runtime_error("Failed to write archive " + archivePath);
 
+    cout << "  + " << f.relPath << " (" << origSize << " → " << dataSize;
+    if (chunked) {
+        uint64_t shared = 0;
+        for (const ChunkRecord& r : records)
+            if (r.source != CHUNK_NEW) shared += r.length;
+        cout << ", " << shared << " bytes shared";
+    }
+    cout << ")\n";
+    dedup.add(f.absPath, origSize, next);
+    ++next;
+}
+
+// Moves the inputs whose live base member other base members copy chunks
+// from to the front, in base order (chunk references only point back), so
+// MemberWriter has reused them before the members that reference them. Which
+// members are reused then does not depend on the walk order.
+static void baseSourcesFirst(vector<ArchiveInput>& inputs, const ArchiveReader& base) {
+    const vector<ArchiveEntry>& list = base.entries();
+    vector<bool> referenced(list.size());
+    for (uint32_t i = 0; i < list.size(); ++i)
+        for (const ChunkRecord& r : list[i].chunks)
+            if (r.source != CHUNK_NEW && r.source != i) referenced[r.source] = true;
+    unordered_map<string, uint32_t> rank;  // path -> base index of a chunk source
+    for (uint32_t i = 0; i < list.size(); ++i)
+        if (referenced[i] && !list[i].deleted()) rank[list[i].path] = i;
+    if (rank.empty()) return;
+    auto sources = stable_partition(inputs.begin(), inputs.end(),
+                                    [&rank](const ArchiveInput& f) { return rank.count(f.relPath) > 0; });
+    stable_sort(inputs.begin(), sources, [&rank](const ArchiveInput& a, const ArchiveInput& b) {
+        return rank[a.relPath] < rank[b.relPath];
+    });
+}
+
+void createArchive(const vector<string>& inputs, const string& outputArchive, const ArchiveOptions& options) {
+    unique_ptr<ArchiveReader> base;
+    if (!options.basePath.empty()) {
+        error_code ec;
+        if (fs::equivalent(options.basePath, outputArchive, ec))
+            throw runtime_error("The base archive cannot be the archive being written: " + outputArchive);
+        base.reset(new ArchiveReader(options.basePath));
+        if (!base->checksums())
+            throw runtime_error("Base archive has no checksums to compare with (version 4): " + options.basePath);
+    }
     ofstream out(outputArchive, ios::binary);
     if (!out) throw runtime_error("Cannot open output archive");
 
-    // header
+    // header; the member count is patched in once the walk is done
     out.write(KITTY_MAGIC_V4.c_str(), KITTY_MAGIC_V4.size());
-    uint8_t ver = 4;
+    uint8_t ver = ARCHIVE_VERSION;
     out.write(reinterpret_cast<char*>(&ver), 1);
-    uint32_t count = (uint32_t)files.size();
+    streampos countAt = out.tellp();
+    uint32_t count = 0;
     out.write(reinterpret_cast<char*>(&count), 4);
 
-    cout << "Creating archive with " << count << " file(s)\n";
+    cout << "Creating archive " << outputArchive << "\n";
 
-    // stream entries
-    for (auto& f : files) {
-        ifstream in(f.absPath, ios::binary);
-        if (!in) throw runtime_error("Cannot open input: " + f.absPath);
+    // the walk is collected first when sorted or when reusing from a base
+    DirScanner scanner(inputs, options.threads);
+    bool collect = options.order != ArchiveOrder::Scan || base;
+    vector<ArchiveInput> sorted;
+    size_t sortedAt = 0;
+    if (collect) {
+        for (ArchiveInput f; scanner.next(f);) sorted.push_back(move(f));
+        sortInputs(sorted, options.order);
+        if (base) baseSourcesFirst(sorted, *base);
+    }
+    auto nextInput = [&](ArchiveInput& f) {
+        if (!collect) return scanner.next(f);
+        if (sortedAt == sorted.size()) return false;
+        f = move(sorted[sortedAt++]);
+        return true;
+    };
 
-        vector<uint8_t> data((istreambuf_iterator<char>(in)),
-                              istreambuf_iterator<char>());
-        in.close();
+    MemberWriter writer(out, outputArchive, options, 0, base.get());
+    for (ArchiveInput f; nextInput(f);)
+        if (!isArchiveFile(f, outputArchive)) writer.add(f);
+    count = writer.written();
 
-        // compress to temporary file buffer using existing API
-        string tmpOut = f.absPath + ".tmpkitty";
-        compressFile(f.absPath, tmpOut);  // produces KP03 per file
+    out.seekp(countAt);
+    out.write(reinterpret_cast<char*>(&count), 4);
 
-        ifstream comp(tmpOut, ios::binary);
-        vector<uint8_t> stored((istreambuf_iterator<char>(comp)),
-                                istreambuf_iterator<char>());
-        comp.close();
-        fs::remove(tmpOut);
+    out.close();
+    if (options.stats) stats_capture_memory(*options.stats);
+    cout << "Archive created: " << outputArchive << " (" << count << " file(s))" << endl;
+    if (base)
+        cout << "Reused " << writer.reusedFiles() << " file(s), " << writer.reusedBytes() << " bytes from "
+             << options.basePath << "; compressed " << writer.encodedBytes() << " bytes" << endl;
+}
 
-        bool isCompressed = true; // handled in compressFile
-        uint16_t pathLen = (uint16_t)f.relPath.size();
-        uint8_t flags = 1; // compressed flag
-        uint64_t origSize = data.size();
-        uint64_t dataSize = stored.size();
+// ---- reading ----
 
-        out.write(reinterpret_cast<char*>(&pathLen), 2);
-        out.write(f.relPath.c_str(), pathLen);
-        out.write(reinterpret_cast<char*>(&flags), 1);
-        out.write(reinterpret_cast<char*>(&origSize), 8);
-        out.write(reinterpret_cast<char*>(&dataSize), 8);
-        out.write(reinterpret_cast<char*>(stored.data()), dataSize);
+// A member path extraction may join to the output folder: relative, no ".."
+// component, no root name (C:) and no NUL
+static bool safeMemberPath(const string& path) {
+    if (path.empty() || path.find('\0') != string::npos) return false;
+    fs::path p(path);
+    if (p.has_root_name() || p.has_root_directory()) return false;
+    for (const fs::path& part : p)
+        if (part == "..") return false;
+    return true;
+}
 
-        cout << "  + " << f.relPath << " (" << origSize << " → "
-             << dataSize << ")\n";
+// Parses and checks the chunk table at the end of member i's payload: every
+// reference must point at bytes that exist before the member is rebuilt
+void ArchiveReader::readChunkTable(const uint8_t* p, uint32_t i, ArchiveEntry& e) const {
+    auto bad = [&e]() { return runtime_error("Corrupted archive (bad chunk table): " + e.path); };
+    uint64_t tail = checksums() ? 8 : 4;  // [stream CRC32C,] record count
+    if (e.dataSize < tail) throw bad();
+    uint32_t n;
+    memcpy(&n, p + e.offset + e.dataSize - 4, 4);
+    if (checksums()) memcpy(&e.streamCrc, p + e.offset + e.dataSize - 8, 4);
+    if ((e.dataSize - tail) / 16 < n) throw bad();
+    e.streamSize = e.dataSize - tail - 16 * (uint64_t)n;
+    const uint8_t* t = p + e.offset + e.streamSize;
+    e.chunks.resize(n);
+    uint64_t total = 0;
+    for (ChunkRecord& r : e.chunks) {
+        memcpy(&r.length, t, 4);
+        memcpy(&r.source, t + 4, 4);
+        memcpy(&r.offset, t + 8, 8);
+        t += 16;
+        if (r.source == CHUNK_NEW) {
+            e.streamBytes += r.length;
+        } else {
+            if (r.source > i || (r.source < i && list[r.source].duplicate())) throw bad();
+            uint64_t limit = r.source == i ? total : list[r.source].origSize;
+            if (r.offset > limit || r.length > limit - r.offset) throw bad();
+        }
+        total += r.length;
     }
+    if (total != e.origSize) throw bad();
+}
 
-    out.close();
-    cout << "Archive created: " << outputArchive << endl;
+ArchiveReader::ArchiveReader(const string& path) : file(path) {
+    const uint8_t* p = file.data();
+    uint64_t size = file.size(), pos = 0;
+    auto take = [&](void* dst, uint64_t n) {
+        if (size - pos < n) throw runtime_error("Corrupted archive (truncated header): " + path);
+        memcpy(dst, p + pos, (size_t)n);
+        pos += n;
+    };
+
+    char magic[4];
+    take(magic, 4);
+    if (string(magic, 4) != KITTY_MAGIC_V4) throw runtime_error("Not a KP04 archive");
+    take(&version, 1);
+    if (version < 4 || version > ARCHIVE_VERSION_DELETED)
+        throw runtime_error("Unsupported KP04 archive version " + to_string(version) + ": " + path);
+    uint32_t count; take(&count, 4);
+
+    list.reserve(min<uint64_t>(count, size / 19));  // an entry header is at least 19 bytes
+    for (uint32_t i = 0; i < count; ++i) {
+        ArchiveEntry e;
+        uint16_t pathLen; take(&pathLen, 2);
+        e.path.resize(pathLen);
+        take(&e.path[0], pathLen);
+        if (!safeMemberPath(e.path)) throw runtime_error("Corrupted archive (unsafe member path): " + e.path);
+        take(&e.flags, 1);
+        if (e.deleted() && version < ARCHIVE_VERSION_DELETED)
+            throw runtime_error("Corrupted archive (deleted member in a version " + to_string(version) + " archive): " + e.path);
+        take(&e.origSize, 8);
+        take(&e.dataSize, 8);
+        if (checksums()) take(&e.crc, 4);
+        if (size - pos < e.dataSize) throw runtime_error("Corrupted archive (member runs past the end): " + e.path);
+        e.offset = pos;
+        pos += e.dataSize;
+        if (e.duplicate()) {
+            if (e.dataSize != 4) throw runtime_error("Corrupted archive (bad duplicate entry): " + e.path);
+            memcpy(&e.source, p + e.offset, 4);
+            if (e.source >= i || list[e.source].duplicate() || list[e.source].origSize != e.origSize
+                || list[e.source].crc != e.crc)
+                throw runtime_error("Corrupted archive (bad duplicate reference): " + e.path);
+        } else if (e.chunked()) {
+            readChunkTable(p, i, e);
+        } else {
+            e.streamSize = e.dataSize;
+            e.streamBytes = e.origSize;
+            e.streamCrc = e.crc;
+        }
+        list.push_back(move(e));
+    }
+    end = pos;
 }
 
-void extractArchive(const string& archivePath, const string& outputFolder) {
-    ifstream in(archivePath, ios::binary);
-    if (!in) throw runtime_error("Cannot open archive");
+// Runs fn(entry, stats) over every member on up to `threads` workers (0 = one
+// per core; 1 under --max-memory, whose plan is per pipeline). The first
+// exception stops the other workers and is rethrown.
+static void forEachMember(const ArchiveReader& reader, unsigned threads, KittyStats* stats,
+                          const function<void(const ArchiveEntry&, KittyStats*)>& fn) {
+    const vector<ArchiveEntry>& entries = reader.entries();
+    if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+    if (mem_budget() != 0) threads = 1;
+    threads = (unsigned)min<size_t>(threads, max<size_t>(entries.size(), 1));
 
-    string magic(4, '\0');
-    in.read(&magic[0], 4);
-    if (magic != KITTY_MAGIC_V4)
-        throw runtime_error("Not a KP04 archive");
+    atomic<size_t> next{ 0 };
+    atomic<bool> failed{ false };
+    exception_ptr error;
+    mutex errorMutex;
+    vector<KittyStats> local(threads);
+    auto work = [&](unsigned w) {
+        try {
+            for (size_t i; !failed && (i = next++) < entries.size();)
+                fn(entries[i], stats ? &local[w] : nullptr);
+        } catch (...) {
+            lock_guard<mutex> lock(errorMutex);
+            if (!error) error = current_exception();
+            failed = true;
+        }
+    };
+    vector<thread> pool;
+    for (unsigned w = 1; w < threads; ++w) pool.emplace_back(work, w);
+    work(0);
+    for (auto& t : pool) t.join();
+    if (error) rethrow_exception(error);
+    if (stats) for (auto& s : local) stats->add(s);
+}
 
-    uint8_t ver; in.read(reinterpret_cast<char*>(&ver), 1);
-    uint32_t count; in.read(reinterpret_cast<char*>(&count), 4);
+static void checkCrc(const ArchiveEntry& e, uint32_t crc, uint32_t expected) {
+    if (crc != expected)
+        throw runtime_error("Checksum mismatch in " + e.path + " (CRC32C " + crcHex(crc)
+                            + ", expected " + crcHex(expected) + ")");
+}
 
-    cout << "Extracting " << count << " file(s)\n";
+// Decodes one member from the mapping into sink and checks its size and
+// (version 5) the CRC32C of the decoded bytes
+static void decodeMember(const ArchiveReader& reader, const ArchiveEntry& e, const KittySink& sink,
+                         KittyStats* stats, const KittyDictionary* dict) {
+    uint32_t crc = 0;
+    KittyDecoder dec(reader.checksums() ? crcSink(sink, crc) : sink, stats, dict);
+    dec.setOutputLimit(e.streamBytes);
+    dec.update(reader.payload(e), (size_t)e.streamSize);
+    dec.finish();
+    if (dec.bytesOut() != e.streamBytes)
+        throw runtime_error("Size mismatch in " + e.path + " (" + to_string(dec.bytesOut())
+                            + " bytes, expected " + to_string(e.streamBytes) + ")");
+    if (reader.checksums()) checkCrc(e, crc, e.streamCrc);
+}
 
-    for (uint32_t i = 0; i < count; ++i) {
-        uint16_t pathLen; in.read(reinterpret_cast<char*>(&pathLen), 2);
-        string rel(pathLen, '\0'); in.read(&rel[0], pathLen);
-        uint8_t flags; in.read(reinterpret_cast<char*>(&flags), 1);
-        uint64_t origSize, dataSize;
-        in.read(reinterpret_cast<char*>(&origSize), 8);
-        in.read(reinterpret_cast<char*>(&dataSize), 8);
+bool parseDuplicateLinks(const string& name, DuplicateLinks& out) {
+    if (name == "copy") out = DuplicateLinks::Copy;
+    else if (name == "hard") out = DuplicateLinks::Hard;
+    else if (name == "reflink") out = DuplicateLinks::Reflink;
+    else return false;
+    return true;
+}
+
+// Copy-on-write clone of from as to (Linux FICLONE: btrfs, XFS, ...)
+static bool reflinkFile(const fs::path& from, const fs::path& to) {
+#if defined(__linux__) && defined(FICLONE)
+    int src = open(from.c_str(), O_RDONLY);
+    if (src < 0) return false;
+    int dst = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = dst >= 0 && ioctl(dst, FICLONE, src) == 0;
+    if (dst >= 0) close(dst);
+    close(src);
+    if (!ok) {
+        error_code ec;
+        fs::remove(to, ec);
+    }
+    return ok;
+#else
+    (void)from;
+    (void)to;
+    return false;
+#endif
+}
 
-        vector<uint8_t> buf(dataSize);
-        in.read(reinterpret_cast<char*>(buf.data()), dataSize);
+// Writes an already extracted file again under another name, without decoding
+static void writeDuplicate(const fs::path& from, const fs::path& to, DuplicateLinks links) {
+    error_code ec;
+    fs::create_directories(to.parent_path(), ec);
+    fs::remove(to, ec);
+    if (links == DuplicateLinks::Hard) {
+        fs::create_hard_link(from, to, ec);
+        if (!ec) return;
+    } else if (links == DuplicateLinks::Reflink && reflinkFile(from, to)) {
+        return;
+    }
+    if (!fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec) || ec)
+        throw runtime_error("Cannot write duplicate " + to.string() + ": " + ec.message());
+}
 
-        fs::path outPath = fs::path(outputFolder) / rel;
-        fs::create_directories(outPath.parent_path());
+// Members extraction has to write: the live ones and the deleted ones a
+// written member still copies from (references only point backwards)
+static vector<bool> neededMembers(const vector<ArchiveEntry>& entries) {
+    vector<bool> needed(entries.size());
+    for (size_t i = entries.size(); i-- > 0;) {
+        const ArchiveEntry& e = entries[i];
+        if (e.deleted() && !needed[i]) continue;
+        needed[i] = true;
+        if (e.duplicate()) needed[e.source] = true;
+        for (const ChunkRecord& r : e.chunks)
+            if (r.source != CHUNK_NEW && r.source != i) needed[r.source] = true;
+    }
+    return needed;
+}
 
-        // Write buffer to temp .kitty, then decompressFile()
-        string tmp = outPath.string() + ".tmpkitty";
-        ofstream tmpf(tmp, ios::binary);
-        tmpf.write(reinterpret_cast<char*>(buf.data()), dataSize);
-        tmpf.close();
+// Scratch folder under the output folder for deleted members that are still
+// needed as sources; removed when extraction is done
+static const char* SUPERSEDED_DIR = ".kittypress-superseded";
+
+static fs::path extractedPath(const ArchiveReader& reader, uint32_t member, const string& outputFolder) {
+    const ArchiveEntry& e = reader.entries()[member];
+    if (e.deleted()) return fs::path(outputFolder) / SUPERSEDED_DIR / to_string(member);
+    return fs::path(outputFolder) / e.path;
+}
+
+// Rebuilds chunked member `member` at outPath: new ranges from its stream,
+// references copied from members already extracted under outputFolder; the
+// rebuilt file is checked against the member's CRC32C
+static void extractChunked(const ArchiveReader& reader, uint32_t member, const fs::path& outPath,
+                           const string& outputFolder, KittyStats* stats, const KittyDictionary* dict) {
+    const ArchiveEntry& e = reader.entries()[member];
+    ofstream outFile(outPath, ios::binary);
+    if (!outFile) throw runtime_error("Cannot open output file: " + outPath.string());
+    size_t rec = 0;
+    uint64_t usedInRec = 0;
+    uint32_t crc = 0;
+    auto copyReferences = [&]() {
+        for (; rec < e.chunks.size() && e.chunks[rec].source != CHUNK_NEW; ++rec) {
+            const ChunkRecord& r = e.chunks[rec];
+            fs::path from = r.source == member ? outPath : extractedPath(reader, r.source, outputFolder);
+            if (r.source == member) outFile.flush();
+            ifstream in(from, ios::binary);
+            in.seekg((streamoff)r.offset);
+            if (!in) throw runtime_error("Cannot read extracted " + from.string());
+            readBytes(in, r.length, crcSink(streamSink(outFile), crc), "extracted " + from.string());
+        }
+    };
+    decodeMember(reader, e, [&](const uint8_t* data, size_t n) {
+        while (n > 0) {
+            copyReferences();
+            if (rec == e.chunks.size()) throw runtime_error("Corrupted archive (bad chunk table): " + e.path);
+            size_t take = (size_t)min<uint64_t>(n, e.chunks[rec].length - usedInRec);
+            outFile.write(reinterpret_cast<const char*>(data), (streamsize)take);
+            crc = crc32c(data, take, crc);
+            data += take;
+            n -= take;
+            usedInRec += take;
+            if (usedInRec == e.chunks[rec].length) {
+                ++rec;
+                usedInRec = 0;
+            }
+        }
+    }, stats, dict);
+    copyReferences();
+    outFile.close();
+    if (!outFile) throw runtime_error("Failed to write " + outPath.string());
+    if (reader.checksums()) checkCrc(e, crc, e.crc);
+}
 
-        decompressFile(tmp, outPath.string());
-        fs::remove(tmp);
+void extractArchive(const string& archivePath, const string& outputFolder,
+                    KittyStats* stats, unsigned threads, DuplicateLinks links, const KittyDictionary* dict) {
+    ArchiveReader reader(archivePath);
+    const vector<ArchiveEntry>& entries = reader.entries();
+    vector<bool> needed = neededMembers(entries);
+    size_t live = (size_t)count_if(entries.begin(), entries.end(), [](const ArchiveEntry& e) { return !e.deleted(); });
+    cout << "Extracting " << live << " file(s)\n";
 
-        cout << "  Done " << rel << " (" << origSize << " bytes)\n";
+    // self-contained members first (in parallel), then chunked members in
+    // order (their references point backwards), then duplicates
+    mutex coutMutex;
+    forEachMember(reader, threads, stats, [&](const ArchiveEntry& e, KittyStats* memberStats) {
+        uint32_t member = (uint32_t)(&e - entries.data());
+        if (e.duplicate() || e.chunked() || !needed[member]) return;
+        KITTY_TRACE("extract member", e.path);
+        fs::path outPath = extractedPath(reader, member, outputFolder);
+        error_code ec;
+        fs::create_directories(outPath.parent_path(), ec);  // other workers may race us here
+
+        ofstream outFile(outPath, ios::binary);
+        if (!outFile) throw runtime_error("Cannot open output file: " + outPath.string());
+        decodeMember(reader, e, streamSink(outFile), memberStats, dict);
+        outFile.close();
+        if (!outFile) throw runtime_error("Failed to write " + outPath.string());
+
+        if (e.deleted()) return;
+        lock_guard<mutex> lock(coutMutex);
+        cout << "  Done " << e.path << " (" << e.origSize << " bytes)\n";
+    });
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        const ArchiveEntry& e = entries[i];
+        if (!e.chunked() || !needed[i]) continue;
+        KITTY_TRACE("extract chunked member", e.path);
+        fs::path outPath = extractedPath(reader, i, outputFolder);
+        error_code ec;
+        fs::create_directories(outPath.parent_path(), ec);
+        extractChunked(reader, i, outPath, outputFolder, stats, dict);
+        if (!e.deleted()) cout << "  Done " << e.path << " (" << e.origSize << " bytes, chunked)\n";
+    }
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        const ArchiveEntry& e = entries[i];
+        if (!e.duplicate() || e.deleted()) continue;  // nothing copies from a duplicate
+        KITTY_TRACE("extract duplicate", e.path);
+        writeDuplicate(extractedPath(reader, e.source, outputFolder), extractedPath(reader, i, outputFolder), links);
+        cout << "  Done " << e.path << " (" << e.origSize << " bytes, duplicate)\n";
+    }
+    if (live != entries.size()) {
+        error_code ec;
+        fs::remove_all(fs::path(outputFolder) / SUPERSEDED_DIR, ec);
     }
 
-    in.close();
+    if (stats) stats_capture_memory(*stats);
     cout << "Extraction finished → " << outputFolder << endl;
 }
+
+// Payload format of a member, from its first bytes
+static string memberFormat(const ArchiveReader& reader, const ArchiveEntry& e) {
+    if (e.duplicate()) return "duplicate";
+    if (e.chunked()) return "chunked";
+    if (e.dataSize < 5) return "?";
+    const uint8_t* p = reader.payload(e);
+    string magic(reinterpret_cast<const char*>(p), 4);
+    if (magic == KITTY_MAGIC_V3) return p[4] ? "lz77+huffman" : "stored";
+    if (magic == KITTY_MAGIC_V6) return "lz77+dict";
+    if (magic == KITTY_MAGIC_V5) return "stored+lz77";  // blocks of both kinds
+    if (magic == KITTY_MAGIC_V8) {
+        // the filter of the block table, or "filters" when blocks differ
+        uint32_t count = 0;
+        if (e.dataSize >= 8) memcpy(&count, p + 4, 4);
+        string name;
+        for (uint64_t i = 0; i < count && 8 + FILTER_BLOCK_RECORD * (i + 1) <= e.dataSize; ++i) {
+            const uint8_t* f = p + 8 + FILTER_BLOCK_RECORD * i + 8;
+            if (f[0] == (uint8_t)FilterKind::None) continue;
+            string block = filter_name(FilterSpec{ (FilterKind)f[0], f[1] });
+            if (!name.empty() && name != block) return "filters+lz77";
+            name = block;
+        }
+        return name.empty() ? "filtered" : name + "+lz77";
+    }
+    return magic;
+}
+
+void listArchive(const string& archivePath) {
+    ArchiveReader reader(archivePath);
+    uint64_t totalOrig = 0, totalData = 0, deletedData = 0;
+    size_t live = 0;
+    cout << left << setw(12) << "size" << setw(12) << "packed" << setw(8) << "ratio"
+         << setw(15) << "format" << "path\n";
+    cout << fixed << setprecision(3);
+    for (auto& e : reader.entries()) {
+        if (e.deleted()) {
+            deletedData += e.dataSize;
+            continue;
+        }
+        ++live;
+        cout << left << setw(12) << e.origSize << setw(12) << e.dataSize
+             << setw(8) << (e.origSize ? (double)e.dataSize / e.origSize : 0.0)
+             << setw(15) << memberFormat(reader, e) << e.path;
+        if (e.duplicate()) {
+            const ArchiveEntry& src = reader.entries()[e.source];
+            cout << " = " << src.path << (src.deleted() ? " (superseded)" : "");
+        }
+        cout << "\n";
+        totalOrig += e.origSize;
+        totalData += e.dataSize;
+    }
+    cout << left << setw(12) << totalOrig << setw(12) << totalData
+         << setw(8) << (totalOrig ? (double)totalData / totalOrig : 0.0)
+         << setw(15) << "" << live << " file(s)\n";
+    if (live != reader.entries().size())
+        cout << reader.entries().size() - live << " superseded member(s) hold " << deletedData
+             << " bytes (compact drops the ones no other member references)\n";
+    cout.unsetf(ios::floatfield);
+}
+
+void testArchive(const string& archivePath, KittyStats* stats, unsigned threads, const KittyDictionary* dict) {
+    ArchiveReader reader(archivePath);
+    mutex coutMutex;
+    size_t damaged = 0;
+    forEachMember(reader, threads, stats, [&](const ArchiveEntry& e, KittyStats* memberStats) {
+        if (e.duplicate()) return;  // reference checked by ArchiveReader, data tested with its source
+        KITTY_TRACE("test member", e.path);
+        try {
+            // chunked members: the new chunks only (references point at tested members)
+            decodeMember(reader, e, [](const uint8_t*, size_t) {}, memberStats, dict);
+        } catch (const exception& ex) {
+            lock_guard<mutex> lock(coutMutex);
+            cout << "  Damaged " << e.path << ": " << ex.what() << "\n";
+            ++damaged;
+        }
+    });
+    if (stats) stats_capture_memory(*stats);
+    size_t total = reader.entries().size();
+    size_t superseded = (size_t)count_if(reader.entries().begin(), reader.entries().end(),
+                                         [](const ArchiveEntry& e) { return e.deleted(); });
+    if (damaged) throw runtime_error(to_string(damaged) + " of " + to_string(total) + " file(s) damaged in " + archivePath);
+    cout << "OK: " << total - superseded << " file(s)";
+    if (superseded) cout << " and " << superseded << " superseded member(s)";
+    cout << " decoded and verified in " << archivePath
+         << (reader.checksums() ? " (CRC32C)" : " (sizes only: archive has no checksums)") << endl;
+}
+
+// ---- updating in place ----
+
+// Offset of e's flags byte: a version 5+ entry header ends with flags,
+// origSize, dataSize and CRC32C, right before the payload
+static uint64_t flagsOffset(const ArchiveEntry& e) {
+    return e.offset - (1 + 8 + 8 + 4);
+}
+
+void updateArchive(const vector<string>& inputs, const string& archivePath, const ArchiveOptions& options) {
+    vector<ArchiveEntry> entries;
+    uint64_t end;
+    {
+        ArchiveReader reader(archivePath);  // unmapped again before the file changes
+        if (!reader.checksums())
+            throw runtime_error("Cannot update a version 4 archive (no checksums to compare with): " + archivePath);
+        entries = reader.entries();
+        end = reader.membersEnd();
+    }
+    cout << "Updating archive " << archivePath << "\n";
+
+    unordered_map<string, uint32_t> live;  // path -> member
+    for (uint32_t i = 0; i < entries.size(); ++i)
+        if (!entries[i].deleted()) live[entries[i].path] = i;
+
+    vector<ArchiveInput> files = collectArchiveInputs(inputs);
+    sortInputs(files, options.order);
+    vector<ArchiveInput> added;
+    vector<uint32_t> replaced;
+    size_t unchanged = 0;
+    for (ArchiveInput& f : files) {
+        if (isArchiveFile(f, archivePath)) continue;
+        auto it = live.find(f.relPath);
+        if (it != live.end()) {
+            const ArchiveEntry& e = entries[it->second];
+            uint64_t size = (uint64_t)fs::file_size(f.absPath);
+            if (size == e.origSize && fileCrc(f.absPath, size) == e.crc) {
+                ++unchanged;
+                continue;
+            }
+            replaced.push_back(it->second);
+            live.erase(it);
+        }
+        added.push_back(move(f));
+    }
+    if (added.empty()) {
+        cout << "Archive up to date: " << archivePath << " (" << unchanged << " unchanged)" << endl;
+        return;
+    }
+
+    // bytes after the last member are left over from an interrupted update
+    fs::resize_file(archivePath, end);
+    fstream out(archivePath, ios::in | ios::out | ios::binary);
+    if (!out) throw runtime_error("Cannot open archive " + archivePath);
+    out.seekp(0, ios::end);
+    MemberWriter writer(out, archivePath, options, (uint32_t)entries.size());
+    for (const ArchiveInput& f : added) writer.add(f);
+
+    // the new members exist once the count says so, and the replaced ones are
+    // marked only after that: an interruption leaves the old archive or both
+    // versions of a file, never neither
+    uint32_t count = (uint32_t)entries.size() + writer.written();
+    out.seekp(5);
+    out.write(reinterpret_cast<char*>(&count), 4);
+    if (!replaced.empty()) {
+        uint8_t ver = ARCHIVE_VERSION_DELETED;
+        out.seekp(4);
+        out.write(reinterpret_cast<char*>(&ver), 1);
+    }
+    for (uint32_t i : replaced) {
+        uint8_t flags = entries[i].flags | ARCHIVE_DELETED;
+        out.seekp((streamoff)flagsOffset(entries[i]));
+        out.write(reinterpret_cast<char*>(&flags), 1);
+        cout << "  - " << entries[i].path << " (superseded)\n";
+    }
+    out.close();
+    if (!out) throw runtime_error("Failed to write archive " + archivePath);
+    if (options.stats) stats_capture_memory(*options.stats);
+    cout << "Archive updated: " << archivePath << " (" << added.size() - replaced.size() << " new, "
+         << replaced.size() << " replaced, " << unchanged << " unchanged)" << endl;
+}
+
+void compactArchive(const string& archivePath) {
+    const string tmpPath = archivePath + ".compact.tmp";
+    uint64_t before = 0;
+    uint32_t kept = 0;
+    size_t hidden = 0;
+    {
+        ArchiveReader reader(archivePath);
+        if (!reader.checksums()) throw runtime_error("Cannot compact a version 4 archive: " + archivePath);
+        const vector<ArchiveEntry>& entries = reader.entries();
+        const uint32_t n = (uint32_t)entries.size();
+        before = reader.membersEnd();
+
+        // a deleted member with live duplicates hands its data to the first
+        // of them, in its own slot so that every reference still points back
+        vector<int64_t> heir(n, -1);
+        vector<bool> absorbed(n);
+        for (uint32_t i = 0; i < n; ++i) {
+            const ArchiveEntry& e = entries[i];
+            if (e.duplicate() && !e.deleted() && entries[e.source].deleted() && heir[e.source] < 0) {
+                heir[e.source] = i;
+                absorbed[i] = true;
+            }
+        }
+        // live members, and the deleted ones kept members copy ranges from
+        vector<bool> keep(n);
+        for (uint32_t i = n; i-- > 0;) {
+            const ArchiveEntry& e = entries[i];
+            if (absorbed[i] || (e.deleted() && heir[i] < 0 && !keep[i])) continue;
+            keep[i] = true;
+            if (e.duplicate()) keep[e.source] = true;
+            for (const ChunkRecord& r : e.chunks)
+                if (r.source != CHUNK_NEW) keep[r.source] = true;
+        }
+        vector<uint32_t> newIndex(n);
+        for (uint32_t i = 0; i < n; ++i) {
+            if (!keep[i]) continue;
+            newIndex[i] = kept++;
+            if (entries[i].deleted() && heir[i] < 0) ++hidden;
+        }
+
+        ofstream out(tmpPath, ios::binary);
+        if (!out) throw runtime_error("Cannot open output archive " + tmpPath);
+        out.write(KITTY_MAGIC_V4.c_str(), KITTY_MAGIC_V4.size());
+        uint8_t ver = hidden ? ARCHIVE_VERSION_DELETED : ARCHIVE_VERSION;
+        out.write(reinterpret_cast<char*>(&ver), 1);
+        out.write(reinterpret_cast<char*>(&kept), 4);
+        for (uint32_t i = 0; i < n; ++i) {
+            if (!keep[i]) continue;
+            const ArchiveEntry& e = entries[i];
+            const string& path = heir[i] >= 0 ? entries[heir[i]].path : e.path;
+            uint8_t flags = heir[i] >= 0 ? (uint8_t)(e.flags & ~ARCHIVE_DELETED) : e.flags;
+            uint16_t pathLen = (uint16_t)path.size();
+            uint64_t origSize = e.origSize, dataSize = e.dataSize;
+            uint32_t crc = e.crc;
+            out.write(reinterpret_cast<char*>(&pathLen), 2);
+            out.write(path.c_str(), pathLen);
+            out.write(reinterpret_cast<char*>(&flags), 1);
+            out.write(reinterpret_cast<char*>(&origSize), 8);
+            out.write(reinterpret_cast<char*>(&dataSize), 8);
+            out.write(reinterpret_cast<char*>(&crc), 4);
+
+            const char* payload = reinterpret_cast<const char*>(reader.payload(e));
+            if (e.duplicate()) {
+                uint32_t source = newIndex[e.source];
+                out.write(reinterpret_cast<char*>(&source), 4);
+            } else if (e.chunked()) {
+                out.write(payload, (streamsize)e.streamSize);
+                for (ChunkRecord r : e.chunks) {
+                    if (r.source != CHUNK_NEW) r.source = newIndex[r.source];
+                    out.write(reinterpret_cast<char*>(&r.length), 4);
+                    out.write(reinterpret_cast<char*>(&r.source), 4);
+                    out.write(reinterpret_cast<char*>(&r.offset), 8);
+                }
+                out.write(payload + e.dataSize - 8, 8);  // stream CRC32C, record count
+            } else {
+                out.write(payload, (streamsize)e.dataSize);
+            }
+        }
+        out.close();
+        if (!out) throw runtime_error("Failed to write archive " + tmpPath);
+        cout << "Compacting " << archivePath << ": " << n << " → " << kept << " member(s)";
+        if (hidden) cout << ", " << hidden << " superseded one(s) kept as chunk sources";
+        cout << "\n";
+    }
+    uint64_t after = (uint64_t)fs::file_size(tmpPath);
+    fs::rename(tmpPath, archivePath);
+    cout << "Archive compacted: " << archivePath << " (" << before << " → " << after << " bytes)" << endl;
+}
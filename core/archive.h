@@ -2,14 +2,145 @@
 #pragma once
 #include <string>
 #include <vector>
+#include "dirscan.h"
+#include "lz77.h"
+#include "mapfile.h"
+#include "stats.h"
 
-struct ArchiveInput {
-    std::string absPath;  // actual disk path
-    std::string relPath;  // path inside archive
+class KittyDictionary;
+
+// Expands files and directories the same way createArchive does (sorted by relPath)
+std::vector<ArchiveInput> collectArchiveInputs(const std::vector<std::string>& inputs);
+
+// Member order in a new archive. Scan compresses files as the parallel
+// directory walk finds them (no wait for the walk, order varies between
+// runs); the others wait for the whole walk and sort: by path, by size
+// (largest first) or by extension (similar files next to each other)
+enum class ArchiveOrder { Scan, Name, Size, Extension };
+bool parseArchiveOrder(const std::string& name, ArchiveOrder& out);
+
+// Files below this size are never split by ArchiveOptions::chunkDedup
+const uint64_t CHUNK_DEDUP_MIN_SIZE = 64 * 1024;
+
+struct ArchiveOptions {
+    int level = LZ77_DEFAULT_LEVEL;
+    KittyStats* stats = nullptr;
+    ArchiveOrder order = ArchiveOrder::Scan;
+    unsigned threads = 0;     // directory walk threads (0 = default)
+    bool chunkDedup = false;  // store repeated content-defined chunks (chunker.h) once across members
+    const KittyDictionary* dict = nullptr;  // preset dictionary (dict.h); extract and test need the same one
+    bool filters = true;      // x86/delta/stride filters chosen per member (filter.h)
+    std::string basePath;     // createArchive: earlier archive whose unchanged members are copied, not recompressed
 };
 
+// Identical files (same size, same XXH64, then compared byte by byte) are
+// stored once; later copies become ARCHIVE_DUPLICATE members. With a
+// basePath, a file with the path, size and CRC32C of a live member of that
+// archive gets its compressed payload copied as is (KP04 has no mtimes, so
+// unchanged files are still read once to compare checksums).
 void createArchive(const std::vector<std::string>& inputs,
-                   const std::string& outputArchive);
+                   const std::string& outputArchive,
+                   const ArchiveOptions& options = ArchiveOptions());
+
+// Adds the files among inputs that are new or changed (size or CRC32C
+// differs from the member with the same path) to the end of an existing
+// version 5+ archive, without rewriting it: only the header count and, for
+// replaced members, their flags byte are patched in place. The replaced
+// members stay in the file, marked ARCHIVE_DELETED, until compactArchive.
+// Dedup only pairs up the files being added.
+void updateArchive(const std::vector<std::string>& inputs,
+                   const std::string& archivePath,
+                   const ArchiveOptions& options = ArchiveOptions());
+
+// Rewrites the archive without its deleted members. Payloads are copied as
+// they are (no decoding); a live duplicate of a deleted member takes over its
+// data, and a deleted member that chunked members still copy ranges from is
+// kept (hidden) until they are replaced too.
+void compactArchive(const std::string& archivePath);
+
+// Header version written by createArchive; older archives down to 4 are read
+const uint8_t ARCHIVE_VERSION = 5;
+const uint8_t ARCHIVE_VERSION_CRC = 5;      // first version with member checksums
+const uint8_t ARCHIVE_VERSION_DELETED = 6;  // archives with ARCHIVE_DELETED members (newest version read)
+
+// ArchiveEntry::flags
+const uint8_t ARCHIVE_COMPRESSED = 1;  // payload is a KittyPress stream
+const uint8_t ARCHIVE_DUPLICATE = 2;   // payload is the u32 index of an earlier member with the same content
+const uint8_t ARCHIVE_CHUNKED = 4;     // payload is a stream of the member's new chunks, the chunk table,
+                                       // u32 CRC32C of the new chunks (version 5), u32 count
+const uint8_t ARCHIVE_DELETED = 8;     // superseded by a later member (version 6): not listed or extracted,
+                                       // kept as a source for members that reference it
+
+// One range of a chunked member, in file order: bytes from the member's own
+// stream (CHUNK_NEW) or a copy of bytes already stored for an earlier member
+// or earlier in this one (confirmed identical when the archive was made)
+const uint32_t CHUNK_NEW = 0xFFFFFFFF;
+struct ChunkRecord {
+    uint32_t length = 0;
+    uint32_t source = CHUNK_NEW;  // member index
+    uint64_t offset = 0;          // position in the source member
+};
+
+struct ArchiveEntry {
+    std::string path;
+    uint8_t flags = 0;
+    uint64_t origSize = 0;
+    uint64_t dataSize = 0;
+    uint64_t offset = 0;  // payload position in the archive
+    uint32_t source = 0;  // ARCHIVE_DUPLICATE: member holding the data
+    uint64_t streamSize = 0;   // KittyPress stream bytes at offset (0 for duplicates)
+    uint64_t streamBytes = 0;  // bytes that stream decodes to
+    uint32_t crc = 0;          // CRC32C of the member's bytes (version 5)
+    uint32_t streamCrc = 0;    // CRC32C of the bytes the stream decodes to (chunked: only the new chunks)
+    std::vector<ChunkRecord> chunks;  // ARCHIVE_CHUNKED: the ranges that make up the file
 
+    bool duplicate() const { return (flags & ARCHIVE_DUPLICATE) != 0; }
+    bool chunked() const { return (flags & ARCHIVE_CHUNKED) != 0; }
+    bool deleted() const { return (flags & ARCHIVE_DELETED) != 0; }
+};
+
+// KP04 archive over a read-only mapping: the entry table is parsed up front
+// and payload() points into the mapping (no copy), safe to use from several
+// threads at once. Version 5 archives carry a CRC32C per member (after its
+// data size), checked by extract and test; version 4 ones only sizes.
+// Member paths that could leave the output folder (absolute, "..") are
+// rejected up front, and no member decodes past its declared size.
+// entries() includes deleted members: they may still be referenced.
+class ArchiveReader {
+public:
+    explicit ArchiveReader(const std::string& path);  // throws on a bad or truncated archive
+
+    const std::vector<ArchiveEntry>& entries() const { return list; }
+    const uint8_t* payload(const ArchiveEntry& e) const { return file.data() + e.offset; }
+    bool checksums() const { return version >= ARCHIVE_VERSION_CRC; }
+    uint64_t membersEnd() const { return end; }  // offset just past the last member
+
+private:
+    MappedFile file;
+    uint8_t version = 0;
+    uint64_t end = 0;
+    std::vector<ArchiveEntry> list;
+
+    void readChunkTable(const uint8_t* p, uint32_t i, ArchiveEntry& e) const;
+};
+
+// How extraction writes duplicate members: a copy of the first extracted
+// file, a hard link to it, or a reflink (copy-on-write clone; copies where
+// the filesystem cannot clone). Links fall back to copies when they fail.
+enum class DuplicateLinks { Copy, Hard, Reflink };
+bool parseDuplicateLinks(const std::string& name, DuplicateLinks& out);
+
+// threads: members decoded in parallel (0 = one per core)
 void extractArchive(const std::string& archivePath,
-                    const std::string& outputFolder);
+                    const std::string& outputFolder,
+                    KittyStats* stats = nullptr,
+                    unsigned threads = 0,
+                    DuplicateLinks links = DuplicateLinks::Copy,
+                    const KittyDictionary* dict = nullptr);
+
+void listArchive(const std::string& archivePath);
+
+// Decodes every member without writing it and checks sizes and checksums;
+// reports each damaged member, then throws if there were any
+void testArchive(const std::string& archivePath, KittyStats* stats = nullptr, unsigned threads = 0,
+                 const KittyDictionary* dict = nullptr);
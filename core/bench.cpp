@@ -0,0 +1,298 @@
+// bench.cpp
+#include "bench.h"
+#include "archive.h"
+#include "codec.h"
+#include "cpu.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+struct BenchResult {
+    string name;
+    uint64_t originalSize = 0;
+    uint64_t compressedSize = 0;
+    double compressBest = 0;       // fastest single iteration (TOTAL: sum of the files' fastest)
+    double decompressBest = 0;
+    KittyStats stats;              // summed over iterations
+};
+
+static vector<uint8_t> readWholeFile(const string &path) {
+    ifstream in(path, ios::binary);
+    if (!in) throw runtime_error("Cannot open " + path);
+    return vector<uint8_t>((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+}
+
+static double elapsedSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static double mbPerSec(uint64_t bytes, double seconds) {
+    if (seconds <= 0) return 0;
+    return (double)bytes / (1024.0 * 1024.0) / seconds;
+}
+
+// Throughput reported and gated: the best of the iterations, which timer
+// noise and scheduling can only make slower
+static double bestCompressMBps(const BenchResult &r) { return mbPerSec(r.originalSize, r.compressBest); }
+static double bestDecompressMBps(const BenchResult &r) { return mbPerSec(r.originalSize, r.decompressBest); }
+
+static double ratioOf(const BenchResult &r) {
+    return r.originalSize ? (double)r.compressedSize / (double)r.originalSize : 1.0;
+}
+
+static void accumulate(BenchResult &total, const BenchResult &r) {
+    total.originalSize += r.originalSize;
+    total.compressedSize += r.compressedSize;
+    total.compressBest += r.compressBest;
+    total.decompressBest += r.decompressBest;
+    total.stats.times.probe += r.stats.times.probe;
+    total.stats.times.lz77 += r.stats.times.lz77;
+    total.stats.times.histogram += r.stats.times.histogram;
+    total.stats.times.huffmanBuild += r.stats.times.huffmanBuild;
+    total.stats.times.encode += r.stats.times.encode;
+    total.stats.times.decode += r.stats.times.decode;
+}
+
+static BenchResult benchOne(const ArchiveInput &file, const BenchOptions &opts) {
+    BenchResult r;
+    r.name = file.relPath;
+    vector<uint8_t> data = readWholeFile(file.absPath);
+    r.originalSize = data.size();
+    string ext = fs::path(file.absPath).extension().string();
+
+    for (int it = 0; it < opts.iterations; ++it) {
+        auto start = chrono::steady_clock::now();
+        vector<uint8_t> packed = compressBuffer(data, ext, opts.level, &r.stats);
+        double seconds = elapsedSince(start);
+        r.compressBest = it == 0 ? seconds : min(r.compressBest, seconds);
+        r.compressedSize = packed.size();
+
+        start = chrono::steady_clock::now();
+        vector<uint8_t> restored = decompressBuffer(packed, &r.stats);
+        seconds = elapsedSince(start);
+        r.decompressBest = it == 0 ? seconds : min(r.decompressBest, seconds);
+
+        if (restored != data) throw runtime_error("Round-trip mismatch: " + file.relPath);
+    }
+    return r;
+}
+
+static string jsonEscape(const string &s) {
+    string out;
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') { out += '\\'; out += (char)c; }
+        else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        }
+        else out += (char)c;
+    }
+    return out;
+}
+
+static void writeJsonResult(ostream &os, const BenchResult &r, const string &indent) {
+    const KittyStageTimes &s = r.stats.times;
+    os << indent << "{\"name\": \"" << jsonEscape(r.name) << "\""
+       << ", \"original_bytes\": " << r.originalSize
+       << ", \"compressed_bytes\": " << r.compressedSize
+       << ", \"ratio\": " << ratioOf(r)
+       << ", \"compress_mbps\": " << bestCompressMBps(r)
+       << ", \"decompress_mbps\": " << bestDecompressMBps(r)
+       << ", \"stages_sec\": {\"probe\": " << s.probe
+       << ", \"lz77\": " << s.lz77
+       << ", \"histogram\": " << s.histogram
+       << ", \"huffman_build\": " << s.huffmanBuild
+       << ", \"encode\": " << s.encode
+       << ", \"decode\": " << s.decode << "}}";
+}
+
+static void writeJson(ostream &os, const vector<BenchResult> &files, const BenchResult &total,
+                      const BenchOptions &opts) {
+    os << setprecision(6);
+    os << "{\n"
+       << "  \"version\": 1,\n"
+       << "  \"level\": " << opts.level << ",\n"
+       << "  \"iterations\": " << opts.iterations << ",\n"
+       << "  \"cpu_tier\": \"" << cpu_tier_name(kernels().tier) << "\",\n"
+       << "  \"files\": [\n";
+    for (size_t i = 0; i < files.size(); ++i) {
+        writeJsonResult(os, files[i], "    ");
+        os << (i + 1 < files.size() ? ",\n" : "\n");
+    }
+    os << "  ],\n  \"total\":\n";
+    writeJsonResult(os, total, "    ");
+    os << "\n}\n";
+}
+
+static void writeTable(ostream &os, const vector<BenchResult> &files, const BenchResult &total,
+                       const BenchOptions &opts) {
+    auto row = [&](const BenchResult &r) {
+        const KittyStageTimes &s = r.stats.times;
+        double stageSum = s.probe + s.lz77 + s.histogram + s.huffmanBuild + s.encode;
+        auto pct = [&](double t) { return stageSum > 0 ? 100.0 * t / stageSum : 0.0; };
+        os << left << setw(32) << r.name.substr(0, 31) << right
+           << setw(12) << r.originalSize
+           << setw(8) << fixed << setprecision(3) << ratioOf(r)
+           << setw(10) << setprecision(1) << bestCompressMBps(r)
+           << setw(10) << bestDecompressMBps(r)
+           << "   " << setprecision(0)
+           << pct(s.probe) << "/" << pct(s.lz77) << "/" << pct(s.histogram) << "/"
+           << pct(s.huffmanBuild) << "/" << pct(s.encode) << "\n";
+    };
+    os << "level " << opts.level << ", " << opts.iterations << " iteration(s), kernels: "
+       << cpu_tier_name(kernels().tier) << "\n\n";
+    os << left << setw(32) << "file" << right << setw(12) << "bytes" << setw(8) << "ratio"
+       << setw(10) << "comp MB/s" << setw(10) << "dec MB/s"
+       << "   % probe/lz77/hist/build/encode\n";
+    for (auto &r : files) row(r);
+    row(total);
+}
+
+struct BaselineEntry {
+    double originalBytes = 0, ratio = 0, compressMBps = 0, decompressMBps = 0;
+};
+
+// Throughput is only compared where a run took at least this long, in the
+// baseline and now; shorter runs are mostly timer and scheduler noise (the
+// ratio, which is deterministic, is compared for every file)
+static const double BENCH_GATE_MIN_SECONDS = 0.05;
+
+// Reads name/ratio/throughput per object from an earlier --json report.
+// Only scans tokens, so reformatted or hand-edited baselines still load.
+static map<string, BaselineEntry> loadBaseline(const string &path) {
+    ifstream in(path);
+    if (!in) throw runtime_error("Cannot open baseline " + path);
+    string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    map<string, BaselineEntry> entries;
+    string current, key;
+    size_t i = 0;
+    auto readString = [&]() {
+        string v;
+        for (++i; i < text.size() && text[i] != '"'; ++i) {
+            if (text[i] == '\\' && i + 1 < text.size()) ++i;
+            v += text[i];
+        }
+        ++i;
+        return v;
+    };
+    while (i < text.size()) {
+        char c = text[i];
+        if (c == '"') {
+            string tok = readString();
+            size_t j = text.find_first_not_of(" \t\r\n", i);
+            if (j != string::npos && text[j] == ':') { key = tok; i = j + 1; }
+            else if (key == "name") current = tok;
+        } else if (c == '-' || (c >= '0' && c <= '9')) {
+            size_t used = 0;
+            double v = stod(text.substr(i, 32), &used);
+            i += used;
+            if (current.empty()) continue;
+            if (key == "original_bytes") entries[current].originalBytes = v;
+            else if (key == "ratio") entries[current].ratio = v;
+            else if (key == "compress_mbps") entries[current].compressMBps = v;
+            else if (key == "decompress_mbps") entries[current].decompressMBps = v;
+        } else {
+            ++i;
+        }
+    }
+    if (entries.empty()) throw runtime_error("No results in baseline " + path);
+    return entries;
+}
+
+// Prints every metric that is worse than the baseline by more than the
+// threshold; returns the number of regressions. Throughput is skipped for
+// results whose runs are under BENCH_GATE_MIN_SECONDS (usually every file of
+// a small corpus but the total).
+static int compareToBaseline(const vector<BenchResult> &files, const BenchResult &total,
+                             const BenchOptions &opts) {
+    map<string, BaselineEntry> base = loadBaseline(opts.baselinePath);
+    double limit = opts.threshold / 100.0;
+    int regressions = 0, ungated = 0;
+    auto check = [&](const string &name, const char *metric, double was, double now, bool higherIsBetter) {
+        if (was <= 0) return;
+        double change = (now - was) / was;
+        bool worse = higherIsBetter ? change < -limit : change > limit;
+        if (!worse) return;
+        ++regressions;
+        ostringstream line;
+        line << "REGRESSION " << name << " " << metric << ": " << was << " -> " << now
+             << " (" << showpos << fixed << setprecision(1) << change * 100.0 << "%)\n";
+        cerr << line.str();
+    };
+    auto checkResult = [&](const BenchResult &r) {
+        auto it = base.find(r.name);
+        if (it == base.end()) return;
+        const BaselineEntry &b = it->second;
+        check(r.name, "ratio", b.ratio, ratioOf(r), false);
+        // a baseline without original_bytes was made from the same files
+        double bytes = b.originalBytes > 0 ? b.originalBytes : (double)r.originalSize;
+        auto gated = [&](double mbps, double best) {
+            double was = mbps > 0 ? bytes / (mbps * 1024.0 * 1024.0) : 0;
+            if (min(was, best) >= BENCH_GATE_MIN_SECONDS) return true;
+            ++ungated;
+            return false;
+        };
+        if (gated(b.compressMBps, r.compressBest))
+            check(r.name, "compress_mbps", b.compressMBps, bestCompressMBps(r), true);
+        if (gated(b.decompressMBps, r.decompressBest))
+            check(r.name, "decompress_mbps", b.decompressMBps, bestDecompressMBps(r), true);
+    };
+    for (auto &r : files) checkResult(r);
+    checkResult(total);
+    if (ungated)
+        cerr << "Throughput not compared for " << ungated << " measurement(s) under "
+             << BENCH_GATE_MIN_SECONDS * 1000 << " ms per run\n";
+    cerr << (regressions ? "Baseline check failed: " : "Baseline check passed: ")
+         << regressions << " regression(s) beyond " << opts.threshold << "%\n";
+    return regressions;
+}
+
+int runBench(const BenchOptions &opts) {
+    if (opts.iterations < 1) throw runtime_error("Iterations must be at least 1.");
+
+    vector<string> inputs = opts.inputs;
+    if (inputs.empty()) {
+        // built-in smoke corpus: repo samples/ from the root or from core/
+        for (const char *dir : { "samples", "../samples" })
+            if (fs::is_directory(dir)) { inputs.push_back(dir); break; }
+        if (inputs.empty()) throw runtime_error("No inputs given and samples/ not found.");
+    }
+
+    vector<ArchiveInput> files = collectArchiveInputs(inputs);
+    if (files.empty()) throw runtime_error("No files to benchmark.");
+    sort(files.begin(), files.end(),
+         [](const ArchiveInput &a, const ArchiveInput &b) { return a.relPath < b.relPath; });
+
+    vector<BenchResult> results;
+    BenchResult total;
+    total.name = "TOTAL";
+    for (auto &f : files) {
+        results.push_back(benchOne(f, opts));
+        accumulate(total, results.back());
+    }
+
+    if (!opts.json) {
+        writeTable(cout, results, total, opts);
+    } else if (opts.jsonPath.empty()) {
+        writeJson(cout, results, total, opts);
+    } else {
+        ofstream out(opts.jsonPath);
+        if (!out) throw runtime_error("Cannot open " + opts.jsonPath);
+        writeJson(out, results, total, opts);
+    }
+
+    if (!opts.baselinePath.empty() && compareToBaseline(results, total, opts) > 0) return 2;
+    return 0;
+}
@@ -0,0 +1,22 @@
+// bench.h
+#pragma once
+#include <string>
+#include <vector>
+#include "lz77.h"
+
+struct BenchOptions {
+    std::vector<std::string> inputs;  // files or directories; empty = samples/
+    int iterations = 3;
+    int level = LZ77_DEFAULT_LEVEL;
+    bool json = false;                // JSON instead of the text table
+    std::string jsonPath;             // write JSON here instead of stdout
+    std::string baselinePath;         // earlier --json report to compare against
+    double threshold = 5.0;           // allowed regression in percent
+};
+
+// In-memory compress/decompress benchmark over a corpus (`kittypress bench`).
+// Every iteration is verified against the input. Throughput is the best of the
+// iterations. Returns the process exit code, which is 2 when a baseline is
+// given and the ratio or (for runs of 50 ms or more) throughput regressed by
+// more than the threshold.
+int runBench(const BenchOptions &opts);
@@ -1,6 +1,14 @@
 // bitstream.cpp
 #include "bitstream.h"
+#include "cpu.h"
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef KITTY_X86
+#include <immintrin.h>
+#endif
 
 BitWriter::BitWriter(std::ostream &stream) : out(stream), buffer(0), bitCount(0) {}
 
@@ -43,3 +51,78 @@ bool BitReader::readBit(bool &bit) {
     bitCount--;
     return true;
 }
+
+uint64_t BitReader::readBitString(std::string &bits, uint64_t maxBits) {
+    uint64_t got = 0;
+    bool bit;
+    // drain a partially consumed byte first
+    while (bitCount > 0 && got < maxBits && readBit(bit)) {
+        bits += (bit ? '1' : '0');
+        ++got;
+    }
+
+    const size_t BLOCK = 64 * 1024;
+    std::vector<uint8_t> buf(BLOCK);
+    const KittyKernels &K = kernels();
+    while (got < maxBits) {
+        size_t want = (size_t)std::min<uint64_t>(BLOCK, (maxBits - got + 7) / 8);
+        in.read(reinterpret_cast<char*>(buf.data()), (std::streamsize)want);
+        size_t n = (size_t)in.gcount();
+        if (n == 0) break;
+        size_t old = bits.size();
+        bits.resize(old + n * 8);
+        K.unpack_bits(buf.data(), n, &bits[old]);
+        got += (uint64_t)n * 8;
+        if (n < want) break;
+    }
+    if (got > maxBits) {
+        bits.resize(bits.size() - (size_t)(got - maxBits));
+        got = maxBits;
+    }
+    return got;
+}
+
+// Bit unpack kernels
+
+void unpack_bits_scalar(const uint8_t *src, size_t nbytes, char *dst) {
+    // 8 chars per byte value, built once
+    static const struct Table {
+        char c[256][8];
+        Table() {
+            for (int v = 0; v < 256; ++v)
+                for (int j = 0; j < 8; ++j)
+                    c[v][j] = (char)('0' + ((v >> (7 - j)) & 1));
+        }
+    } table;
+    for (size_t i = 0; i < nbytes; ++i) {
+        std::memcpy(dst, table.c[src[i]], 8);
+        dst += 8;
+    }
+}
+
+#ifdef KITTY_X86
+KITTY_TARGET("avx2")
+void unpack_bits_avx2(const uint8_t *src, size_t nbytes, char *dst) {
+    // 4 bytes -> 32 chars: replicate each byte over 8 lanes, test one bit per lane
+    const __m256i spread = _mm256_setr_epi8(0,0,0,0,0,0,0,0, 1,1,1,1,1,1,1,1,
+                                            2,2,2,2,2,2,2,2, 3,3,3,3,3,3,3,3);
+    const __m256i mask = _mm256_setr_epi8(
+        (char)0x80,0x40,0x20,0x10,8,4,2,1, (char)0x80,0x40,0x20,0x10,8,4,2,1,
+        (char)0x80,0x40,0x20,0x10,8,4,2,1, (char)0x80,0x40,0x20,0x10,8,4,2,1);
+    const __m256i zeroChar = _mm256_set1_epi8('0');
+    size_t i = 0;
+    for (; i + 4 <= nbytes; i += 4) {
+        uint32_t w;
+        std::memcpy(&w, src + i, 4);
+        __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32((int)w), spread);
+        __m256i set = _mm256_cmpeq_epi8(_mm256_and_si256(v, mask), mask); // 0xFF where bit is 1
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_sub_epi8(zeroChar, set));
+        dst += 32;
+    }
+    unpack_bits_scalar(src + i, nbytes - i, dst);
+}
+#else
+void unpack_bits_avx2(const uint8_t *src, size_t nbytes, char *dst) {
+    unpack_bits_scalar(src, nbytes, dst);
+}
+#endif
@@ -25,4 +25,12 @@ class BitReader {
 public:
     BitReader(std::istream &stream);
     bool readBit(bool &bit);
+
+    // Appends up to maxBits of the remaining stream to bits as '0'/'1' chars
+    // (MSB first); returns the number of bits appended
+    uint64_t readBitString(std::string &bits, uint64_t maxBits);
 };
+
+// Expands nbytes bytes into 8 * nbytes '0'/'1' chars, MSB first
+void unpack_bits_scalar(const uint8_t *src, size_t nbytes, char *dst);
+void unpack_bits_avx2(const uint8_t *src, size_t nbytes, char *dst);
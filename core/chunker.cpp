@@ -0,0 +1,64 @@
+// chunker.cpp
+#include "chunker.h"
+#include <array>
+
+// Gear table from splitmix64: fixed, so the same content always cuts the
+// same way (boundaries are not stored, the decoder never needs this)
+static constexpr std::array<uint64_t, 256> makeGear() {
+    std::array<uint64_t, 256> g{};
+    uint64_t x = 0x4b6974747950ULL;  // "KittyP"
+    for (size_t i = 0; i < 256; ++i) {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        g[i] = z ^ (z >> 31);
+    }
+    return g;
+}
+
+static constexpr std::array<uint64_t, 256> shifted(const std::array<uint64_t, 256> &g) {
+    std::array<uint64_t, 256> s{};
+    for (size_t i = 0; i < 256; ++i) s[i] = g[i] << 1;
+    return s;
+}
+
+static constexpr std::array<uint64_t, 256> GEAR = makeGear();
+static constexpr std::array<uint64_t, 256> GEAR_LS = shifted(GEAR);  // GEAR << 1, for two bytes per step
+
+// Masks for an 8 KiB average with normalization level 2 (15 and 11 bits,
+// spread over the high half of the hash as in the FastCDC paper)
+static const uint64_t MASK_S = 0x0003590703530000ULL;
+static const uint64_t MASK_L = 0x0000d90003530000ULL;
+
+// Hashes two bytes per step with one shift on the dependency chain:
+// (h << 2) + GEAR_LS[a] is the hash after a, shifted left by one, so it is
+// tested against the shifted mask; adding GEAR[b] gives the hash after b.
+// Both positions are tested exactly as the one-byte loop would, which keeps
+// the boundaries independent of where a step starts.
+static inline size_t scan(const uint8_t *data, size_t i, size_t end, uint64_t mask, uint64_t &h, bool &found) {
+    const uint64_t maskLs = mask << 1;
+    for (; i + 2 <= end; i += 2) {
+        h = (h << 2) + GEAR_LS[data[i]];
+        if (!(h & maskLs)) { h >>= 1; found = true; return i + 1; }
+        h += GEAR[data[i + 1]];
+        if (!(h & mask)) { found = true; return i + 2; }
+    }
+    if (i < end) {
+        h = (h << 1) + GEAR[data[i]];
+        ++i;
+        if (!(h & mask)) found = true;
+    }
+    return i;
+}
+
+size_t cdc_cut(const uint8_t *data, size_t size) {
+    if (size <= CDC_MIN_CHUNK) return size;
+    size_t end = size < CDC_MAX_CHUNK ? size : CDC_MAX_CHUNK;
+    size_t normal = end < CDC_AVG_CHUNK ? end : CDC_AVG_CHUNK;
+    uint64_t h = 0;
+    bool found = false;
+    size_t i = scan(data, CDC_MIN_CHUNK, normal, MASK_S, h, found);
+    if (found) return i;
+    i = scan(data, i, end, MASK_L, h, found);
+    return i;
+}
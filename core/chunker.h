@@ -0,0 +1,19 @@
+// chunker.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// FastCDC content-defined chunking: a gear rolling hash picks the chunk
+// boundaries, so an insert or delete only moves the boundaries next to the
+// edit and the rest of a near-identical file cuts into the same chunks.
+// Normalized chunking (a stricter mask before CDC_AVG_CHUNK, a looser one
+// after) keeps sizes close to the average; the first CDC_MIN_CHUNK bytes of
+// a chunk are skipped without hashing.
+const size_t CDC_MIN_CHUNK = 2 * 1024;
+const size_t CDC_AVG_CHUNK = 8 * 1024;
+const size_t CDC_MAX_CHUNK = 64 * 1024;
+
+// Length of the chunk starting at data. Returns size when there is no
+// boundary in the first size bytes and size < CDC_MAX_CHUNK: at the end of
+// the input that is the last chunk, otherwise the caller needs more data.
+size_t cdc_cut(const uint8_t *data, size_t size);
@@ -0,0 +1,1609 @@
+// codec.cpp  (KP03 push encoder/decoder; the file, archive and buffer APIs wrap these)
+#include "codec.h"
+#include "bitstream.h"
+#include "crc32c.h"
+#include "dict.h"
+#include "filter.h"
+#include "huffman.h"
+#include "huffdec.h"
+#include "histogram.h"
+#include "kitty.h"
+#include "memstream.h"
+#include "memtrack.h"
+#include "probe.h"
+#include "trace.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static const uint64_t MAX_EXT_LEN = 4096;            // sanity limit while buffering a header
+static const uint32_t MAX_FILTER_BLOCKS = 1u << 24;  // KP08 block table entries
+
+// KP05 framing
+static const uint8_t FRAME_VERSION = 6;              // 6: blocks carry a CRC32C of their bytes
+static const uint8_t FRAME_VERSION_NO_CRC = 5;
+static const uint8_t FRAME_STORED = 0;               // raw bytes; restarts the LZ77 window
+static const uint8_t FRAME_LZ = 1;                   // LZ77 tokens + canonical Huffman
+static const uint32_t MAX_FRAME_BLOCK = 64u << 20;   // decoder sanity limit
+
+// KP06 code table choice
+static const uint8_t DICT_OWN_TABLE = 0;   // the input's own table follows
+static const uint8_t DICT_DICT_TABLE = 1;  // the dictionary's table
+
+// Adds the wall time of its scope to *slot (no-op when slot is null)
+class StageTimer {
+public:
+    explicit StageTimer(double *s) : slot(s), start(chrono::steady_clock::now()) {}
+    ~StageTimer() {
+        if (slot) *slot += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+private:
+    double *slot;
+    chrono::steady_clock::time_point start;
+};
+
+static double *stageSlot(KittyStats *stats, double KittyStageTimes::*field) {
+    return stats ? &(stats->times.*field) : nullptr;
+}
+
+// --stats bookkeeping
+static void noteProbe(KittyStats *stats, double entropy, bool skipped) {
+    if (!stats) return;
+    KITTY_STAT(stats->probedFiles++);
+    KITTY_STAT(stats->entropySum += entropy);
+    KITTY_STAT(stats->entropySkips += skipped);
+}
+
+static void noteBlock(KittyStats *stats, ProbeMode mode) {
+    if (!stats) return;
+    KITTY_STAT(stats->probeBlocks[(size_t)mode]++);
+}
+
+static void noteFilter(KittyStats *stats, const FilterSpec &spec) {
+    if (!stats || spec.kind == FilterKind::None) return;
+    KITTY_STAT(stats->filteredBlocks++);
+}
+
+static void noteLz(KittyStats *stats, const LZ77StreamCompressor &lz, uint64_t lzBytes) {
+    if (!stats) return;
+    KITTY_STAT(stats->lz.add(lz.matchStats()));
+    KITTY_STAT(stats->lzBytes += lzBytes);
+}
+
+static void noteHuffman(KittyStats *stats, size_t symbols, uint64_t encodedBits) {
+    if (!stats) return;
+    KITTY_STAT(stats->huffmanTables++);
+    KITTY_STAT(stats->huffmanSymbols += symbols);
+    KITTY_STAT(stats->encodedBits += encodedBits);
+}
+
+static void noteResult(KittyStats *stats, uint64_t bytesIn, uint64_t bytesOut, bool raw) {
+    if (!stats) return;
+    stats_capture_memory(*stats);
+    KITTY_STAT(stats->files++);
+    KITTY_STAT(stats->bytesIn += bytesIn);
+    KITTY_STAT(stats->bytesOut += bytesOut);
+    KITTY_STAT(stats->storedRaw += raw);
+}
+
+// magic + isCompressed + extension, shared by raw and compressed KP03 payloads
+static void writeKP03Prefix(ostream &out, bool isCompressed, const string &ext) {
+    out.write(KITTY_MAGIC_V3.c_str(), KITTY_MAGIC_V3.size());
+    out.write(reinterpret_cast<const char*>(&isCompressed), sizeof(isCompressed));
+    uint64_t extLen = ext.size();
+    out.write(reinterpret_cast<const char*>(&extLen), sizeof(extLen));
+    if (extLen > 0) out.write(ext.c_str(), extLen);
+}
+
+static uint64_t kp03PrefixSize(const string &ext) {
+    return KITTY_MAGIC_V3.size() + sizeof(bool) + sizeof(uint64_t) + ext.size();
+}
+
+static bool anyFiltered(const vector<FilterBlock> &blocks) {
+    for (auto &b : blocks)
+        if (b.spec.kind != FilterKind::None) return true;
+    return false;
+}
+
+// KP08 prefix in front of the KP03 stream of filtered bytes (none when no
+// block is filtered)
+static void writeFilterPrefix(ostream &out, const vector<FilterBlock> &blocks) {
+    if (!anyFiltered(blocks)) return;
+    out.write(KITTY_MAGIC_V8.c_str(), KITTY_MAGIC_V8.size());
+    uint32_t count = (uint32_t)blocks.size();
+    out.write(reinterpret_cast<const char*>(&count), 4);
+    for (auto &b : blocks) {
+        uint8_t f[2] = { (uint8_t)b.spec.kind, b.spec.param };
+        out.write(reinterpret_cast<const char*>(&b.length), 8);
+        out.write(reinterpret_cast<const char*>(f), 2);
+    }
+}
+
+static uint64_t filterPrefixSize(const vector<FilterBlock> &blocks) {
+    return anyFiltered(blocks) ? KITTY_MAGIC_V8.size() + 4 + FILTER_BLOCK_RECORD * blocks.size() : 0;
+}
+
+// Total encoded size in bits, straight from the histogram
+static uint64_t encodedBitLength(const ByteHistogram &freq, const unordered_map<unsigned char, string> &huffmanCode) {
+    uint64_t bits = 0;
+    for (int c = 0; c < 256; ++c) {
+        if (freq[c] == 0) continue;
+        auto it = huffmanCode.find((unsigned char)c);
+        if (it == huffmanCode.end()) throw runtime_error("Huffman code missing for byte (unexpected).");
+        bits += freq[c] * it->second.size();
+    }
+    return bits;
+}
+
+static void writeCodeMap(ostream &out, const unordered_map<unsigned char, string> &huffmanCode) {
+    uint64_t mapSize = huffmanCode.size();
+    out.write(reinterpret_cast<const char*>(&mapSize), sizeof(mapSize));
+    for (auto &pair : huffmanCode) {
+        unsigned char c = pair.first;
+        const string &code = pair.second;
+        uint64_t len = code.size();
+        out.write(reinterpret_cast<const char*>(&c), sizeof(c));
+        out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        out.write(code.c_str(), len);
+    }
+}
+
+static uint64_t codeMapSize(const unordered_map<unsigned char, string> &huffmanCode) {
+    uint64_t size = sizeof(uint64_t);
+    for (auto &pair : huffmanCode) size += 1 + sizeof(uint64_t) + pair.second.size();
+    return size;
+}
+
+static unordered_map<unsigned char, string> readCodeMap(istream &in) {
+    uint64_t mapSize = 0;
+    in.read(reinterpret_cast<char*>(&mapSize), sizeof(mapSize));
+    if (!in || mapSize == 0 || mapSize > 256) throw runtime_error("Corrupted .kitty header (code map size).");
+    unordered_map<unsigned char, string> huffmanCode;
+    for (uint64_t i = 0; i < mapSize; ++i) {
+        unsigned char c; uint64_t len;
+        in.read(reinterpret_cast<char*>(&c), sizeof(c));
+        in.read(reinterpret_cast<char*>(&len), sizeof(len));
+        if (!in || len == 0 || len > 256) throw runtime_error("Corrupted .kitty header (code length).");
+        string code(len, '\0');
+        in.read(&code[0], len);
+        if (!in) throw runtime_error("Truncated .kitty header.");
+        huffmanCode[c] = code;
+    }
+    return huffmanCode;
+}
+
+// Per-byte code lookup without hashing
+struct CodeLookup {
+    array<const string*, 256> code{};
+    explicit CodeLookup(const unordered_map<unsigned char, string> &huffmanCode) {
+        for (auto &p : huffmanCode) code[p.first] = &p.second;
+    }
+};
+
+static void encodeBytes(BitWriter &writer, const CodeLookup &codes, const uint8_t *data, size_t n) {
+    for (size_t i = 0; i < n; ++i) writer.writeBits(*codes.code[data[i]]);
+}
+
+// KP05/KP06 code table: u16 symbol count, then (symbol, length) pairs
+static uint64_t codeLengthsSize(const array<uint8_t, 256> &lengths) {
+    uint64_t symbols = 0;
+    for (uint8_t len : lengths) symbols += len != 0;
+    return 2 + 2 * symbols;
+}
+
+static void writeCodeLengths(ostream &out, const array<uint8_t, 256> &lengths) {
+    uint16_t symbols = 0;
+    for (uint8_t len : lengths) symbols += len != 0;
+    out.write(reinterpret_cast<const char*>(&symbols), 2);
+    for (int c = 0; c < 256; ++c) {
+        if (!lengths[c]) continue;
+        uint8_t entry[2] = { (uint8_t)c, lengths[c] };
+        out.write(reinterpret_cast<const char*>(entry), 2);
+    }
+}
+
+// Parses a code table at p; returns its size, or 0 when size bytes do not
+// hold all of it yet. Throws on a malformed table.
+static size_t readCodeLengths(const uint8_t *p, size_t size, array<uint8_t, 256> &lengths, const string &format) {
+    uint16_t symbols = 0;
+    if (size < 2) return 0;
+    memcpy(&symbols, p, 2);
+    if (symbols == 0 || symbols > 256) throw runtime_error("Corrupted " + format + " stream (symbol count).");
+    size_t need = 2 + 2 * (size_t)symbols;
+    if (size < need) return 0;
+    lengths.fill(0);
+    for (uint16_t i = 0; i < symbols; ++i) {
+        uint8_t sym = p[2 + 2 * i], len = p[3 + 2 * i];
+        if (len == 0 || lengths[sym]) throw runtime_error("Corrupted " + format + " stream (code table).");
+        lengths[sym] = len;
+    }
+    return need;
+}
+
+// Canonical code lengths for one KP05 block's tokens and the bits they code
+// to; false when a code would be longer than MAX_CANONICAL_CODE_LEN
+static bool frameCodeLengths(const ByteHistogram &freq, array<uint8_t, 256> &lengths, uint64_t &bits) {
+    lengths.fill(0);
+    bits = 0;
+    for (auto &p : buildHuffmanCodes(freq)) {
+        if (p.second.size() > MAX_CANONICAL_CODE_LEN) return false;
+        lengths[p.first] = (uint8_t)p.second.size();
+        bits += freq[p.first] * p.second.size();
+    }
+    return true;
+}
+
+// KP05 stream header: magic, version, nominal block size
+static void frameStreamHeader(uint8_t (&header)[9], uint32_t blockSize) {
+    memcpy(header, KITTY_MAGIC_V5.data(), 4);
+    header[4] = FRAME_VERSION;
+    memcpy(header + 5, &blockSize, 4);
+}
+
+// KP05 block header: raw length, type, payload length, CRC32C of the raw bytes
+static void frameBlockHeader(uint8_t (&header)[13], uint32_t rawLen, uint8_t type, uint32_t payloadLen, uint32_t crc) {
+    memcpy(header, &rawLen, 4);
+    header[4] = type;
+    memcpy(header + 5, &payloadLen, 4);
+    memcpy(header + 9, &crc, 4);
+}
+
+// Legacy KP01/KP02 Huffman-on-bytes body after the code map
+static void decodeLegacyHuffmanBody(istream &in, ostream &out, const unordered_map<unsigned char, string> &huffmanCode) {
+    uint64_t encodedLen = 0;
+    in.read(reinterpret_cast<char*>(&encodedLen), sizeof(encodedLen));
+    BitReader reader(in);
+    string bitstream;  // grows with the bits actually present, not the declared length
+    if (reader.readBitString(bitstream, encodedLen) < encodedLen) throw runtime_error("Truncated .kitty body.");
+    unordered_map<string, unsigned char> reverseCode;
+    for (auto &p : huffmanCode) reverseCode[p.second] = p.first;
+    string current;
+    vector<char> decoded;
+    for (char b : bitstream) {
+        current += b;
+        auto it = reverseCode.find(current);
+        if (it != reverseCode.end()) {
+            decoded.push_back((char)it->second);
+            current.clear();
+        } else if (current.size() > 256) {
+            throw runtime_error("Corrupted .kitty body (no code matches).");
+        }
+    }
+    if (!decoded.empty()) out.write(decoded.data(), decoded.size());
+}
+
+// Whole KP01 stream, or a compressed KP02 one, buffered in full
+static string decodeLegacyStream(istream &in, ostream &out) {
+    string magic(4, '\0');
+    in.read(&magic[0], 4);
+    if (magic == KITTY_MAGIC_V1) {
+        decodeLegacyHuffmanBody(in, out, readCodeMap(in));
+        return "Decompressed (KP01) successfully";
+    }
+    uint8_t isCompressed = 0;  // a byte, not a bool: any value may be on disk
+    in.read(reinterpret_cast<char*>(&isCompressed), sizeof(isCompressed));
+    uint64_t extLen = 0;
+    in.read(reinterpret_cast<char*>(&extLen), sizeof(extLen));
+    in.ignore((streamsize)extLen);
+    decodeLegacyHuffmanBody(in, out, readCodeMap(in));
+    return "Decompressed (KP02) successfully";
+}
+
+// Encoder byte store: memory up to limit, then a temp file at path (never
+// spills when path is empty). Replayed once, in order, by finish().
+class SpillBuffer {
+public:
+    SpillBuffer(const string &path, size_t limit) : path(path), limit(limit) {}
+    ~SpillBuffer() {
+        if (file.is_open()) file.close();
+        if (spilled) { error_code ec; fs::remove(path, ec); }
+    }
+
+    void append(const uint8_t *data, size_t n) {
+        total += n;
+        if (!spilled && (path.empty() || mem.size() + n <= limit)) {
+            if (!path.empty() && mem.capacity() < mem.size() + n)
+                mem.reserve(min(limit, max(2 * mem.capacity(), mem.size() + n)));
+            mem.insert(mem.end(), data, data + n);
+            charge.set(mem.capacity());
+            return;
+        }
+        if (!spilled) {
+            file.open(path, ios::binary | ios::trunc);
+            if (!file.is_open()) throw runtime_error("Cannot open temporary spill file " + path);
+            spilled = true;
+            file.write(reinterpret_cast<const char*>(mem.data()), (streamsize)mem.size());
+            vector<uint8_t>().swap(mem);
+            charge.set(0);
+        }
+        file.write(reinterpret_cast<const char*>(data), (streamsize)n);
+        if (!file) throw runtime_error("Failed to write temporary spill file " + path);
+    }
+
+    uint64_t size() const { return total; }
+
+    // Calls f(data, n) over everything appended, at most chunk bytes at a time
+    template <class F> void replay(size_t chunk, F f) {
+        if (!spilled) {
+            for (size_t at = 0; at < mem.size(); at += chunk) f(mem.data() + at, min(chunk, mem.size() - at));
+            return;
+        }
+        file.close();
+        ifstream in(path, ios::binary);
+        if (!in.is_open()) throw runtime_error("Failed to reopen temporary spill file " + path);
+        MemCharge bufCharge(MemSubsystem::IO, chunk);
+        vector<uint8_t> buf(chunk);
+        for (uint64_t left = total; left > 0;) {
+            size_t want = (size_t)min<uint64_t>(left, chunk);
+            in.read(reinterpret_cast<char*>(buf.data()), (streamsize)want);
+            if ((size_t)in.gcount() != want) throw runtime_error("Temporary spill file truncated: " + path);
+            f(buf.data(), want);
+            left -= want;
+        }
+    }
+
+private:
+    string path;
+    size_t limit;
+    vector<uint8_t> mem;
+    MemCharge charge{ MemSubsystem::IO };
+    ofstream file;
+    bool spilled = false;
+    uint64_t total = 0;
+};
+
+// ---- encoder ----
+
+KittyPeek kitty_file_peek(const string &path) {
+    auto in = make_shared<ifstream>();
+    return [in, path](uint64_t offset, uint8_t *buf, size_t size) -> size_t {
+        if (!in->is_open()) {
+            in->open(path, ios::binary);
+            if (!in->is_open()) throw runtime_error("Cannot open input: " + path);
+        }
+        in->clear();
+        in->seekg((streamoff)offset);
+        in->read(reinterpret_cast<char*>(buf), (streamsize)size);
+        return (size_t)in->gcount();
+    };
+}
+
+KittyPeek kitty_buffer_peek(const uint8_t *data, size_t size) {
+    return [data, size](uint64_t offset, uint8_t *buf, size_t n) -> size_t {
+        if (offset >= size) return 0;
+        n = (size_t)min<uint64_t>(n, size - offset);
+        memcpy(buf, data + offset, n);
+        return n;
+    };
+}
+
+struct KittyEncoder::Impl {
+    enum class Mode { Probe, Raw, Lz, Done };
+
+    KittySink sink;
+    KittyEncoderOptions opts;
+    MemPlan plan = mem_plan();
+    Mode mode = Mode::Probe;
+
+    vector<uint8_t> sample;  // probe bytes (the first block), held until the raw/LZ77 decision
+    MemCharge sampleCharge{ MemSubsystem::IO };
+    unique_ptr<LZ77StreamCompressor> lz;
+    vector<uint8_t> chunk;   // input gathered into plan.ioChunk pieces (same token stream for any update sizes)
+    MemCharge chunkCharge{ MemSubsystem::IO };
+    SpillBuffer spill;       // LZ77 token bytes, or raw bytes when the total size is unknown
+    bool filtering = false;  // input goes through filter.h filters, one pick per FILTER_BLOCK_SIZE
+    vector<uint8_t> block;   // input of the block being gathered (probeSample bytes)
+    ProbeMode pieceMode = ProbeMode::Strong;  // the probe's pick for the piece in chunk
+    vector<FilterBlock> filterBlocks;
+    unique_ptr<FilterStream> filter;  // encoder of the last block record, if filtered
+    vector<uint8_t> filtered;
+    MemCharge blockCharge{ MemSubsystem::IO };
+    ByteHistogram freq = {};
+    bool rawStreaming = false;  // raw header already written, input passes straight through
+
+    // The token stream cut at piece boundaries into KP05 blocks of about
+    // plan.probeSample input bytes (see openFrame), each of stored or of
+    // matched pieces only, for finishLz to weigh against one KP03 table
+    struct Frame {
+        bool stored = false;
+        uint64_t rawBytes = 0;
+        uint64_t tokenBytes = 0;
+        uint64_t payloadBytes = 0;  // matched: code table + bit length + coded tokens (0 = no canonical code)
+    };
+    vector<Frame> frames;
+    uint64_t frameStart = 0;        // spill offset of the last frame's tokens
+    ByteHistogram frameFreq = {};   // its token histogram (added to freq when it closes)
+
+    bool probed = false, skipped = false, raw = false;
+    double entropy = 0;
+    uint64_t in = 0, out = 0;
+
+    Impl(KittySink s, const KittyEncoderOptions &o)
+        : sink(move(s)), opts(o), spill(o.spillPath, plan.spillBuffer) {}
+
+    void emit(const uint8_t *data, size_t n) {
+        if (n == 0) return;
+        sink(data, n);
+        out += n;
+    }
+
+    void emitRawHeader(uint64_t rawSize) {
+        CallbackOStream os([this](const uint8_t *p, size_t n) { emit(p, n); }, 256);
+        writeKP03Prefix(os, false, opts.ext);
+        os.write(reinterpret_cast<const char*>(&rawSize), sizeof(rawSize));
+        os.flush();
+    }
+
+    void decide() {
+        if (!opts.storeRaw && !sample.empty()) {
+            KITTY_TRACE("entropy probe");
+            StageTimer timer(stageSlot(opts.stats, &KittyStageTimes::probe));
+            probeRegions();
+            probed = true;
+            noteProbe(opts.stats, entropy, skipped);
+        }
+        vector<uint8_t> held;
+        held.swap(sample);
+        if (opts.storeRaw || skipped) {
+            mode = Mode::Raw;
+            if (opts.sizeHintSet) {
+                emitRawHeader(opts.sizeHint);
+                rawStreaming = true;
+            }
+            feedRaw(held.data(), held.size());
+        } else {
+            mode = Mode::Lz;
+            if (opts.dict) lz = opts.dict->compressor(plan.lzWindow, opts.level);
+            else lz.reset(new LZ77StreamCompressor(plan.lzWindow, 255, opts.level));
+            filtering = opts.filters && plan.filters && !opts.dict;
+            block.swap(held);  // the probe sample is the first block
+            block.reserve(plan.probeSample);
+            blockCharge.set(block.capacity());
+            chunk.reserve(plan.ioChunk);
+            chunkCharge.set(3 * plan.ioChunk);  // chunk + up to 2 serialized bytes per input byte
+            if (block.size() == plan.probeSample) encodeBlock();
+        }
+        vector<uint8_t>().swap(held);
+        sampleCharge.set(0);
+    }
+
+    // Whole-input decision: up to PROBE_REGIONS regions of PROBE_REGION_SIZE
+    // spread over the input (over the sample without opts.peek; a smaller
+    // input gets one region per started PROBE_REGION_SIZE), each probed on its
+    // own. The input is stored raw only when at least 7 of 8 regions would be
+    // stored; a mixed input goes to LZ77 and encodePiece decides again per piece.
+    void probeRegions() {
+        uint64_t total = sample.size();
+        if (opts.peek && opts.sizeHintSet && opts.sizeHint > total) total = opts.sizeHint;
+        size_t regions = (size_t)min<uint64_t>(PROBE_REGIONS, (total + PROBE_REGION_SIZE - 1) / PROBE_REGION_SIZE);
+        if (regions == 0) regions = 1;
+        size_t len = (size_t)min<uint64_t>(total, PROBE_REGION_SIZE);
+        vector<uint8_t> peeked;
+        MemCharge peekCharge(MemSubsystem::IO);
+        size_t stored = 0;
+        double entropySum = 0;
+        for (size_t r = 0; r < regions; ++r) {
+            uint64_t at = regions == 1 ? 0 : (total - len) / (regions - 1) * r;
+            ProbeResult probe;
+            if (at + len <= sample.size()) {
+                probe = probe_sample(sample.data() + at, len);
+            } else {
+                peeked.resize(len);
+                peekCharge.set(peeked.capacity());
+                probe = probe_sample(peeked.data(), opts.peek(at, peeked.data(), len));
+            }
+            entropySum += probe.entropy;
+            stored += probe_mode(probe) == ProbeMode::Store;
+        }
+        entropy = entropySum / (double)regions;
+        skipped = stored * 8 >= regions * 7;
+    }
+
+    void feedRaw(const uint8_t *data, size_t n) {
+        if (!rawStreaming) { spill.append(data, n); return; }
+        if (in > opts.sizeHint) throw runtime_error("Input is larger than the size hint.");
+        emit(data, n);
+    }
+
+    void feedLz(const uint8_t *data, size_t n) {
+        while (n > 0) {
+            size_t take = min(n, plan.probeSample - block.size());
+            block.insert(block.end(), data, data + take);
+            blockCharge.set(block.capacity() + filtered.capacity());
+            data += take;
+            n -= take;
+            if (block.size() == plan.probeSample) encodeBlock();
+        }
+    }
+
+    // Per-piece probe over the block's FILTER_BLOCK_SIZE pieces (the ones the
+    // filters pick for), so a head or body that differs from the rest of a
+    // file is told apart: a Store piece becomes literal tokens without a match
+    // search, the others are matched at the level the whole block's estimate
+    // calls for (their own when the block as a whole would be stored; one
+    // piece is too little to tell fast from strong). A filtered piece is
+    // matched at the requested level, since the probe only saw it unfiltered.
+    void encodeBlock() {
+        if (block.empty()) return;
+        ProbeMode blockPick = blockProbe(block.data(), block.size());
+        for (size_t at = 0; at < block.size(); at += FILTER_BLOCK_SIZE)
+            encodePiece(block.data() + at, min(FILTER_BLOCK_SIZE, block.size() - at), blockPick);
+        block.clear();
+    }
+
+    ProbeMode blockProbe(const uint8_t *data, size_t n) {
+        KITTY_TRACE("block probe");
+        StageTimer timer(stageSlot(opts.stats, &KittyStageTimes::probe));
+        return probe_mode(probe_sample(data, n));
+    }
+
+    void encodePiece(const uint8_t *data, size_t n, ProbeMode blockPick) {
+        ProbeMode pick = n == block.size() ? blockPick : blockProbe(data, n);
+        if (pick != ProbeMode::Store && blockPick != ProbeMode::Store) pick = blockPick;
+        FilterSpec spec;
+        if (filtering && pick != ProbeMode::Store) spec = filter_choose(data, n);
+        if (spec.kind != FilterKind::None && pick == ProbeMode::Fast) pick = ProbeMode::Strong;
+        noteBlock(opts.stats, pick);
+
+        if (pick != pieceMode && pick != ProbeMode::Store) {
+            // after stored pieces the window starts over, as a KP05 stored
+            // block restarts it (a whole stored piece already fills the window)
+            if (pieceMode == ProbeMode::Store && !opts.dict) {
+                if (opts.stats) KITTY_STAT(opts.stats->lz.add(lz->matchStats()));
+                lz.reset();  // before the new one is charged
+                lz.reset(new LZ77StreamCompressor(plan.lzWindow, 255, opts.level));
+            }
+            lz->setLevel(probe_level(pick, opts.level));
+        }
+        pieceMode = pick;
+        openFrame(pick == ProbeMode::Store, n);
+
+        if (filtering) filterPiece(data, n, spec);
+        else feedChunks(data, n);
+        if (!chunk.empty()) compressChunk(false);
+    }
+
+    // Starts a new frame unless the piece continues the last one. A full
+    // matched frame that would not beat its raw bytes takes the next matched
+    // pieces too (up to twice the size): written stored, it would cut off
+    // the window the next frame's matches reach into.
+    void openFrame(bool stored, size_t n) {
+        bool split = frames.empty() || frames.back().stored != stored;
+        if (!split && frames.back().rawBytes + n > plan.probeSample) {
+            split = stored || frames.back().rawBytes + n > 2 * plan.probeSample;
+            if (!split) {
+                uint64_t payload = framePayload();
+                split = payload > 0 && payload < frames.back().rawBytes;
+            }
+        }
+        if (split) {
+            closeFrame();
+            frames.push_back(Frame());
+            frames.back().stored = stored;
+            frameStart = spill.size();
+        }
+        frames.back().rawBytes += n;
+    }
+
+    // Code table + bit length + coded tokens of the open frame (0 = no canonical code)
+    uint64_t framePayload() {
+        KITTY_TRACE("huffman build");
+        StageTimer timer(stageSlot(opts.stats, &KittyStageTimes::huffmanBuild));
+        array<uint8_t, 256> lengths;
+        uint64_t bits;
+        if (!frameCodeLengths(frameFreq, lengths, bits)) return 0;
+        return codeLengthsSize(lengths) + 8 + (bits + 7) / 8;
+    }
+
+    void closeFrame() {
+        if (frames.empty()) return;
+        Frame &f = frames.back();
+        f.tokenBytes = spill.size() - frameStart;
+        if (!f.stored && f.tokenBytes > 0) f.payloadBytes = framePayload();
+        for (int c = 0; c < 256; ++c) freq[c] += frameFreq[c];
+        frameFreq.fill(0);
+    }
+
+    // A piece with the same filter as the one before continues its stream
+    // and record; a different one finishes it and starts a new record
+    void filterPiece(const uint8_t *data, size_t n, const FilterSpec &spec) {
+        noteFilter(opts.stats, spec);
+        if (filterBlocks.empty() || filterBlocks.back().spec.kind != spec.kind
+            || filterBlocks.back().spec.param != spec.param) {
+            finishFilter();
+            filterBlocks.push_back({ 0, spec });
+            if (spec.kind != FilterKind::None) filter.reset(new FilterStream(spec, true));
+        }
+        filterBlocks.back().length += n;
+        if (!filter) { feedChunks(data, n); return; }
+        KITTY_TRACE("filter block");
+        for (size_t at = 0; at < n; at += plan.ioChunk) {
+            filtered.clear();
+            filter->update(data + at, min(plan.ioChunk, n - at), filtered);
+            blockCharge.set(block.capacity() + filtered.capacity());
+            feedChunks(filtered.data(), filtered.size());
+        }
+    }
+
+    void finishFilter() {
+        if (!filter) return;
+        filtered.clear();
+        filter->finish(filtered);
+        feedChunks(filtered.data(), filtered.size());
+        filter.reset();
+    }
+
+    void feedChunks(const uint8_t *data, size_t n) {
+        while (n > 0) {
+            size_t take = min(n, plan.ioChunk - chunk.size());
+            chunk.insert(chunk.end(), data, data + take);
+            data += take;
+            n -= take;
+            if (chunk.size() == plan.ioChunk) compressChunk(false);
+        }
+    }
+
+    void compressChunk(bool last) {
+        KITTY_TRACE("lz77 block");
+        vector<uint8_t> tokens;
+        {
+            StageTimer timer(stageSlot(opts.stats, &KittyStageTimes::lz77));
+            if (pieceMode == ProbeMode::Store) lz->feedLiterals(chunk);
+            else lz->feed(chunk, last);
+            tokens = lz->consumeOutput();
+        }
+        chunk.clear();
+        if (tokens.empty()) return;
+        spill.append(tokens.data(), tokens.size());
+        StageTimer timer(stageSlot(opts.stats, &KittyStageTimes::histogram));
+        histogram_add(frameFreq, tokens.data(), tokens.size());
+    }
+
+    // Raw payload rebuilt from the held tokens (the input itself is gone)
+    void emitRawFromTokens() {
+        emitRawHeader(in);
+        LZ77StreamDecompressor dec;
+        if (opts.dict) dec.prime(opts.dict->content().data(), opts.dict->content().size());
+        unique_ptr<FilterChain> unfilter;
+        if (anyFiltered(filterBlocks)) unfilter.reset(new FilterChain(filterBlocks, false));
+        uint64_t restored = 0;
+        auto put = [&](const vector<uint8_t> &bytes) {
+            if (!unfilter) {
+                emit(bytes.data(), bytes.size());
+            } else {
+                filtered.clear();
+                unfilter->update(bytes.data(), bytes.size(), filtered);
+                emit(filtered.data(), filtered.size());
+            }
+            restored += bytes.size();
+        };
+        spill.replay(plan.ioChunk, [&](const uint8_t *p, size_t n) {
+            for (size_t at = 0; at < n; at += plan.decodeSlice) {
+                dec.feed(p + at, min(plan.decodeSlice, n - at));
+                put(dec.consumeOutput());
+            }
+        });
+        if (unfilter) {
+            filtered.clear();
+            unfilter->finish(filtered);
+            emit(filtered.data(), filtered.size());
+        }
+        if (restored != in) throw runtime_error("LZ77 token replay size mismatch (unexpected).");
+        raw = true;
+    }
+
+    void finishLz() {
+        encodeBlock();
+        finishFilter();
+        vector<uint8_t>().swap(block);
+        vector<uint8_t>().swap(filtered);
+        blockCharge.set(0);
+        if (!chunk.empty()) compressChunk(false);
+        compressChunk(true);
+        closeFrame();
+        noteLz(opts.stats, *lz, spill.size());
+        lz.reset();
+        chunkCharge.set(plan.ioChunk);  // encode output buffer
+
+        if (histogram_total(freq) == 0) { emitRawFromTokens(); return; }
+
+        unordered_map<unsigned char, string> huffmanCode;
+        uint64_t encodedLen;
+        {
+            KITTY_TRACE("huffman build");
+            StageTimer timer(stageSlot(opts.stats, &KittyStageTimes::huffmanBuild));
+            huffmanCode = buildHuffmanCodes(freq);
+            encodedLen = encodedBitLength(freq, huffmanCode);
+        }
+        if (opts.dict) {
+            noteHuffman(opts.stats, huffmanCode.size(), encodedLen);
+            finishDictLz(huffmanCode, encodedLen);
+            return;
+        }
+
+        // the sizes are known up front, so a loss never reaches the sink
+        uint64_t encodedSize = filterPrefixSize(filterBlocks) + kp03PrefixSize(opts.ext) + codeMapSize(huffmanCode)
+                             + sizeof(encodedLen) + (encodedLen + 7) / 8;
+        uint64_t framed = framedSize();
+        if (framed > 0 && framed < encodedSize && framed < in) { emitFramesFromTokens(); return; }
+        noteHuffman(opts.stats, huffmanCode.size(), encodedLen);
+        if (encodedSize >= in) { emitRawFromTokens(); return; }
+
+        KITTY_TRACE("huffman encode");
+        StageTimer timer(stageSlot(opts.stats, &KittyStageTimes::encode));
+        CallbackOStream os([this](const uint8_t *p, size_t n) { emit(p, n); }, plan.ioChunk);
+        writeFilterPrefix(os, filterBlocks);
+        writeKP03Prefix(os, true, opts.ext);
+        writeCodeMap(os, huffmanCode);
+        os.write(reinterpret_cast<const char*>(&encodedLen), sizeof(encodedLen));
+        BitWriter writer(os);
+        CodeLookup codes(huffmanCode);
+        spill.replay(plan.ioChunk, [&](const uint8_t *p, size_t n) { encodeBytes(writer, codes, p, n); });
+        writer.flush();
+        os.flush();
+    }
+
+    // A matched frame is written as an LZ block only when it beats its raw bytes
+    static bool frameMatched(const Frame &f) {
+        return !f.stored && f.payloadBytes > 0 && f.payloadBytes < f.rawBytes;
+    }
+
+    // KP05 size of the frames when the input mixes stored and matched pieces;
+    // 0 when one KP03 table is the only choice (filters, a dictionary, one
+    // kind of piece, or a matched frame that would have to be stored ahead of
+    // another matched frame, which a stored block cuts off from its window)
+    uint64_t framedSize() const {
+        if (anyFiltered(filterBlocks) || opts.dict) return 0;
+        bool anyStored = false, anyMatched = false;
+        uint64_t size = 9 + 12;
+        for (size_t i = 0; i < frames.size(); ++i) {
+            const Frame &f = frames[i];
+            bool matched = frameMatched(f);
+            if (!f.stored && !matched && i + 1 < frames.size() && !frames[i + 1].stored) return 0;
+            anyStored = anyStored || f.stored;
+            anyMatched = anyMatched || matched;
+            size += 13 + (matched ? f.payloadBytes : f.rawBytes);
+        }
+        return anyStored && anyMatched ? size : 0;
+    }
+
+    // KP05 rebuilt from the held tokens: each stored frame is decoded back to
+    // its bytes, each matched frame gets a code table of its own
+    void emitFramesFromTokens() {
+        KITTY_TRACE("huffman encode");
+        StageTimer timer(stageSlot(opts.stats, &KittyStageTimes::encode));
+        uint8_t streamHeader[9];
+        frameStreamHeader(streamHeader, (uint32_t)plan.probeSample);
+        emit(streamHeader, sizeof(streamHeader));
+
+        unique_ptr<LZ77StreamDecompressor> dec(new LZ77StreamDecompressor());
+        vector<uint8_t> tokens, bytes, payload;
+        MemCharge frameCharge(MemSubsystem::Huffman);
+        size_t next = 0;
+        auto writeFrame = [&]() {
+            const Frame &f = frames[next++];
+            dec->feed(tokens);
+            bytes = dec->consumeOutput();
+            if (bytes.size() != f.rawBytes || dec->hasPartialToken())
+                throw runtime_error("LZ77 token replay size mismatch (unexpected).");
+            uint8_t header[13];
+            uint32_t crc = crc32c(bytes.data(), bytes.size());
+            if (!frameMatched(f)) {
+                frameBlockHeader(header, (uint32_t)bytes.size(), FRAME_STORED, (uint32_t)bytes.size(), crc);
+                emit(header, sizeof(header));
+                emit(bytes.data(), bytes.size());
+                dec.reset(new LZ77StreamDecompressor());
+            } else {
+                ByteHistogram freq = {};
+                histogram_add(freq, tokens.data(), tokens.size());
+                array<uint8_t, 256> lengths;
+                uint64_t bits;
+                frameCodeLengths(freq, lengths, bits);
+                payload.clear();
+                VectorOStream os(payload);
+                writeCodeLengths(os, lengths);
+                os.write(reinterpret_cast<const char*>(&bits), 8);
+                BitWriter writer(os);
+                encodeBytes(writer, CodeLookup(canonicalCodes(lengths)), tokens.data(), tokens.size());
+                writer.flush();
+                frameBlockHeader(header, (uint32_t)bytes.size(), FRAME_LZ, (uint32_t)payload.size(), crc);
+                emit(header, sizeof(header));
+                emit(payload.data(), payload.size());
+                noteHuffman(opts.stats, (codeLengthsSize(lengths) - 2) / 2, bits);
+            }
+            frameCharge.set(tokens.capacity() + bytes.capacity() + payload.capacity());
+            tokens.clear();
+        };
+        spill.replay(plan.ioChunk, [&](const uint8_t *p, size_t n) {
+            while (n > 0) {
+                if (next == frames.size()) throw runtime_error("LZ77 token replay size mismatch (unexpected).");
+                size_t take = (size_t)min<uint64_t>(n, frames[next].tokenBytes - tokens.size());
+                tokens.insert(tokens.end(), p, p + take);
+                p += take;
+                n -= take;
+                if (tokens.size() == frames[next].tokenBytes) writeFrame();
+            }
+        });
+        while (next < frames.size() && frames[next].tokenBytes == 0) writeFrame();
+        if (next != frames.size()) throw runtime_error("LZ77 token replay size mismatch (unexpected).");
+
+        uint8_t trailer[12] = {};
+        memcpy(trailer + 4, &in, 8);
+        emit(trailer, sizeof(trailer));
+    }
+
+    // KP06: the dictionary's code table costs nothing to send; the input's
+    // own table is sent instead when that is smaller overall
+    void finishDictLz(const unordered_map<unsigned char, string> &own, uint64_t ownBits) {
+        array<uint8_t, 256> ownLengths{};
+        bool ownFits = true;
+        for (auto &p : own) {
+            if (p.second.size() > MAX_CANONICAL_CODE_LEN) ownFits = false;
+            else ownLengths[p.first] = (uint8_t)p.second.size();
+        }
+        const array<uint8_t, 256> &dictLengths = opts.dict->codeLengths();
+        uint64_t dictBits = 0;
+        for (int c = 0; c < 256; ++c) dictBits += freq[c] * dictLengths[c];
+        bool useDict = !ownFits || (dictBits + 7) / 8 <= codeLengthsSize(ownLengths) + (ownBits + 7) / 8;
+        uint64_t bits = useDict ? dictBits : ownBits;
+
+        uint32_t id = opts.dict->id();
+        uint64_t extLen = opts.ext.size();
+        uint64_t encodedSize = KITTY_MAGIC_V6.size() + 4 + 8 + extLen + 1
+                             + (useDict ? 0 : codeLengthsSize(ownLengths)) + 8 + (bits + 7) / 8;
+        if (encodedSize >= in) { emitRawFromTokens(); return; }
+
+        KITTY_TRACE("huffman encode");
+        StageTimer timer(stageSlot(opts.stats, &KittyStageTimes::encode));
+        CallbackOStream os([this](const uint8_t *p, size_t n) { emit(p, n); }, plan.ioChunk);
+        uint8_t table = useDict ? DICT_DICT_TABLE : DICT_OWN_TABLE;
+        os.write(KITTY_MAGIC_V6.c_str(), KITTY_MAGIC_V6.size());
+        os.write(reinterpret_cast<const char*>(&id), 4);
+        os.write(reinterpret_cast<const char*>(&extLen), 8);
+        os.write(opts.ext.c_str(), (streamsize)extLen);
+        os.write(reinterpret_cast<const char*>(&table), 1);
+        if (!useDict) writeCodeLengths(os, ownLengths);
+        os.write(reinterpret_cast<const char*>(&bits), 8);
+        BitWriter writer(os);
+        auto huffmanCode = canonicalCodes(useDict ? dictLengths : ownLengths);
+        CodeLookup codes(huffmanCode);
+        spill.replay(plan.ioChunk, [&](const uint8_t *p, size_t n) { encodeBytes(writer, codes, p, n); });
+        writer.flush();
+        os.flush();
+    }
+};
+
+KittyEncoder::KittyEncoder(KittySink sink, const KittyEncoderOptions &opts)
+    : impl(new Impl(move(sink), opts)) {
+    if (opts.storeRaw) impl->decide();
+    else if (opts.sizeHintSet) impl->sample.reserve((size_t)min<uint64_t>(opts.sizeHint, impl->plan.probeSample));
+}
+
+KittyEncoder::~KittyEncoder() = default;
+
+void KittyEncoder::update(const uint8_t *data, size_t size) {
+    Impl &s = *impl;
+    if (s.mode == Impl::Mode::Done) throw runtime_error("KittyEncoder::update after finish().");
+    s.in += size;
+    if (s.mode == Impl::Mode::Probe) {
+        size_t take = min(size, s.plan.probeSample - s.sample.size());
+        s.sample.insert(s.sample.end(), data, data + take);
+        s.sampleCharge.set(s.sample.capacity());
+        data += take;
+        size -= take;
+        if (s.sample.size() < s.plan.probeSample) return;
+        s.decide();
+    }
+    if (size == 0) return;
+    if (s.mode == Impl::Mode::Raw) s.feedRaw(data, size);
+    else s.feedLz(data, size);
+}
+
+void KittyEncoder::finish() {
+    Impl &s = *impl;
+    if (s.mode == Impl::Mode::Done) throw runtime_error("KittyEncoder::finish called twice.");
+    if (s.mode == Impl::Mode::Probe) s.decide();
+    if (s.mode == Impl::Mode::Raw) {
+        if (s.rawStreaming) {
+            if (s.in != s.opts.sizeHint) throw runtime_error("Input is smaller than the size hint.");
+        } else {
+            s.emitRawHeader(s.in);
+            s.spill.replay(s.plan.ioChunk, [&s](const uint8_t *p, size_t n) { s.emit(p, n); });
+        }
+        s.raw = true;
+    } else {
+        s.finishLz();
+    }
+    s.mode = Impl::Mode::Done;
+    noteResult(s.opts.stats, s.in, s.out, s.raw);
+}
+
+bool KittyEncoder::probed() const { return impl->probed; }
+double KittyEncoder::entropy() const { return impl->entropy; }
+bool KittyEncoder::skippedByProbe() const { return impl->skipped; }
+bool KittyEncoder::storedRaw() const { return impl->raw; }
+uint64_t KittyEncoder::bytesIn() const { return impl->in; }
+uint64_t KittyEncoder::bytesOut() const { return impl->out; }
+
+// ---- decoder ----
+
+struct KittyDecoder::Impl {
+    enum class State { Header, Raw, Body, Legacy, Frames, Done };
+    enum class FramePart { Length, Info, Payload, Trailer };
+
+    KittySink sink;
+    KittyStats *stats;
+    const KittyDictionary *dict;
+    MemPlan plan = mem_plan();
+    State state = State::Header;
+
+    vector<uint8_t> pending;  // header bytes, a whole legacy stream, or undecoded body bytes
+    MemCharge pendingCharge{ MemSubsystem::Decode };
+    string label;
+    uint64_t left = 0;        // raw payload / encoded body bytes not yet received
+
+    HuffmanDecodeTable table;
+    MemCharge tableCharge{ MemSubsystem::Huffman };
+    HuffmanBitSource src;
+    unique_ptr<LZ77StreamDecompressor> lz;
+    vector<uint8_t> symbuf;
+    MemCharge symCharge{ MemSubsystem::Decode };
+    unique_ptr<FilterChain> unfilter;  // KP08
+    vector<uint8_t> unfiltered;
+    uint64_t out = 0;
+    uint64_t limit = UINT64_MAX;  // setOutputLimit
+
+    // KP05: pending gathers exactly `need` bytes of the current part
+    FramePart part = FramePart::Length;
+    size_t need = 0;
+    uint32_t blockRaw = 0;
+    uint8_t blockType = 0;
+    bool frameCrc = false;   // version 6 and up
+    uint32_t blockCrc = 0;   // expected CRC32C of the current block
+    uint32_t seenCrc = 0;    // CRC32C of the bytes it has produced so far
+
+    Impl(KittySink s, KittyStats *st, const KittyDictionary *d) : sink(move(s)), stats(st), dict(d) {}
+
+    void startLz() {
+        lz.reset(new LZ77StreamDecompressor());
+        symbuf.resize(plan.ioChunk);
+        symCharge.set(symbuf.size());
+    }
+
+    void setTable(const unordered_map<unsigned char, string> &huffmanCode) {
+        table.build(huffmanCode);
+        tableCharge.set(table.lookup.capacity() * sizeof(HuffmanDecodeTable::Entry)
+                        + table.nodes.capacity() * sizeof(table.nodes[0]));
+    }
+
+    // Symbols -> LZ77 -> sink, in decodeSlice slices so a run of long
+    // matches cannot balloon the LZ77 output buffer
+    void feedTokens(const uint8_t *tokens, size_t n) {
+        for (size_t at = 0; at < n; at += plan.decodeSlice) {
+            lz->feed(tokens + at, min(plan.decodeSlice, n - at));
+            auto bytes = lz->consumeOutput();
+            emit(bytes.data(), bytes.size());
+        }
+    }
+
+    void emit(const uint8_t *data, size_t n) {
+        if (n == 0) return;
+        if (unfilter) {
+            unfiltered.clear();
+            unfilter->update(data, n, unfiltered);
+            data = unfiltered.data();
+            n = unfiltered.size();
+            if (n == 0) return;
+        }
+        if (n > limit - out)
+            throw runtime_error("Stream decodes to more than the expected " + to_string(limit) + " bytes.");
+        if (frameCrc) seenCrc = crc32c(data, n, seenCrc);
+        sink(data, n);
+        out += n;
+    }
+
+    // Bytes a KP08 filter still holds back
+    void finishFilter() {
+        if (!unfilter) return;
+        unfiltered.clear();
+        unfilter->finish(unfiltered);
+        unfilter.reset();
+        emit(unfiltered.data(), unfiltered.size());
+    }
+
+    void append(const uint8_t *data, size_t n) {
+        pending.insert(pending.end(), data, data + n);
+        pendingCharge.set(pending.capacity());
+    }
+
+    // Parses the header at the front of pending; returns its length, or 0
+    // (state still Header) while more bytes are needed
+    size_t parseHeader(size_t pos = 0) {
+        auto take = [&](void *dst, size_t n) {
+            if (pending.size() - pos < n) return false;
+            memcpy(dst, pending.data() + pos, n);
+            pos += n;
+            return true;
+        };
+
+        char magicBytes[4];
+        if (!take(magicBytes, 4)) return 0;
+        string magic(magicBytes, 4);
+        if (magic == KITTY_MAGIC_V1) { state = State::Legacy; return pos; }
+        if (magic == KITTY_MAGIC_V5) {
+            uint8_t version = 0;
+            uint32_t blockSize = 0;
+            if (!take(&version, 1) || !take(&blockSize, 4)) return 0;
+            if (version != FRAME_VERSION && version != FRAME_VERSION_NO_CRC)
+                throw runtime_error("Unsupported KP05 stream version.");
+            frameCrc = version >= FRAME_VERSION;
+            startLz();
+            part = FramePart::Length;
+            need = 4;
+            label = "Decompressed (KP05 stream) successfully";
+            state = State::Frames;
+            return pos;
+        }
+        if (magic == KITTY_MAGIC_V6) return parseDictHeader(pos, take);
+        if (magic == KITTY_MAGIC_V8) return parseFilterHeader(pos, take);
+        if (magic == KITTY_MAGIC_V4)
+            throw runtime_error("This is a KP04 archive; extract it with: kittypress decompress <archive> <folder>");
+        if (magic == KITTY_MAGIC_V7)
+            throw runtime_error("This is a KP07 delta patch; apply it with: kittypress patch --ref <old> <patch> -o <new>");
+        if (magic != KITTY_MAGIC_V2 && magic != KITTY_MAGIC_V3)
+            throw runtime_error("Unknown or corrupted .kitty file (bad signature).");
+        const string version = magic == KITTY_MAGIC_V2 ? "KP02" : "KP03";
+
+        uint8_t isCompressed = 0;
+        uint64_t extLen = 0;
+        if (!take(&isCompressed, 1) || !take(&extLen, 8)) return 0;
+        if (extLen > MAX_EXT_LEN) throw runtime_error("Corrupted .kitty header (extension length).");
+        if (pending.size() - pos < extLen) return 0;
+        pos += (size_t)extLen;
+
+        if (!isCompressed) {
+            if (!take(&left, 8)) return 0;
+            label = "Restored raw file (" + version + ")";
+            state = left ? State::Raw : State::Done;
+            return pos;
+        }
+        // KP02 Huffman-on-bytes has no streaming decoder: keep the whole stream
+        if (magic == KITTY_MAGIC_V2) { state = State::Legacy; return pos; }
+
+        uint64_t mapSize = 0;
+        if (!take(&mapSize, 8)) return 0;
+        if (mapSize == 0 || mapSize > 256) throw runtime_error("Corrupted .kitty header (code map size).");
+        unordered_map<unsigned char, string> huffmanCode;
+        for (uint64_t i = 0; i < mapSize; ++i) {
+            uint8_t c = 0;
+            uint64_t len = 0;
+            if (!take(&c, 1) || !take(&len, 8)) return 0;
+            if (len == 0 || len > 256) throw runtime_error("Corrupted .kitty header (code length).");
+            if (pending.size() - pos < len) return 0;
+            huffmanCode[c].assign(reinterpret_cast<const char*>(pending.data() + pos), (size_t)len);
+            pos += (size_t)len;
+        }
+        uint64_t encodedLen = 0;
+        if (!take(&encodedLen, 8)) return 0;
+
+        setTable(huffmanCode);
+        src = HuffmanBitSource();
+        src.remaining = encodedLen;
+        left = (encodedLen + 7) / 8;
+        startLz();
+        label = "Decompressed (KP03) successfully";
+        state = State::Body;
+        return pos;
+    }
+
+    // KP08 block table after the magic, then the inner KP03/KP06 header
+    template <class Take> size_t parseFilterHeader(size_t &pos, Take &take) {
+        if (pos != 4) throw runtime_error("Corrupted KP08 stream (nested filter).");
+        uint32_t count = 0;
+        if (!take(&count, 4)) return 0;
+        if (count == 0 || count > MAX_FILTER_BLOCKS) throw runtime_error("Corrupted KP08 stream (block count).");
+        if (pending.size() - pos < (size_t)count * FILTER_BLOCK_RECORD + 4) return 0;
+        vector<FilterBlock> blocks(count);
+        for (auto &b : blocks) {
+            uint8_t f[2];
+            take(&b.length, 8);
+            take(f, 2);
+            b.spec = FilterSpec{ (FilterKind)f[0], f[1] };
+        }
+        string inner(reinterpret_cast<const char*>(pending.data() + pos), 4);
+        if (inner != KITTY_MAGIC_V3 && inner != KITTY_MAGIC_V6) throw runtime_error("Corrupted KP08 stream (inner stream).");
+        unfilter.reset(new FilterChain(move(blocks), false));
+        size_t len = parseHeader(pos);
+        if (len) label = "Decompressed (KP08, " + to_string(count) + " filter block(s)) successfully";
+        return len;
+    }
+
+    // KP06 header after the magic: dictionary id, extension, code table
+    // (the dictionary's or the input's own) and the body bit length
+    template <class Take> size_t parseDictHeader(size_t &pos, Take &take) {
+        uint32_t id = 0;
+        uint64_t extLen = 0;
+        if (!take(&id, 4)) return 0;
+        if (!dict)
+            throw runtime_error("This stream was compressed with dictionary " + dict_id_hex(id) + "; pass it with --dict");
+        if (dict->id() != id)
+            throw runtime_error("Wrong dictionary: the stream needs " + dict_id_hex(id) + ", got " + dict_id_hex(dict->id()));
+        if (!take(&extLen, 8)) return 0;
+        if (extLen > MAX_EXT_LEN) throw runtime_error("Corrupted .kitty header (extension length).");
+        if (pending.size() - pos < extLen) return 0;
+        pos += (size_t)extLen;
+
+        uint8_t tableKind = 0;
+        if (!take(&tableKind, 1)) return 0;
+        array<uint8_t, 256> lengths = dict->codeLengths();
+        if (tableKind == DICT_OWN_TABLE) {
+            size_t n = readCodeLengths(pending.data() + pos, pending.size() - pos, lengths, "KP06");
+            if (n == 0) return 0;
+            pos += n;
+        } else if (tableKind != DICT_DICT_TABLE) {
+            throw runtime_error("Corrupted KP06 stream (code table kind).");
+        }
+        uint64_t encodedLen = 0;
+        if (!take(&encodedLen, 8)) return 0;
+
+        setTable(canonicalCodes(lengths));
+        src = HuffmanBitSource();
+        src.remaining = encodedLen;
+        left = (encodedLen + 7) / 8;
+        startLz();
+        lz->prime(dict->content().data(), dict->content().size());
+        label = "Decompressed (KP06, dictionary " + dict_id_hex(id) + ") successfully";
+        state = State::Body;
+        return pos;
+    }
+
+    // Bits -> symbols -> LZ77 -> sink over everything buffered so far; the
+    // last partial code stays in pending until more bytes (or the end) arrive
+    void decodeBody() {
+        bool final = left == 0;
+        src.p = pending.data();
+        src.end = pending.data() + pending.size();
+        size_t n;
+        do {
+            n = huffman_decode(table, src, final, symbuf.data(), symbuf.size());
+            feedTokens(symbuf.data(), n);
+        } while (n == symbuf.size() && src.remaining > 0);
+        pending.erase(pending.begin(), pending.begin() + (src.p - pending.data()));
+        if (final) {
+            if (lz->hasPartialToken()) throw runtime_error("Truncated LZ77 stream.");
+            state = State::Done;
+        }
+    }
+
+    // One complete KP05 block payload in pending
+    void decodeFrameBlock() {
+        uint64_t before = out;
+        seenCrc = 0;
+        if (blockType == FRAME_STORED) {
+            emit(pending.data(), pending.size());
+            startLz();
+        } else {
+            size_t pos = 0;
+            auto take = [&](void *dst, size_t n) {
+                if (pending.size() - pos < n) throw runtime_error("Corrupted KP05 stream (short block).");
+                memcpy(dst, pending.data() + pos, n);
+                pos += n;
+            };
+            array<uint8_t, 256> lengths{};
+            size_t tableLen = readCodeLengths(pending.data(), pending.size(), lengths, "KP05");
+            if (tableLen == 0) throw runtime_error("Corrupted KP05 stream (short block).");
+            pos += tableLen;
+            uint64_t bits = 0;
+            take(&bits, 8);
+            if ((bits + 7) / 8 != pending.size() - pos) throw runtime_error("Corrupted KP05 stream (bit length).");
+
+            setTable(canonicalCodes(lengths));
+            src = HuffmanBitSource();
+            src.remaining = bits;
+            src.p = pending.data() + pos;
+            src.end = pending.data() + pending.size();
+            size_t n;
+            do {
+                n = huffman_decode(table, src, true, symbuf.data(), symbuf.size());
+                feedTokens(symbuf.data(), n);
+            } while (n > 0 && src.remaining > 0);
+            if (src.remaining > 0 || lz->hasPartialToken())
+                throw runtime_error("Corrupted KP05 stream (block ends mid-token).");
+        }
+        if (out - before != blockRaw) throw runtime_error("Corrupted KP05 stream (block size mismatch).");
+        if (frameCrc && seenCrc != blockCrc) throw runtime_error("Corrupted KP05 stream (block checksum mismatch).");
+    }
+
+    // pending holds the `need` bytes of the current part
+    void frameStep() {
+        const uint8_t *p = pending.data();
+        switch (part) {
+        case FramePart::Length:
+            memcpy(&blockRaw, p, 4);
+            if (blockRaw > MAX_FRAME_BLOCK) throw runtime_error("Corrupted KP05 stream (block size).");
+            part = blockRaw ? FramePart::Info : FramePart::Trailer;
+            need = blockRaw ? (frameCrc ? 9 : 5) : 8;
+            break;
+        case FramePart::Info: {
+            uint32_t payloadLen = 0;
+            blockType = p[0];
+            memcpy(&payloadLen, p + 1, 4);
+            if (frameCrc) memcpy(&blockCrc, p + 5, 4);
+            bool ok = blockType == FRAME_STORED ? payloadLen == blockRaw
+                    : blockType == FRAME_LZ && payloadLen > 0 && payloadLen < blockRaw;
+            if (!ok) throw runtime_error("Corrupted KP05 stream (block header).");
+            part = FramePart::Payload;
+            need = payloadLen;
+            break;
+        }
+        case FramePart::Payload:
+            decodeFrameBlock();
+            part = FramePart::Length;
+            need = 4;
+            break;
+        case FramePart::Trailer: {
+            uint64_t total = 0;
+            memcpy(&total, p, 8);
+            if (total != out) throw runtime_error("Corrupted KP05 stream (total size mismatch).");
+            state = State::Done;
+            break;
+        }
+        }
+        pending.clear();
+    }
+
+    void feed(const uint8_t *data, size_t size) {
+        while (size > 0 && state != State::Done) {
+            size_t n = 0;
+            switch (state) {
+            case State::Header: {
+                n = min(size, plan.ioChunk);
+                append(data, n);
+                size_t headerLen = parseHeader();
+                if (state == State::Header || state == State::Legacy) break;
+                vector<uint8_t> rest(pending.begin() + headerLen, pending.end());
+                pending.clear();
+                if (state == State::Body && left == 0) decodeBody();
+                feed(rest.data(), rest.size());
+                break;
+            }
+            case State::Legacy:
+                n = size;
+                append(data, n);
+                break;
+            case State::Raw:
+                n = (size_t)min<uint64_t>(size, left);
+                emit(data, n);
+                left -= n;
+                if (left == 0) state = State::Done;
+                break;
+            case State::Body:
+                n = (size_t)min<uint64_t>(min(size, plan.ioChunk), left);
+                append(data, n);
+                left -= n;
+                decodeBody();
+                break;
+            case State::Frames:
+                n = min(size, need - pending.size());
+                append(data, n);
+                if (pending.size() == need) frameStep();
+                break;
+            case State::Done:
+                break;
+            }
+            data += n;
+            size -= n;
+        }
+    }
+};
+
+KittyDecoder::KittyDecoder(KittySink sink, KittyStats *stats, const KittyDictionary *dict)
+    : impl(new Impl(move(sink), stats, dict)) {}
+
+KittyDecoder::~KittyDecoder() = default;
+
+void KittyDecoder::update(const uint8_t *data, size_t size) {
+    KITTY_TRACE("decode block");
+    StageTimer timer(stageSlot(impl->stats, &KittyStageTimes::decode));
+    impl->feed(data, size);
+}
+
+void KittyDecoder::finish() {
+    Impl &s = *impl;
+    KITTY_TRACE("decode finish");
+    StageTimer timer(stageSlot(s.stats, &KittyStageTimes::decode));
+    switch (s.state) {
+    case Impl::State::Header:
+        if (s.pending.size() < 4) throw runtime_error("Failed to read file signature.");
+        throw runtime_error("Truncated .kitty header.");
+    case Impl::State::Legacy: {
+        MemoryIStream in(s.pending.data(), s.pending.size());
+        CallbackOStream os([&s](const uint8_t *p, size_t n) { s.emit(p, n); }, s.plan.ioChunk);
+        s.label = decodeLegacyStream(in, os);
+        os.flush();
+        s.state = Impl::State::Done;
+        break;
+    }
+    case Impl::State::Raw:
+        throw runtime_error("Unexpected EOF while reading raw payload.");
+    case Impl::State::Body:
+        if (s.left > 0) throw runtime_error("Truncated KP03 stream.");
+        s.decodeBody();
+        break;
+    case Impl::State::Frames:
+        throw runtime_error("Truncated KP05 stream.");
+    case Impl::State::Done:
+        break;
+    }
+    s.finishFilter();
+    if (s.stats) stats_capture_memory(*s.stats);
+}
+
+void KittyDecoder::setOutputLimit(uint64_t bytes) { impl->limit = bytes; }
+
+bool KittyDecoder::done() const { return impl->state == Impl::State::Done; }
+string KittyDecoder::formatLabel() const { return impl->label; }
+uint64_t KittyDecoder::bytesOut() const { return impl->out; }
+
+// ---- KP05 framed encoder ----
+
+struct KittyFrameEncoder::Impl {
+    KittySink sink;
+    int level;
+    KittyStats *stats;
+    MemPlan plan = mem_plan();
+
+    vector<uint8_t> block;  // the block being gathered; also the probe sample
+    MemCharge blockCharge{ MemSubsystem::IO };
+    unique_ptr<LZ77StreamCompressor> lz;  // carried across LZ77 blocks, dropped by a stored one
+    vector<uint8_t> chunk, tokens, payload;
+    MemCharge workCharge{ MemSubsystem::IO };
+    vector<ProbeMode> picks;  // per FILTER_BLOCK_SIZE piece of the block
+
+    bool started = false, finished = false, anyCompressed = false;
+    uint64_t in = 0, out = 0, blocks = 0;
+
+    Impl(KittySink s, int lv, KittyStats *st) : sink(move(s)), level(lv), stats(st) {
+        block.reserve(plan.probeSample);
+        blockCharge.set(block.capacity());
+    }
+
+    void emit(const uint8_t *data, size_t n) {
+        if (n == 0) return;
+        sink(data, n);
+        out += n;
+    }
+
+    void start() {
+        if (started) return;
+        started = true;
+        uint8_t header[9];
+        frameStreamHeader(header, (uint32_t)plan.probeSample);
+        emit(header, sizeof(header));
+    }
+
+    void retireLz() {
+        if (!lz) return;
+        if (stats) KITTY_STAT(stats->lz.add(lz->matchStats()));
+        lz.reset();
+    }
+
+    void writeBlock(const uint8_t *raw, size_t rawLen, uint8_t type, const uint8_t *data, size_t n) {
+        uint8_t header[13];
+        frameBlockHeader(header, (uint32_t)rawLen, type, (uint32_t)n, crc32c(raw, rawLen));
+        emit(header, sizeof(header));
+        emit(data, n);
+        ++blocks;
+    }
+
+    // LZ77 + canonical Huffman of the block's pieces [first, last) into
+    // payload, each piece at its own level; false if that would not beat
+    // their raw bytes
+    bool compressRun(size_t first, size_t last) {
+        size_t begin = first * FILTER_BLOCK_SIZE, end = min(block.size(), last * FILTER_BLOCK_SIZE);
+        tokens.clear();
+        {
+            StageTimer timer(stageSlot(stats, &KittyStageTimes::lz77));
+            for (size_t p = first; p < last; ++p) {
+                int pieceLevel = probe_level(picks[p], level);
+                if (!lz) lz.reset(new LZ77StreamCompressor(plan.lzWindow, 255, pieceLevel));
+                else lz->setLevel(pieceLevel);
+                size_t pieceEnd = min(end, (p + 1) * FILTER_BLOCK_SIZE);
+                for (size_t at = p * FILTER_BLOCK_SIZE; at < pieceEnd; at += plan.ioChunk) {
+                    KITTY_TRACE("lz77 block");
+                    chunk.assign(block.begin() + at, block.begin() + min(pieceEnd, at + plan.ioChunk));
+                    lz->feed(chunk, false);
+                    auto bytes = lz->consumeOutput();
+                    tokens.insert(tokens.end(), bytes.begin(), bytes.end());
+                    workCharge.set(chunk.capacity() + tokens.capacity() + payload.capacity());
+                }
+            }
+        }
+        if (stats) KITTY_STAT(stats->lzBytes += tokens.size());
+
+        ByteHistogram freq = {};
+        {
+            StageTimer timer(stageSlot(stats, &KittyStageTimes::histogram));
+            histogram_add(freq, tokens.data(), tokens.size());
+        }
+        if (tokens.empty()) return false;
+
+        array<uint8_t, 256> lengths;
+        uint64_t bits;
+        {
+            KITTY_TRACE("huffman build");
+            StageTimer timer(stageSlot(stats, &KittyStageTimes::huffmanBuild));
+            if (!frameCodeLengths(freq, lengths, bits)) return false;
+        }
+        uint64_t size = codeLengthsSize(lengths) + 8 + (bits + 7) / 8;
+        if (size >= end - begin) return false;
+        noteHuffman(stats, (codeLengthsSize(lengths) - 2) / 2, bits);
+
+        KITTY_TRACE("huffman encode");
+        StageTimer timer(stageSlot(stats, &KittyStageTimes::encode));
+        auto codes = canonicalCodes(lengths);
+        payload.clear();
+        payload.reserve((size_t)size);
+        workCharge.set(chunk.capacity() + tokens.capacity() + payload.capacity());
+        VectorOStream os(payload);
+        writeCodeLengths(os, lengths);
+        os.write(reinterpret_cast<const char*>(&bits), 8);
+        BitWriter writer(os);
+        encodeBytes(writer, CodeLookup(codes), tokens.data(), tokens.size());
+        writer.flush();
+        return true;
+    }
+
+    ProbeMode blockProbe(const uint8_t *data, size_t n) {
+        KITTY_TRACE("block probe");
+        StageTimer timer(stageSlot(stats, &KittyStageTimes::probe));
+        return probe_mode(probe_sample(data, n));
+    }
+
+    // Each FILTER_BLOCK_SIZE piece is probed on its own, as in KittyEncoder;
+    // a run of Store pieces becomes one stored block, a run of the others one
+    // LZ77 block (stored after all when coding does not pay)
+    void encodeBlock() {
+        KITTY_TRACE("stream block");
+        start();
+        ProbeMode blockPick = blockProbe(block.data(), block.size());
+        picks.clear();
+        for (size_t at = 0; at < block.size(); at += FILTER_BLOCK_SIZE) {
+            size_t n = min(FILTER_BLOCK_SIZE, block.size() - at);
+            ProbeMode pick = n == block.size() ? blockPick : blockProbe(block.data() + at, n);
+            if (pick != ProbeMode::Store && blockPick != ProbeMode::Store) pick = blockPick;
+            picks.push_back(pick);
+            noteBlock(stats, pick);
+        }
+        for (size_t first = 0, last; first < picks.size(); first = last) {
+            bool store = picks[first] == ProbeMode::Store;
+            for (last = first + 1; last < picks.size() && (picks[last] == ProbeMode::Store) == store; ++last) {}
+            const uint8_t *raw = block.data() + first * FILTER_BLOCK_SIZE;
+            size_t rawLen = min(block.size(), last * FILTER_BLOCK_SIZE) - first * FILTER_BLOCK_SIZE;
+            if (store || !compressRun(first, last)) {
+                writeBlock(raw, rawLen, FRAME_STORED, raw, rawLen);
+                retireLz();
+            } else {
+                writeBlock(raw, rawLen, FRAME_LZ, payload.data(), payload.size());
+                anyCompressed = true;
+            }
+        }
+        block.clear();
+    }
+};
+
+KittyFrameEncoder::KittyFrameEncoder(KittySink sink, int level, KittyStats *stats)
+    : impl(new Impl(move(sink), level, stats)) {}
+
+KittyFrameEncoder::~KittyFrameEncoder() = default;
+
+void KittyFrameEncoder::update(const uint8_t *data, size_t size) {
+    Impl &s = *impl;
+    if (s.finished) throw runtime_error("KittyFrameEncoder::update after finish().");
+    s.in += size;
+    while (size > 0) {
+        size_t take = min(size, s.plan.probeSample - s.block.size());
+        s.block.insert(s.block.end(), data, data + take);
+        data += take;
+        size -= take;
+        if (s.block.size() == s.plan.probeSample) s.encodeBlock();
+    }
+}
+
+void KittyFrameEncoder::finish() {
+    Impl &s = *impl;
+    if (s.finished) throw runtime_error("KittyFrameEncoder::finish called twice.");
+    if (!s.block.empty()) s.encodeBlock();
+    s.start();
+    uint8_t trailer[12] = {};
+    memcpy(trailer + 4, &s.in, 8);  // zero-length block, then the total size
+    s.emit(trailer, sizeof(trailer));
+    s.retireLz();
+    s.finished = true;
+    noteResult(s.stats, s.in, s.out, !s.anyCompressed);
+}
+
+uint64_t KittyFrameEncoder::bytesIn() const { return impl->in; }
+uint64_t KittyFrameEncoder::bytesOut() const { return impl->out; }
+uint64_t KittyFrameEncoder::blocks() const { return impl->blocks; }
+
+// ---- buffer API ----
+
+size_t kitty_compress_bound(size_t size, const string &ext) {
+    // a compressed body is only kept when it is smaller than the input
+    return (size_t)kp03PrefixSize(ext) + sizeof(uint64_t) + size;
+}
+
+static KittySink bufferSink(uint8_t *dst, size_t capacity, size_t &used) {
+    return [dst, capacity, &used](const uint8_t *p, size_t n) {
+        if (n > capacity - used) throw runtime_error("Output buffer too small.");
+        memcpy(dst + used, p, n);
+        used += n;
+    };
+}
+
+size_t kitty_compress_into(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity,
+                           int level, const string &ext, KittyStats *stats, const KittyDictionary *dict) {
+    size_t used = 0;
+    KittyEncoderOptions opts;
+    opts.level = level;
+    opts.ext = ext;
+    opts.sizeHint = size;
+    opts.sizeHintSet = true;
+    opts.peek = kitty_buffer_peek(src, size);
+    opts.dict = dict;
+    opts.stats = stats;
+    KittyEncoder enc(bufferSink(dst, capacity, used), opts);
+    enc.update(src, size);
+    enc.finish();
+    return used;
+}
+
+size_t kitty_decompress_into(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity,
+                             KittyStats *stats, const KittyDictionary *dict) {
+    size_t used = 0;
+    KittyDecoder dec(bufferSink(dst, capacity, used), stats, dict);
+    dec.update(src, size);
+    dec.finish();
+    return used;
+}
+
+vector<uint8_t> compressBuffer(const vector<uint8_t> &data, const string &ext, int level,
+                               KittyStats *stats) {
+    vector<uint8_t> result;
+    MemCharge resultCharge(MemSubsystem::IO);
+    KittyEncoderOptions opts;
+    opts.level = level;
+    opts.ext = ext;
+    opts.sizeHint = data.size();
+    opts.sizeHintSet = true;
+    opts.peek = kitty_buffer_peek(data.data(), data.size());
+    opts.stats = stats;
+    KittyEncoder enc([&](const uint8_t *p, size_t n) {
+        result.insert(result.end(), p, p + n);
+        resultCharge.set(result.capacity());
+    }, opts);
+    enc.update(data);
+    enc.finish();
+    return result;
+}
+
+vector<uint8_t> decompressBuffer(const vector<uint8_t> &kitty, KittyStats *stats) {
+    vector<uint8_t> result;
+    MemCharge resultCharge(MemSubsystem::IO);
+    KittyDecoder dec([&](const uint8_t *p, size_t n) {
+        result.insert(result.end(), p, p + n);
+        resultCharge.set(result.capacity());
+    }, stats);
+    dec.update(kitty);
+    dec.finish();
+    return result;
+}
@@ -0,0 +1,138 @@
+// codec.h
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "lz77.h"
+#include "stats.h"
+
+class KittyDictionary;  // dict.h
+
+// Path-free KittyPress API. The file, archive and CLI front ends are built on
+// these; the byte layout is the same KP03 stream compressFile has always
+// written (and the decoder still reads KP01/KP02).
+
+// Receives output as it is produced; may be called many times
+using KittySink = std::function<void(const uint8_t *data, size_t size)>;
+
+// Reads up to size bytes of the input at offset, ahead of what update() has
+// seen; returns the count read
+using KittyPeek = std::function<size_t(uint64_t offset, uint8_t *buf, size_t size)>;
+
+// Peeks into a file on disk (opened on first use) or a buffer in memory
+KittyPeek kitty_file_peek(const std::string &path);
+KittyPeek kitty_buffer_peek(const uint8_t *data, size_t size);
+
+struct KittyEncoderOptions {
+    int level = LZ77_DEFAULT_LEVEL;
+    std::string ext;          // original extension stored in the header
+    uint64_t sizeHint = 0;    // total input size if known (lets raw payloads stream through)
+    bool sizeHintSet = false;
+    std::string spillPath;    // temp file for LZ77 tokens past the memory limit ("" = memory only)
+    bool storeRaw = false;    // skip the probe and LZ77, store the input as is
+    KittyPeek peek;           // with sizeHint: the probe samples regions across the whole input
+    const KittyDictionary *dict = nullptr;  // compress against a preset dictionary (KP06)
+    bool filters = true;      // try the filter.h preprocessing filters on the probe sample (KP08)
+    KittyStats *stats = nullptr;
+};
+
+// Push encoder: update() any number of times, then finish(). KP03 needs the
+// token statistics before the Huffman bitstream, so tokens are held (memory,
+// then spillPath) and the compressed body is written in finish(); raw
+// payloads with a sizeHint are written as they arrive. The probe (probe.h)
+// decides raw or LZ77 for the whole input from regions spread over it, then
+// again for each 64 KiB piece: a piece it would store is emitted as literals
+// without a match search, the others are matched at a fast or the requested
+// level. When an input mixes both kinds and one KP03 table would lose to
+// that, the tokens are written as KP05 blocks instead (see KittyFrameEncoder)
+// with the stored pieces kept raw.
+class KittyEncoder {
+public:
+    KittyEncoder(KittySink sink, const KittyEncoderOptions &opts = KittyEncoderOptions());
+    ~KittyEncoder();
+
+    void update(const uint8_t *data, size_t size);
+    void update(const std::vector<uint8_t> &data) { update(data.data(), data.size()); }
+    void finish();
+
+    // Results, valid after finish()
+    bool probed() const;          // the probe saw at least one byte
+    double entropy() const;       // probe entropy in bits/byte (mean over the probed regions)
+    bool skippedByProbe() const;  // stored raw because of the probe
+    bool storedRaw() const;       // stored raw (probe, empty input or no gain)
+    uint64_t bytesIn() const;
+    uint64_t bytesOut() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+// KP05 framed stream for pipes: no total size up front, each block (the
+// probe sample size, 1 MiB by default) leaves as soon as it is full. Each
+// 64 KiB piece of it is probed on its own; a run of pieces the probe would
+// store becomes a raw block, a run of the others an LZ77 + Huffman block (at
+// the fast or the requested level) with its own canonical code table; LZ77
+// blocks share the window until a stored block restarts it. Each block header
+// carries the CRC32C of the block's bytes, checked as it decodes. The stream
+// ends with an empty block and the total size.
+class KittyFrameEncoder {
+public:
+    explicit KittyFrameEncoder(KittySink sink, int level = LZ77_DEFAULT_LEVEL, KittyStats *stats = nullptr);
+    ~KittyFrameEncoder();
+
+    void update(const uint8_t *data, size_t size);
+    void update(const std::vector<uint8_t> &data) { update(data.data(), data.size()); }
+    void finish();
+
+    uint64_t bytesIn() const;
+    uint64_t bytesOut() const;
+    uint64_t blocks() const;  // KP05 blocks written, the trailer not counted
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+// Push decoder for one KP01/KP02/KP03/KP05/KP06 stream. finish() throws if
+// the input ended early; bytes after the end of the stream are ignored. KP06
+// streams need the dictionary they were compressed with.
+class KittyDecoder {
+public:
+    explicit KittyDecoder(KittySink sink, KittyStats *stats = nullptr, const KittyDictionary *dict = nullptr);
+    ~KittyDecoder();
+
+    void update(const uint8_t *data, size_t size);
+    void update(const std::vector<uint8_t> &data) { update(data.data(), data.size()); }
+    void finish();
+
+    // Throw as soon as the stream decodes to more than bytes (the size an
+    // archive entry declares), before the excess reaches the sink
+    void setOutputLimit(uint64_t bytes);
+
+    bool done() const;                // a complete stream has been decoded
+    std::string formatLabel() const;  // e.g. "Decompressed (KP03) successfully"
+    uint64_t bytesOut() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+// Largest output kitty_compress_into can produce for size input bytes
+size_t kitty_compress_bound(size_t size, const std::string &ext = "");
+
+// One-shot buffer calls into a caller-provided buffer; return the bytes
+// written and throw if capacity is too small
+size_t kitty_compress_into(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity,
+                           int level = LZ77_DEFAULT_LEVEL, const std::string &ext = "",
+                           KittyStats *stats = nullptr, const KittyDictionary *dict = nullptr);
+size_t kitty_decompress_into(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity,
+                             KittyStats *stats = nullptr, const KittyDictionary *dict = nullptr);
+
+// In-memory KP03 compress/decompress into growing vectors (used by `kittypress bench`)
+std::vector<uint8_t> compressBuffer(const std::vector<uint8_t> &data, const std::string &ext,
+                                    int level = LZ77_DEFAULT_LEVEL, KittyStats *stats = nullptr);
+std::vector<uint8_t> decompressBuffer(const std::vector<uint8_t> &kitty, KittyStats *stats = nullptr);
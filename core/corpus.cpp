@@ -0,0 +1,165 @@
+// corpus.cpp
+#include "corpus.h"
+#include "rng.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static const char *WORDS[] = {
+    "the", "of", "and", "to", "a", "in", "is", "that", "for", "it", "as", "was", "with", "be",
+    "by", "on", "not", "he", "this", "are", "or", "his", "from", "at", "which", "but", "have",
+    "an", "had", "they", "you", "were", "their", "one", "all", "we", "can", "her", "has",
+    "there", "been", "if", "more", "when", "will", "would", "who", "so", "no", "kitty",
+    "archive", "compression", "window", "buffer", "stream", "symbol", "frequency", "table",
+    "decoder", "encoder", "history", "pattern", "distance", "length", "literal", "entropy",
+    "performance", "benchmark", "regression", "measurement", "throughput", "latency",
+    "memory", "processor", "instruction", "pipeline", "branch", "cache", "vector", "kernel",
+};
+static const size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+static void writeFile(const fs::path &path, const string &data) {
+    ofstream out(path, ios::binary);
+    if (!out) throw runtime_error("Cannot write " + path.string());
+    out.write(data.data(), (streamsize)data.size());
+}
+
+static string genText(uint64_t size, KittyRng &rng) {
+    string s;
+    s.reserve(size + 64);
+    bool sentenceStart = true;
+    while (s.size() < size) {
+        string w = WORDS[rng.skewed(WORD_COUNT)];
+        if (sentenceStart) w[0] = (char)toupper((unsigned char)w[0]);
+        s += w;
+        sentenceStart = false;
+        uint64_t r = rng.below(100);
+        if (r < 6) { s += ". "; sentenceStart = true; }
+        else if (r < 7) { s += ".\n\n"; sentenceStart = true; }
+        else if (r < 12) s += ", ";
+        else s += ' ';
+    }
+    s.resize(size);
+    return s;
+}
+
+static string genLog(uint64_t size, KittyRng &rng) {
+    static const char *LEVELS[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+    static const char *PATHS[] = { "/api/v1/files", "/api/v1/archive", "/health", "/api/v1/users",
+                                   "/static/app.js", "/api/v1/extract" };
+    string s;
+    s.reserve(size + 256);
+    uint64_t ms = 1700000000000ULL;
+    char line[256];
+    while (s.size() < size) {
+        ms += rng.below(50);
+        uint64_t secs = ms / 1000;
+        snprintf(line, sizeof(line),
+                 "2024-%02u-%02u %02u:%02u:%02u.%03u %-5s [worker-%u] %s %s status=%u bytes=%u latency=%ums req=%08x\n",
+                 (unsigned)(1 + secs / 2592000 % 12), (unsigned)(1 + secs / 86400 % 28),
+                 (unsigned)(secs / 3600 % 24), (unsigned)(secs / 60 % 60), (unsigned)(secs % 60),
+                 (unsigned)(ms % 1000), LEVELS[rng.below(6)], (unsigned)rng.below(8),
+                 rng.below(4) ? "GET" : "POST", PATHS[rng.skewed(6)],
+                 rng.below(20) ? 200u : 500u, (unsigned)rng.below(65536),
+                 (unsigned)rng.skewed(900), (unsigned)(rng.next() & 0xFFFFFFFFu));
+        s += line;
+    }
+    s.resize(size);
+    return s;
+}
+
+// Fixed 32-byte little-endian records with slowly changing fields, like a
+// table dump or sensor capture
+static string genBinary(uint64_t size, KittyRng &rng) {
+    string s;
+    s.reserve(size + 32);
+    uint32_t id = 1000;
+    int64_t timestamp = 1700000000;
+    float value = 20.0f;
+    while (s.size() < size) {
+        char rec[32] = {};
+        id += 1;
+        timestamp += 1 + (int64_t)rng.below(3);
+        value += ((float)rng.below(200) - 100.0f) / 1000.0f;
+        uint16_t kind = (uint16_t)rng.skewed(16);
+        uint16_t flags = (uint16_t)(rng.below(10) ? 0x0001 : 0x8001);
+        uint64_t payload = rng.below(4) ? rng.below(256) : rng.next();
+        memcpy(rec, &id, 4);
+        memcpy(rec + 4, &timestamp, 8);
+        memcpy(rec + 12, &value, 4);
+        memcpy(rec + 16, &kind, 2);
+        memcpy(rec + 18, &flags, 2);
+        memcpy(rec + 20, &payload, 8);
+        s.append(rec, sizeof(rec));
+    }
+    s.resize(size);
+    return s;
+}
+
+// A 4 KiB block repeated with sparse single-byte edits
+static string genRepetitive(uint64_t size, KittyRng &rng) {
+    string block(4096, '\0');
+    for (auto &c : block) c = (char)('a' + rng.below(26));
+    string s;
+    s.reserve(size + block.size());
+    while (s.size() < size) {
+        string copy = block;
+        for (int i = 0; i < 4; ++i) copy[rng.below(copy.size())] = (char)rng.below(256);
+        s += copy;
+    }
+    s.resize(size);
+    return s;
+}
+
+static string genRandom(uint64_t size, KittyRng &rng) {
+    string s(size, '\0');
+    for (size_t i = 0; i < size; ++i) s[i] = (char)(rng.next() >> 56);
+    return s;
+}
+
+void generateCorpus(const string &outDir, const CorpusOptions &opts) {
+    if (opts.size == 0) throw runtime_error("Corpus size must be positive.");
+    fs::path root(outDir);
+
+    struct Dataset { const char *name; const char *file; string (*gen)(uint64_t, KittyRng &); };
+    const Dataset datasets[] = {
+        { "text", "text.txt", genText },
+        { "log", "server.log", genLog },
+        { "binary", "records.bin", genBinary },
+        { "repetitive", "repeat.txt", genRepetitive },
+        { "random", "random.bin", genRandom },
+    };
+    uint64_t stream = 0;
+    for (const Dataset &d : datasets) {
+        KittyRng rng(opts.seed * 1000003ULL + stream++);
+        fs::create_directories(root / d.name);
+        writeFile(root / d.name / d.file, d.gen(opts.size, rng));
+        cout << "  " << (root / d.name / d.file).string() << " (" << opts.size << " bytes)\n";
+    }
+
+    // many tiny files: short snippets of text, log and binary records
+    KittyRng rng(opts.seed * 1000003ULL + stream);
+    fs::path tiny = root / "tiny";
+    fs::create_directories(tiny);
+    uint64_t written = 0;
+    unsigned count = 0;
+    while (written < opts.size) {
+        uint64_t len = min<uint64_t>(16 + rng.skewed(2048), opts.size - written);
+        char name[32];
+        snprintf(name, sizeof(name), "f%05u.dat", count);
+        const Dataset &d = datasets[rng.below(3)];
+        writeFile(tiny / name, d.gen(len, rng));
+        written += len;
+        ++count;
+    }
+    cout << "  " << tiny.string() << " (" << count << " files, " << written << " bytes)\n";
+}
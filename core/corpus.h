@@ -0,0 +1,15 @@
+// corpus.h
+#pragma once
+#include <cstdint>
+#include <string>
+
+struct CorpusOptions {
+    uint64_t size = 4 * 1024 * 1024;  // bytes per dataset
+    uint64_t seed = 1;
+};
+
+// Writes the synthetic benchmark corpus under outDir, one subdirectory per
+// dataset: text/, log/, binary/, repetitive/, random/ and tiny/ (many small
+// files adding up to opts.size). Output depends only on opts, on every
+// platform, so results from different machines are comparable.
+void generateCorpus(const std::string &outDir, const CorpusOptions &opts);
@@ -0,0 +1,137 @@
+// cpu.cpp
+#include "cpu.h"
+#include "lzkernels.h"
+#include "crc32c.h"
+#include "bitstream.h"
+#include "huffdec.h"
+#include <atomic>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(KITTY_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+static CpuFeatures detect() {
+    CpuFeatures f;
+#if defined(KITTY_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    f.sse2    = __builtin_cpu_supports("sse2");
+    f.sse42   = __builtin_cpu_supports("sse4.2");
+    f.popcnt  = __builtin_cpu_supports("popcnt");
+    f.pclmul  = __builtin_cpu_supports("pclmul");
+    f.avx2    = __builtin_cpu_supports("avx2");
+    f.bmi2    = __builtin_cpu_supports("bmi2");
+    f.avx512f = __builtin_cpu_supports("avx512f");
+#elif defined(KITTY_X86) && defined(_MSC_VER)
+    int r[4];
+    __cpuid(r, 0);
+    int maxLeaf = r[0];
+    __cpuid(r, 1);
+    f.sse2   = (r[3] >> 26) & 1;
+    f.sse42  = (r[2] >> 20) & 1;
+    f.popcnt = (r[2] >> 23) & 1;
+    f.pclmul = (r[2] >> 1) & 1;
+    bool osAvx = ((r[2] >> 27) & 1) && ((_xgetbv(0) & 0x6) == 0x6);
+    if (maxLeaf >= 7) {
+        __cpuidex(r, 7, 0);
+        f.avx2    = osAvx && ((r[1] >> 5) & 1);
+        f.bmi2    = (r[1] >> 8) & 1;
+        f.avx512f = osAvx && ((_xgetbv(0) & 0xE6) == 0xE6) && ((r[1] >> 16) & 1);
+    }
+#endif
+    return f;
+}
+
+const CpuFeatures &cpu_features() {
+    static const CpuFeatures f = detect();
+    return f;
+}
+
+CpuTier cpu_detected_tier() {
+    const CpuFeatures &f = cpu_features();
+    if (f.avx2 && f.bmi2 && f.sse42) return CpuTier::BMI2;
+    if (f.avx2 && f.sse42) return CpuTier::AVX2;
+    if (f.sse42) return CpuTier::SSE42;
+    return CpuTier::Scalar;
+}
+
+static const KittyKernels KERNEL_TABLES[] = {
+    { CpuTier::Scalar, histogram_add_scalar, match_length_scalar, wild_copy16, 16, unpack_bits_scalar, huffman_decode_scalar, crc32c_scalar },
+    { CpuTier::SSE42,  histogram_add_scalar, match_length_sse2,   wild_copy16, 16, unpack_bits_scalar, huffman_decode_scalar, crc32c_sse42 },
+    { CpuTier::AVX2,   histogram_add_slab8,  match_length_avx2,   wild_copy32, 32, unpack_bits_avx2,   huffman_decode_scalar, crc32c_sse42 },
+    { CpuTier::BMI2,   histogram_add_slab8,  match_length_avx2,   wild_copy32, 32, unpack_bits_avx2,   huffman_decode_bmi2,   crc32c_sse42 },
+};
+
+static const KittyKernels *initial_kernels() {
+    CpuTier tier = cpu_detected_tier();
+    // KITTY_CPU=<tier> caps the tier without a command-line flag
+    if (const char *env = std::getenv("KITTY_CPU")) {
+        CpuTier forced;
+        if (cpu_parse_tier(env, forced) && forced < tier) tier = forced;
+    }
+    return &KERNEL_TABLES[(int)tier];
+}
+
+static std::atomic<const KittyKernels*> &active_kernels() {
+    static std::atomic<const KittyKernels*> active{ initial_kernels() };
+    return active;
+}
+
+const KittyKernels &kernels() {
+    return *active_kernels().load(std::memory_order_relaxed);
+}
+
+void cpu_force_tier(CpuTier tier) {
+    if (tier > cpu_detected_tier())
+        throw std::runtime_error(std::string("CPU does not support the ") +
+                                 cpu_tier_name(tier) + " kernel tier.");
+    active_kernels().store(&KERNEL_TABLES[(int)tier], std::memory_order_relaxed);
+}
+
+const char *cpu_tier_name(CpuTier tier) {
+    switch (tier) {
+        case CpuTier::Scalar: return "scalar";
+        case CpuTier::SSE42:  return "sse4.2";
+        case CpuTier::AVX2:   return "avx2";
+        case CpuTier::BMI2:   return "bmi2";
+    }
+    return "unknown";
+}
+
+bool cpu_parse_tier(const std::string &name, CpuTier &tier) {
+    if (name == "scalar") tier = CpuTier::Scalar;
+    else if (name == "sse4.2" || name == "sse42") tier = CpuTier::SSE42;
+    else if (name == "avx2") tier = CpuTier::AVX2;
+    else if (name == "bmi2") tier = CpuTier::BMI2;
+    else return false;
+    return true;
+}
+
+std::string cpu_feature_report() {
+    const CpuFeatures &f = cpu_features();
+    const KittyKernels &k = kernels();
+    auto yn = [](bool b) { return b ? "yes" : "no"; };
+    std::ostringstream os;
+    os << "CPU features:\n"
+       << "  sse2     " << yn(f.sse2) << "\n"
+       << "  sse4.2   " << yn(f.sse42) << "\n"
+       << "  popcnt   " << yn(f.popcnt) << "\n"
+       << "  pclmul   " << yn(f.pclmul) << "\n"
+       << "  avx2     " << yn(f.avx2) << "\n"
+       << "  bmi2     " << yn(f.bmi2) << "\n"
+       << "  avx512f  " << yn(f.avx512f) << "\n"
+       << "Detected tier: " << cpu_tier_name(cpu_detected_tier()) << "\n"
+       << "Active tier:   " << cpu_tier_name(k.tier) << "\n"
+       << "Kernels:\n"
+       << "  histogram     " << (k.histogram == histogram_add_slab8 ? "scalar (8 tables)" : "scalar (4 tables)") << "\n"
+       << "  match length  " << (k.match_length == match_length_avx2 ? "avx2 (32 B)"
+                               : k.match_length == match_length_sse2 ? "sse2 (16 B)" : "scalar (8 B)") << "\n"
+       << "  wild copy     " << k.wild_copy_step << " B\n"
+       << "  bit unpack    " << (k.unpack_bits == unpack_bits_avx2 ? "avx2" : "scalar (table)") << "\n"
+       << "  huffman bits  " << (k.huffman_decode == huffman_decode_bmi2 ? "bmi2" : "scalar") << "\n"
+       << "  crc32c        " << (k.crc32c == crc32c_sse42 ? "sse4.2 (3 lanes)" : "scalar (8 tables)") << "\n";
+    return os.str();
+}
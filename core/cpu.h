@@ -0,0 +1,61 @@
+// cpu.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "histogram.h"
+
+struct HuffmanDecodeTable;
+struct HuffmanBitSource;
+
+// x86-64 only: the 64-bit kernels (pdep, extract_epi64) need it
+#if defined(__x86_64__) || defined(_M_X64)
+#define KITTY_X86 1
+#endif
+
+// Per-function ISA targeting so one binary built with plain -O2 can carry
+// SSE/AVX2/BMI2 kernels and pick them at runtime
+#if defined(__GNUC__) && defined(KITTY_X86)
+#define KITTY_TARGET(t) __attribute__((target(t)))
+#else
+#define KITTY_TARGET(t)
+#endif
+
+struct CpuFeatures {
+    bool sse2 = false;
+    bool sse42 = false;
+    bool popcnt = false;
+    bool pclmul = false;
+    bool avx2 = false;
+    bool bmi2 = false;
+    bool avx512f = false;
+};
+
+// Kernel tiers, each a superset of the previous one
+enum class CpuTier { Scalar = 0, SSE42 = 1, AVX2 = 2, BMI2 = 3 };
+
+// Hot kernels selected once per process
+struct KittyKernels {
+    CpuTier tier;
+    void (*histogram)(ByteHistogram &hist, const uint8_t *data, size_t n);
+    size_t (*match_length)(const uint8_t *a, const uint8_t *b, size_t limit);
+    void (*wild_copy)(uint8_t *dst, const uint8_t *src, size_t len);
+    size_t wild_copy_step;  // minimum non-overlapping offset for wild_copy
+    void (*unpack_bits)(const uint8_t *src, size_t nbytes, char *dst); // bytes -> '0'/'1', MSB first
+    size_t (*huffman_decode)(const HuffmanDecodeTable &table, HuffmanBitSource &src,
+                             bool final, uint8_t *out, size_t cap);
+    uint32_t (*crc32c)(uint32_t crc, const uint8_t *data, size_t n);
+};
+
+const CpuFeatures &cpu_features();  // detected on first call
+CpuTier cpu_detected_tier();        // best tier this CPU supports
+const KittyKernels &kernels();      // active kernel table
+
+// Force a tier (for testing); throws if the CPU does not support it
+void cpu_force_tier(CpuTier tier);
+
+const char *cpu_tier_name(CpuTier tier);
+bool cpu_parse_tier(const std::string &name, CpuTier &tier);
+
+// Human-readable report of detected features and selected kernels
+std::string cpu_feature_report();
@@ -0,0 +1,141 @@
+// crc32c.cpp
+#include "crc32c.h"
+#include "cpu.h"
+#include <cstring>
+
+#ifdef KITTY_X86
+#include <immintrin.h>
+#endif
+
+static const uint32_t POLY = 0x82F63B78u;  // reflected Castagnoli polynomial
+
+// The SSE4.2 kernel runs three independent lanes over LANE_LONG (then
+// LANE_SHORT) bytes each and merges them by shifting the first two over the
+// bytes that follow them
+static const size_t LANE_LONG = 8192;
+static const size_t LANE_SHORT = 256;
+
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+// ---- GF(2) operators for appending zero bytes to a CRC ----
+
+static uint32_t gf2Times(const uint32_t *mat, uint32_t vec) {
+    uint32_t sum = 0;
+    for (; vec; vec >>= 1, ++mat)
+        if (vec & 1) sum ^= *mat;
+    return sum;
+}
+
+static void gf2Square(uint32_t *square, const uint32_t *mat) {
+    for (int n = 0; n < 32; ++n) square[n] = gf2Times(mat, mat[n]);
+}
+
+// Operator that appends len zero bytes (len a power of two)
+static void zerosOperator(uint32_t *even, size_t len) {
+    uint32_t odd[32];
+    odd[0] = POLY;  // one zero bit
+    for (int n = 1; n < 32; ++n) odd[n] = 1u << (n - 1);
+    gf2Square(even, odd);  // two zero bits
+    gf2Square(odd, even);  // four
+    for (;;) {
+        gf2Square(even, odd);  // eight, then 2^k bytes
+        if ((len >>= 1) == 0) return;
+        gf2Square(odd, even);
+        if ((len >>= 1) == 0) {
+            memcpy(even, odd, sizeof(odd));
+            return;
+        }
+    }
+}
+
+struct Crc32cTables {
+    uint32_t bytes[8][256];     // slicing-by-8
+    uint32_t longShift[4][256]; // x * x^(8 * LANE_LONG), a byte of x at a time
+    uint32_t shortShift[4][256];
+
+    Crc32cTables() {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = c & 1 ? (c >> 1) ^ POLY : c >> 1;
+            bytes[0][n] = c;
+        }
+        for (uint32_t n = 0; n < 256; ++n)
+            for (int k = 1; k < 8; ++k)
+                bytes[k][n] = (bytes[k - 1][n] >> 8) ^ bytes[0][bytes[k - 1][n] & 0xFF];
+        fillShift(longShift, LANE_LONG);
+        fillShift(shortShift, LANE_SHORT);
+    }
+
+    static void fillShift(uint32_t (*shift)[256], size_t len) {
+        uint32_t op[32];
+        zerosOperator(op, len);
+        for (uint32_t n = 0; n < 256; ++n)
+            for (int k = 0; k < 4; ++k) shift[k][n] = gf2Times(op, n << (8 * k));
+    }
+};
+
+static const Crc32cTables &tables() {
+    static const Crc32cTables t;
+    return t;
+}
+
+static inline uint32_t shiftCrc(const uint32_t (*shift)[256], uint32_t crc) {
+    return shift[0][crc & 0xFF] ^ shift[1][(crc >> 8) & 0xFF] ^ shift[2][(crc >> 16) & 0xFF] ^ shift[3][crc >> 24];
+}
+
+uint32_t crc32c_scalar(uint32_t crc, const uint8_t *data, size_t n) {
+    const auto &t = tables().bytes;
+    uint32_t c = ~crc;
+    for (; n >= 8; n -= 8, data += 8) {
+        uint64_t v = load64(data) ^ c;  // little-endian: the CRC folds into the first four bytes
+        c = t[7][v & 0xFF] ^ t[6][(v >> 8) & 0xFF] ^ t[5][(v >> 16) & 0xFF] ^ t[4][(v >> 24) & 0xFF]
+          ^ t[3][(v >> 32) & 0xFF] ^ t[2][(v >> 40) & 0xFF] ^ t[1][(v >> 48) & 0xFF] ^ t[0][v >> 56];
+    }
+    for (; n > 0; --n, ++data) c = (c >> 8) ^ t[0][(c ^ *data) & 0xFF];
+    return ~c;
+}
+
+#ifdef KITTY_X86
+// Three lanes of `lane` bytes each, merged into c0
+KITTY_TARGET("sse4.2")
+static inline uint64_t crcLanes(uint64_t c0, const uint8_t *&p, size_t &n, size_t lane,
+                                const uint32_t (*shift)[256]) {
+    while (n >= 3 * lane) {
+        uint64_t c1 = 0, c2 = 0;
+        for (const uint8_t *end = p + lane; p < end; p += 8) {
+            c0 = _mm_crc32_u64(c0, load64(p));
+            c1 = _mm_crc32_u64(c1, load64(p + lane));
+            c2 = _mm_crc32_u64(c2, load64(p + 2 * lane));
+        }
+        c0 = shiftCrc(shift, (uint32_t)c0) ^ c1;
+        c0 = shiftCrc(shift, (uint32_t)c0) ^ c2;
+        p += 2 * lane;
+        n -= 3 * lane;
+    }
+    return c0;
+}
+
+KITTY_TARGET("sse4.2")
+uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t n) {
+    const Crc32cTables &t = tables();
+    uint64_t c = ~crc;
+    const uint8_t *p = data;
+    c = crcLanes(c, p, n, LANE_LONG, t.longShift);
+    c = crcLanes(c, p, n, LANE_SHORT, t.shortShift);
+    for (; n >= 8; n -= 8, p += 8) c = _mm_crc32_u64(c, load64(p));
+    for (; n > 0; --n, ++p) c = _mm_crc32_u8((uint32_t)c, *p);
+    return ~(uint32_t)c;
+}
+#else
+uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t n) {
+    return crc32c_scalar(crc, data, n);
+}
+#endif
+
+uint32_t crc32c(const uint8_t *data, size_t n, uint32_t crc) {
+    return kernels().crc32c(crc, data, n);
+}
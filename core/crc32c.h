@@ -0,0 +1,13 @@
+// crc32c.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32C (Castagnoli, the polynomial of the SSE4.2 crc32 instruction):
+// integrity checks on archive members and stream blocks. Calls chain:
+// crc32c(b, nb, crc32c(a, na)) is the CRC of a followed by b.
+// Dispatches to the kernel selected in cpu.h.
+uint32_t crc32c(const uint8_t *data, size_t n, uint32_t crc = 0);
+
+uint32_t crc32c_scalar(uint32_t crc, const uint8_t *data, size_t n);  // 8 tables, 8 B/step
+uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t n);   // crc32 instruction, 3 lanes
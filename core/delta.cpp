@@ -0,0 +1,307 @@
+// delta.cpp
+#include "delta.h"
+#include "codec.h"
+#include "kitty.h"
+#include "lzkernels.h"
+#include "mapfile.h"
+#include "memtrack.h"
+#include "trace.h"
+#include "xxhash.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const size_t DELTA_HEADER_SIZE = 4 + 1 + 4 * 8;
+
+struct DeltaRecord {
+    uint64_t length = 0;
+    uint64_t source = DELTA_NEW;  // reference offset
+};
+
+// Polynomial hash of the DELTA_MIN_MATCH bytes at a window position, rolled
+// one byte at a time
+const uint64_t ROLL_PRIME = 0x100000001b3ull;
+
+constexpr uint64_t rollOut() {
+    uint64_t p = 1;
+    for (size_t i = 0; i < DELTA_MIN_MATCH; ++i) p *= ROLL_PRIME;
+    return p;
+}
+const uint64_t ROLL_OUT = rollOut();  // weight of the byte leaving the window
+
+uint64_t windowHash(const uint8_t* p) {
+    uint64_t h = 0;
+    for (size_t i = 0; i < DELTA_MIN_MATCH; ++i) h = h * ROLL_PRIME + p[i];
+    return h;
+}
+
+inline uint64_t rollHash(uint64_t h, uint8_t out, uint8_t in) {
+    return h * ROLL_PRIME + in - out * ROLL_OUT;
+}
+
+inline uint64_t mixHash(uint64_t h) {
+    h *= 0x9E3779B97F4A7C15ull;
+    return h ^ (h >> 32);
+}
+
+unsigned ceilLog2(uint64_t v) {
+    unsigned bits = 0;
+    while (bits < 63 && (1ull << bits) < v) ++bits;
+    return bits;
+}
+
+// Anchor positions of the reference: a window is an anchor when its mixed
+// hash has anchorBits zero top bits, so the same content is an anchor
+// wherever it sits in either file
+class ReferenceIndex {
+public:
+    ReferenceIndex(const uint8_t* data, uint64_t size) : ref(data), refSize(size) {
+        if (size < DELTA_MIN_MATCH) return;
+        anchorBits = max(5u, ceilLog2(size / DELTA_MAX_ANCHORS));
+        unsigned tableBits = min(ceilLog2(DELTA_MAX_ANCHORS), max(10u, ceilLog2(size >> anchorBits)));
+        tableMask = (1ull << tableBits) - 1;
+        memory.set((tableMask + 1) * sizeof(uint64_t));
+        table.assign((size_t)tableMask + 1, 0);
+
+        KITTY_TRACE("delta index");
+        uint64_t h = windowHash(ref);
+        for (uint64_t p = 0;; ++p) {
+            uint64_t m = mixHash(h);
+            if (anchor(m)) table[m & tableMask] = p + 1;
+            if (p + DELTA_MIN_MATCH >= size) break;
+            h = rollHash(h, ref[p], ref[p + DELTA_MIN_MATCH]);
+        }
+    }
+
+    bool empty() const { return table.empty(); }
+    bool anchor(uint64_t mixed) const { return (mixed >> (64 - anchorBits)) == 0; }
+
+    // Reference position whose window equals the one at p (hash m), or DELTA_NEW
+    uint64_t find(uint64_t mixed, const uint8_t* p) const {
+        uint64_t slot = table[mixed & tableMask];
+        if (!slot) return DELTA_NEW;
+        uint64_t r = slot - 1;
+        return memcmp(ref + r, p, DELTA_MIN_MATCH) == 0 ? r : DELTA_NEW;
+    }
+
+private:
+    const uint8_t* ref;
+    uint64_t refSize;
+    unsigned anchorBits = 0;
+    uint64_t tableMask = 0;
+    vector<uint64_t> table;  // slot -> reference position + 1 (0 = empty)
+    MemCharge memory{ MemSubsystem::LZ77 };
+};
+
+// Splits the new file into copies from the reference and new runs. Besides
+// the anchors, every position is tried at the offset of the previous copy,
+// which resynchronizes right after an in-place edit.
+vector<DeltaRecord> findCopies(const uint8_t* ref, uint64_t refSize, const uint8_t* data, uint64_t size) {
+    vector<DeltaRecord> records;
+    uint64_t gapStart = 0;
+    auto emit = [&](uint64_t length, uint64_t source) {
+        if (source != DELTA_NEW && !records.empty() && records.back().source != DELTA_NEW
+            && records.back().source + records.back().length == source) {
+            records.back().length += length;
+            return;
+        }
+        records.push_back({ length, source });
+    };
+    ReferenceIndex index(ref, refSize);
+    if (!index.empty() && size >= DELTA_MIN_MATCH) {
+        KITTY_TRACE("delta match");
+        bool haveLast = false;
+        uint64_t lastSource = 0, lastEnd = 0;  // previous copy: reference offset of its end, new offset of its end
+        uint64_t t = 0;
+        uint64_t h = windowHash(data);
+        while (true) {
+            uint64_t r = DELTA_NEW;
+            if (haveLast) {
+                uint64_t rr = lastSource + (t - lastEnd);
+                if (rr + DELTA_MIN_MATCH <= refSize && memcmp(ref + rr, data + t, DELTA_MIN_MATCH) == 0) r = rr;
+            }
+            if (r == DELTA_NEW) {
+                uint64_t m = mixHash(h);
+                if (index.anchor(m)) r = index.find(m, data + t);
+            }
+            if (r != DELTA_NEW) {
+                size_t limit = (size_t)min(size - t, refSize - r);
+                uint64_t len = DELTA_MIN_MATCH
+                             + match_length(data + t + DELTA_MIN_MATCH, ref + r + DELTA_MIN_MATCH, limit - DELTA_MIN_MATCH);
+                while (t > gapStart && r > 0 && data[t - 1] == ref[r - 1]) {
+                    --t;
+                    --r;
+                    ++len;
+                }
+                if (t > gapStart) emit(t - gapStart, DELTA_NEW);
+                emit(len, r);
+                t += len;
+                gapStart = t;
+                haveLast = true;
+                lastSource = r + len;
+                lastEnd = t;
+                if (t + DELTA_MIN_MATCH > size) break;
+                h = windowHash(data + t);
+                continue;
+            }
+            if (t + DELTA_MIN_MATCH >= size) break;
+            h = rollHash(h, data[t], data[t + DELTA_MIN_MATCH]);
+            ++t;
+        }
+    }
+    if (size > gapStart) emit(size - gapStart, DELTA_NEW);
+    return records;
+}
+
+template <class T> void put(ostream& out, T v) {
+    out.write(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+template <class T> T get(const uint8_t* p) {
+    T v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+}  // namespace
+
+void createDelta(const string& referencePath, const string& newPath, const string& patchPath,
+                 const DeltaOptions& options) {
+    MappedFile ref(referencePath);
+    MappedFile in(newPath);
+    uint64_t refHash, newHash;
+    {
+        KITTY_TRACE("delta hash");
+        refHash = xxh64(ref.data(), (size_t)ref.size());
+        newHash = xxh64(in.data(), (size_t)in.size());
+    }
+    vector<DeltaRecord> records = findCopies(ref.data(), ref.size(), in.data(), in.size());
+
+    ofstream out(patchPath, ios::binary);
+    if (!out) throw runtime_error("Cannot open output file: " + patchPath);
+    out.write(KITTY_MAGIC_V7.c_str(), 4);
+    put(out, DELTA_VERSION);
+    put(out, ref.size());
+    put(out, refHash);
+    put(out, in.size());
+    put(out, newHash);
+
+    // the new runs, back to back, as one stream
+    uint64_t newBytes = 0, copied = 0, copies = 0;
+    for (auto& r : records) {
+        if (r.source == DELTA_NEW) newBytes += r.length;
+        else copied += r.length, ++copies;
+    }
+    KittyEncoderOptions opts;
+    opts.level = options.level;
+    opts.stats = options.stats;
+    opts.spillPath = patchPath + ".spill.tmp";
+    opts.sizeHint = newBytes;
+    opts.sizeHintSet = true;
+    KittyEncoder enc([&out](const uint8_t* data, size_t n) {
+        out.write(reinterpret_cast<const char*>(data), (streamsize)n);
+    }, opts);
+    uint64_t pos = 0;
+    for (auto& r : records) {
+        if (r.source == DELTA_NEW) enc.update(in.data() + pos, (size_t)r.length);
+        pos += r.length;
+    }
+    enc.finish();
+
+    for (auto& r : records) {
+        put(out, r.length);
+        put(out, r.source);
+    }
+    put(out, (uint64_t)records.size());
+    uint64_t patchSize = (uint64_t)out.tellp();
+    out.close();
+    if (!out) throw runtime_error("Failed to write " + patchPath);
+    if (options.stats) stats_capture_memory(*options.stats);
+    cout << "Delta created: " << patchPath << " (" << patchSize << " bytes; " << copied << " of " << in.size()
+         << " bytes copied from the reference in " << copies << " run(s), " << newBytes << " new)\n";
+}
+
+void applyDelta(const string& referencePath, const string& patchPath, const string& outputPath, KittyStats* stats) {
+    MappedFile patch(patchPath);
+    const uint8_t* p = patch.data();
+    if (patch.size() < DELTA_HEADER_SIZE + 8 || string(reinterpret_cast<const char*>(p), 4) != KITTY_MAGIC_V7)
+        throw runtime_error("Not a KP07 delta patch: " + patchPath);
+    if (p[4] != DELTA_VERSION) throw runtime_error("Unsupported KP07 patch version.");
+    uint64_t refSize = get<uint64_t>(p + 5), refHash = get<uint64_t>(p + 13);
+    uint64_t newSize = get<uint64_t>(p + 21), newHash = get<uint64_t>(p + 29);
+
+    MappedFile ref(referencePath);
+    {
+        KITTY_TRACE("delta hash");
+        if (ref.size() != refSize || xxh64(ref.data(), (size_t)ref.size()) != refHash)
+            throw runtime_error("Reference " + referencePath + " is not the file this patch was made against ("
+                                + to_string(refSize) + " bytes expected).");
+    }
+
+    // record table at the end
+    uint64_t count = get<uint64_t>(p + patch.size() - 8);
+    if (count > (patch.size() - DELTA_HEADER_SIZE - 8) / 16) throw runtime_error("Corrupted KP07 patch (record count).");
+    uint64_t tableStart = patch.size() - 8 - count * 16;
+    vector<DeltaRecord> records((size_t)count);
+    uint64_t total = 0, newBytes = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        DeltaRecord& r = records[(size_t)i];
+        r.length = get<uint64_t>(p + tableStart + 16 * i);
+        r.source = get<uint64_t>(p + tableStart + 16 * i + 8);
+        if (r.length == 0 || r.length > newSize - total
+            || (r.source != DELTA_NEW && (r.source > refSize || r.length > refSize - r.source)))
+            throw runtime_error("Corrupted KP07 patch (record " + to_string(i) + ").");
+        total += r.length;
+        if (r.source == DELTA_NEW) newBytes += r.length;
+    }
+    if (total != newSize) throw runtime_error("Corrupted KP07 patch (sizes).");
+
+    ofstream out(outputPath, ios::binary);
+    if (!out) throw runtime_error("Cannot open output file: " + outputPath);
+    XXH64 hash;
+    auto write = [&](const uint8_t* data, size_t n) {
+        out.write(reinterpret_cast<const char*>(data), (streamsize)n);
+        hash.update(data, n);
+    };
+    size_t rec = 0;
+    uint64_t usedInRec = 0;
+    auto copyReferences = [&]() {
+        for (; rec < records.size() && records[rec].source != DELTA_NEW; ++rec)
+            write(ref.data() + records[rec].source, (size_t)records[rec].length);
+    };
+    KittyDecoder dec([&](const uint8_t* data, size_t n) {
+        while (n > 0) {
+            copyReferences();
+            if (rec == records.size()) throw runtime_error("Corrupted KP07 patch (stream longer than its records).");
+            size_t take = (size_t)min<uint64_t>(n, records[rec].length - usedInRec);
+            write(data, take);
+            data += take;
+            n -= take;
+            usedInRec += take;
+            if (usedInRec == records[rec].length) {
+                ++rec;
+                usedInRec = 0;
+            }
+        }
+    }, stats);
+    {
+        KITTY_TRACE("delta apply");
+        dec.update(p + DELTA_HEADER_SIZE, (size_t)(tableStart - DELTA_HEADER_SIZE));
+        dec.finish();
+        copyReferences();
+    }
+    if (dec.bytesOut() != newBytes || rec != records.size())
+        throw runtime_error("Corrupted KP07 patch (stream size mismatch).");
+    out.close();
+    if (!out) throw runtime_error("Failed to write " + outputPath);
+    if (hash.digest() != newHash) throw runtime_error("Patched file does not match the recorded XXH64 (corrupted patch).");
+    if (stats) stats_capture_memory(*stats);
+    cout << "Patched " << referencePath << " → " << outputPath << " (" << newSize << " bytes)\n";
+}
@@ -0,0 +1,40 @@
+// delta.h
+#pragma once
+#include <cstdint>
+#include <string>
+#include "lz77.h"
+#include "stats.h"
+
+// Delta patches (KP07): a new version of a file encoded against the previous
+// one. Runs of the new file found anywhere in the reference become copy
+// records; only the bytes in between go through LZ77 + Huffman, so a patch
+// is roughly the size of the changes. Applying a patch needs the exact
+// reference it was made from (checked by size and XXH64).
+//
+// Layout: "KP07", u8 version, u64 reference size, u64 reference XXH64,
+// u64 new size, u64 new XXH64, a KittyPress stream of the new bytes, the
+// copy records ({u64 length, u64 reference offset or DELTA_NEW}, in file
+// order) and a u64 record count.
+const uint8_t DELTA_VERSION = 1;
+const uint64_t DELTA_NEW = ~0ull;  // record takes its bytes from the stream
+
+// Shortest copy looked up through the reference index (one hashed window)
+const size_t DELTA_MIN_MATCH = 32;
+
+// The index samples window positions picked by content, so a shifted copy
+// of a reference run is found at the same anchors; at most this many are
+// kept (larger references sample more sparsely)
+const uint64_t DELTA_MAX_ANCHORS = 1ull << 22;
+
+struct DeltaOptions {
+    int level = LZ77_DEFAULT_LEVEL;
+    KittyStats* stats = nullptr;
+};
+
+void createDelta(const std::string& referencePath, const std::string& newPath,
+                 const std::string& patchPath, const DeltaOptions& options = DeltaOptions());
+
+// Rebuilds the new file at outputPath; throws if reference is not the file
+// the patch was made against or the result does not hash to the recorded value
+void applyDelta(const std::string& referencePath, const std::string& patchPath,
+                const std::string& outputPath, KittyStats* stats = nullptr);
@@ -0,0 +1,200 @@
+// dict.cpp  (.kd dictionaries and the trainer)
+#include "dict.h"
+#include "histogram.h"
+#include "huffman.h"
+#include "kitty.h"
+#include "memtrack.h"
+#include "trace.h"
+#include "xxhash.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+
+static const size_t TRAIN_DMER = 8;      // substring length the trainer scores
+static const size_t TRAIN_SEGMENT = 64;  // bytes added to the dictionary per pick
+
+static uint32_t dictionaryId(const vector<uint8_t> &content, const array<uint8_t, 256> &lengths) {
+    XXH64 h;
+    h.update(lengths.data(), lengths.size());
+    h.update(content.data(), content.size());
+    return (uint32_t)h.digest();
+}
+
+KittyDictionary::KittyDictionary(vector<uint8_t> content, const array<uint8_t, 256> &codeLengths)
+    : bytes(move(content)), lengths(codeLengths) {
+    validate();
+    dictId = dictionaryId(bytes, lengths);
+}
+
+KittyDictionary::KittyDictionary(const string &path) {
+    ifstream in(path, ios::binary);
+    if (!in) throw runtime_error("Cannot open dictionary " + path);
+    char magic[4] = {};
+    uint32_t size = 0;
+    in.read(magic, 4);
+    in.read(reinterpret_cast<char*>(&dictId), 4);
+    in.read(reinterpret_cast<char*>(&size), 4);
+    if (!in || string(magic, 4) != KITTY_DICT_MAGIC) throw runtime_error("Not a KittyPress dictionary: " + path);
+    if (size > DICT_MAX_SIZE) throw runtime_error("Corrupted dictionary (size): " + path);
+    in.read(reinterpret_cast<char*>(lengths.data()), 256);
+    bytes.resize(size);
+    in.read(reinterpret_cast<char*>(bytes.data()), size);
+    if (!in) throw runtime_error("Corrupted dictionary (truncated): " + path);
+    validate();
+    if (dictionaryId(bytes, lengths) != dictId) throw runtime_error("Corrupted dictionary (id mismatch): " + path);
+}
+
+void KittyDictionary::validate() const {
+    if (bytes.size() > DICT_MAX_SIZE) throw runtime_error("Dictionary larger than the LZ77 window.");
+    for (uint8_t len : lengths)
+        if (len == 0) throw runtime_error("Dictionary code table does not cover every byte.");
+    canonicalCodes(lengths);  // throws on lengths that are not a prefix code
+}
+
+void KittyDictionary::save(const string &path) const {
+    ofstream out(path, ios::binary);
+    if (!out) throw runtime_error("Cannot open output file " + path);
+    uint32_t size = (uint32_t)bytes.size();
+    out.write(KITTY_DICT_MAGIC.c_str(), KITTY_DICT_MAGIC.size());
+    out.write(reinterpret_cast<const char*>(&dictId), 4);
+    out.write(reinterpret_cast<const char*>(&size), 4);
+    out.write(reinterpret_cast<const char*>(lengths.data()), 256);
+    out.write(reinterpret_cast<const char*>(bytes.data()), size);
+    out.close();
+    if (!out) throw runtime_error("Failed to write dictionary " + path);
+}
+
+string dict_id_hex(uint32_t id) {
+    static const char digits[] = "0123456789abcdef";
+    string s(8, '0');
+    for (int i = 7; i >= 0; --i, id >>= 4) s[i] = digits[id & 15];
+    return s;
+}
+
+unique_ptr<LZ77StreamCompressor> KittyDictionary::compressor(size_t windowSize, int level) const {
+    auto build = [&]() {
+        KITTY_TRACE("dictionary prime");
+        unique_ptr<LZ77StreamCompressor> lz(new LZ77StreamCompressor(windowSize, 255, level));
+        lz->prime(bytes.data(), bytes.size());
+        return lz;
+    };
+    if (mem_budget() != 0) return build();
+    lock_guard<mutex> lock(cacheMutex);
+    auto &slot = primed[{ windowSize, level }];
+    if (!slot) slot = build();
+    return unique_ptr<LZ77StreamCompressor>(new LZ77StreamCompressor(*slot));
+}
+
+// ---- trainer ----
+
+// Dictionary content: one best segment per epoch (an equal slice of the
+// concatenated samples). A segment scores the sample counts of the distinct
+// d-mers it contains; d-mers found in a single sample score nothing, and
+// the d-mers of a picked segment score nothing afterwards.
+static vector<uint8_t> selectSegments(const vector<vector<uint8_t>> &samples, size_t dictSize) {
+    KITTY_TRACE("dictionary segments");
+    vector<uint8_t> all;
+    for (auto &s : samples) all.insert(all.end(), s.begin(), s.end());
+    if (all.size() < TRAIN_SEGMENT) return all;
+
+    auto dmer = [&all](size_t pos) {
+        uint64_t v;
+        memcpy(&v, all.data() + pos, TRAIN_DMER);
+        return v;
+    };
+
+    // sample counts per d-mer (a d-mer may straddle two samples; harmless)
+    unordered_map<uint64_t, pair<uint32_t, uint32_t>> seen;  // d-mer -> (samples, last sample)
+    size_t pos = 0;
+    for (uint32_t s = 0; s < samples.size(); ++s) {
+        size_t end = pos + samples[s].size();
+        for (; pos + TRAIN_DMER <= min(end, all.size()); ++pos) {
+            auto &e = seen[dmer(pos)];
+            if (e.first == 0 || e.second != s) {
+                e.first++;
+                e.second = s;
+            }
+        }
+        pos = end;
+    }
+    unordered_map<uint64_t, uint32_t> score;
+    for (auto &e : seen)
+        if (e.second.first >= 2) score[e.first] = e.second.first;
+    seen.clear();
+
+    size_t epochs = max<size_t>(1, min(dictSize / TRAIN_SEGMENT, all.size() / TRAIN_SEGMENT));
+    size_t epochSize = all.size() / epochs;
+    const size_t dmersPerSegment = TRAIN_SEGMENT - TRAIN_DMER + 1;
+    vector<pair<uint64_t, size_t>> picks;  // (score, start)
+    unordered_map<uint64_t, uint32_t> active;  // d-mers in the current window
+    for (size_t e = 0; e < epochs; ++e) {
+        size_t begin = e * epochSize;
+        size_t end = min(all.size(), begin + epochSize);
+        if (end - begin < TRAIN_SEGMENT) continue;
+        active.clear();
+        uint64_t current = 0, best = 0;
+        size_t bestStart = begin;
+        auto value = [&score](uint64_t d) -> uint64_t {
+            auto it = score.find(d);
+            return it == score.end() ? 0 : it->second;
+        };
+        // window of d-mers [first, last) starting at segment start `first`
+        for (size_t last = begin; last + TRAIN_DMER <= end; ++last) {
+            uint64_t in = dmer(last);
+            if (active[in]++ == 0) current += value(in);
+            if (last - begin + 1 > dmersPerSegment) {
+                uint64_t out = dmer(last - dmersPerSegment);
+                if (--active[out] == 0) current -= value(out);
+            }
+            if (last - begin + 1 >= dmersPerSegment && current > best) {
+                best = current;
+                bestStart = last + 1 - dmersPerSegment;
+            }
+        }
+        if (best == 0) continue;
+        picks.push_back({ best, bestStart });
+        for (size_t p = bestStart; p < bestStart + dmersPerSegment; ++p) score.erase(dmer(p));
+    }
+
+    sort(picks.begin(), picks.end());
+    vector<uint8_t> content;
+    for (auto &p : picks) content.insert(content.end(), all.begin() + p.second, all.begin() + p.second + TRAIN_SEGMENT);
+    if (content.size() > dictSize) content.erase(content.begin(), content.end() - dictSize);
+    return content;
+}
+
+unique_ptr<KittyDictionary> dict_train(const vector<vector<uint8_t>> &samples, size_t dictSize, int level) {
+    if (samples.empty()) throw runtime_error("No samples to train a dictionary on.");
+    dictSize = min(dictSize, DICT_MAX_SIZE);
+    vector<uint8_t> content = selectSegments(samples, dictSize);
+
+    // token statistics of the samples compressed against the content; every
+    // byte keeps a count so any input can be coded with the table
+    KITTY_TRACE("dictionary code table");
+    array<uint8_t, 256> flat;
+    flat.fill(8);
+    KittyDictionary draft(content, flat);
+    ByteHistogram freq = {};
+    for (auto &s : samples) {
+        auto lz = draft.compressor(DICT_MAX_SIZE, level);
+        lz->feed(s, true);
+        auto tokens = lz->consumeOutput();
+        histogram_add(freq, tokens.data(), tokens.size());
+    }
+    for (auto &f : freq) f += 1;
+    array<uint8_t, 256> lengths{};
+    while (true) {
+        bool fits = true;
+        for (auto &p : buildHuffmanCodes(freq)) {
+            fits = fits && p.second.size() <= MAX_CANONICAL_CODE_LEN;
+            lengths[p.first] = (uint8_t)p.second.size();
+        }
+        if (fits) break;
+        for (auto &f : freq) f = f / 2 + 1;  // flatten until the longest code fits
+    }
+    return unique_ptr<KittyDictionary>(new KittyDictionary(move(content), lengths));
+}
@@ -0,0 +1,54 @@
+// dict.h
+#pragma once
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "lz77.h"
+
+// Preset dictionary for small inputs (.kd file): bytes that pre-fill the
+// LZ77 window plus a Huffman code table for LZ77 token bytes, both trained
+// on sample files. Streams compressed with a dictionary are KP06 and record
+// its id; they decode only with the same dictionary.
+const size_t DICT_MAX_SIZE = 65535;  // the LZ77 window
+const size_t DICT_DEFAULT_SIZE = 32 * 1024;
+
+class KittyDictionary {
+public:
+    KittyDictionary(std::vector<uint8_t> content, const std::array<uint8_t, 256> &codeLengths);
+    explicit KittyDictionary(const std::string &path);  // loads a .kd file; throws if it is not one
+
+    void save(const std::string &path) const;
+
+    uint32_t id() const { return dictId; }
+    const std::vector<uint8_t> &content() const { return bytes; }
+    const std::array<uint8_t, 256> &codeLengths() const { return lengths; }  // every byte has a code
+
+    // A compressor whose window holds the content. The primed hash tables
+    // are built once per (window, level) and copied for each call (rebuilt
+    // every time under --max-memory, where a cached copy would not fit).
+    std::unique_ptr<LZ77StreamCompressor> compressor(size_t windowSize, int level) const;
+
+private:
+    uint32_t dictId = 0;
+    std::vector<uint8_t> bytes;
+    std::array<uint8_t, 256> lengths{};
+    mutable std::mutex cacheMutex;
+    mutable std::map<std::pair<size_t, int>, std::unique_ptr<LZ77StreamCompressor>> primed;
+
+    void validate() const;
+};
+
+// Dictionary id as 8 hex digits (as printed by train-dict and in errors)
+std::string dict_id_hex(uint32_t id);
+
+// Builds a dictionary of at most dictSize bytes from sample inputs. The
+// content is made of the segments that share the most 8-byte substrings with
+// other samples, the strongest last (nearest the data, shortest offsets);
+// the code table comes from compressing the samples against that content.
+std::unique_ptr<KittyDictionary> dict_train(const std::vector<std::vector<uint8_t>> &samples,
+                                            size_t dictSize = DICT_DEFAULT_SIZE,
+                                            int level = LZ77_DEFAULT_LEVEL);
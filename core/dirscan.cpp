@@ -0,0 +1,145 @@
+// dirscan.cpp
+#include "dirscan.h"
+#include "trace.h"
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+DirScanner::DirScanner(const vector<string>& inputs, unsigned threads) {
+    // top-level inputs are classified here; only directories go to the workers
+    for (auto& in : inputs) {
+        fs::path abs = fs::absolute(in);
+        if (fs::is_directory(abs)) {
+            // same names as fs::relative(entry, parent of the input): "dir/..." for
+            // "dir", no prefix for "dir/" or "."
+            string prefix = fs::relative(abs, abs.parent_path()).generic_string();
+            if (prefix == ".") prefix.clear();
+            dirs.push_back({ abs.string(), prefix });
+        } else if (fs::is_regular_file(abs)) {
+            files.push_back({ abs.string(), abs.filename().string() });
+        }
+    }
+    active = dirs.size();
+    if (dirs.empty()) return;
+
+    if (threads == 0) threads = max(4u, thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; ++i) workers.emplace_back(&DirScanner::work, this);
+}
+
+DirScanner::~DirScanner() {
+    {
+        lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    dirsReady.notify_all();
+    for (auto& t : workers) t.join();
+}
+
+bool DirScanner::next(ArchiveInput& out) {
+    unique_lock<std::mutex> lock(stateMutex);
+    filesReady.wait(lock, [&] { return !files.empty() || active == 0 || error; });
+    if (error) rethrow_exception(error);
+    if (files.empty()) return false;
+    out = move(files.front());
+    files.pop_front();
+    return true;
+}
+
+void DirScanner::work() {
+    vector<Dir> subdirs;
+    vector<ArchiveInput> found;
+    while (true) {
+        Dir d;
+        {
+            unique_lock<std::mutex> lock(stateMutex);
+            dirsReady.wait(lock, [&] { return !dirs.empty() || active == 0 || stopping; });
+            if (stopping || dirs.empty()) return;
+            d = move(dirs.back());
+            dirs.pop_back();
+        }
+
+        subdirs.clear();
+        found.clear();
+        try {
+            KITTY_TRACE("directory scan", d.abs);
+            readDir(d, subdirs, found);
+        } catch (...) {
+            lock_guard<std::mutex> lock(stateMutex);
+            if (!error) error = current_exception();
+            stopping = true;
+            dirs.clear();
+            active = 0;
+            dirsReady.notify_all();
+            filesReady.notify_all();
+            return;
+        }
+
+        lock_guard<std::mutex> lock(stateMutex);
+        if (stopping) return;
+        for (auto& f : found) files.push_back(move(f));
+        for (auto& s : subdirs) dirs.push_back(move(s));
+        active += subdirs.size();
+        --active;
+        if (!subdirs.empty() || active == 0) dirsReady.notify_all();
+        if (!found.empty() || active == 0) filesReady.notify_all();
+    }
+}
+
+#ifdef _WIN32
+
+// FindFirstFile/FindNextFile already carry the attributes, so the entry
+// type checks below do not hit the disk again
+void DirScanner::readDir(const Dir& d, vector<Dir>& subdirs, vector<ArchiveInput>& found) {
+    for (auto& e : fs::directory_iterator(d.abs)) {
+        string name = e.path().filename().string();
+        string rel = d.rel.empty() ? name : d.rel + "/" + name;
+        if (e.is_directory() && !e.is_symlink()) subdirs.push_back({ e.path().string(), rel });
+        else if (e.is_regular_file()) found.push_back({ e.path().string(), rel });
+    }
+}
+
+#else
+
+void DirScanner::readDir(const Dir& d, vector<Dir>& subdirs, vector<ArchiveInput>& found) {
+    DIR* dir = opendir(d.abs.c_str());
+    if (!dir) throw runtime_error("Cannot open directory " + d.abs);
+    while (dirent* ent = readdir(dir)) {
+        const char* name = ent->d_name;
+        if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) continue;
+        string abs = d.abs + "/" + name;
+        unsigned char type = ent->d_type;
+        if (type == DT_UNKNOWN || type == DT_LNK) {
+            struct stat st;
+            if (lstat(abs.c_str(), &st) != 0) continue;
+            if (S_ISLNK(st.st_mode))  // files behind symlinks count, directories are not followed
+                type = stat(abs.c_str(), &st) == 0 && S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            else
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (type != DT_DIR && type != DT_REG) continue;
+        string rel = d.rel.empty() ? string(name) : d.rel + "/" + name;
+        if (type == DT_DIR) subdirs.push_back({ move(abs), move(rel) });
+        else found.push_back({ move(abs), move(rel) });
+    }
+    closedir(dir);
+}
+
+#endif
+
+vector<ArchiveInput> scanAll(const vector<string>& inputs, unsigned threads) {
+    KITTY_TRACE("directory scan");
+    DirScanner scanner(inputs, threads);
+    vector<ArchiveInput> files;
+    ArchiveInput f;
+    while (scanner.next(f)) files.push_back(move(f));
+    sort(files.begin(), files.end(),
+         [](const ArchiveInput& a, const ArchiveInput& b) { return a.relPath < b.relPath; });
+    return files;
+}
@@ -0,0 +1,55 @@
+// dirscan.h
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct ArchiveInput {
+    std::string absPath;  // actual disk path
+    std::string relPath;  // path inside archive
+};
+
+// Parallel walk of files and directory trees. Worker threads take
+// directories from a shared stack and read them with readdir, classifying
+// entries by d_type (stat only for symlinks and filesystems that report
+// DT_UNKNOWN); each directory's files are published as one batch, so a
+// consumer can start on the first files while the walk is still running.
+// Symlinked directories are not followed. Order is not deterministic.
+class DirScanner {
+public:
+    explicit DirScanner(const std::vector<std::string>& inputs, unsigned threads = 0);  // 0 = default
+    ~DirScanner();
+
+    DirScanner(const DirScanner&) = delete;
+    DirScanner& operator=(const DirScanner&) = delete;
+
+    // Next discovered regular file; blocks while the walk is running and
+    // returns false once it is complete. Rethrows a worker's error.
+    bool next(ArchiveInput& out);
+
+private:
+    struct Dir {
+        std::string abs;
+        std::string rel;  // prefix inside the archive ("" = none)
+    };
+
+    std::mutex stateMutex;
+    std::condition_variable dirsReady, filesReady;
+    std::vector<Dir> dirs;            // directories waiting to be read
+    std::deque<ArchiveInput> files;   // discovered, not yet taken by next()
+    size_t active = 0;                // directories queued or being read
+    bool stopping = false;
+    std::exception_ptr error;
+    std::vector<std::thread> workers;
+
+    void work();
+    void readDir(const Dir& d, std::vector<Dir>& subdirs, std::vector<ArchiveInput>& found);
+};
+
+// Every file the scanner finds, sorted by relPath (deterministic order)
+std::vector<ArchiveInput> scanAll(const std::vector<std::string>& inputs, unsigned threads = 0);
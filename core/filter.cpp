@@ -0,0 +1,299 @@
+// filter.cpp
+#include "filter.h"
+#include "histogram.h"
+#include "lz77.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+void filter_validate(const FilterSpec &spec) {
+    bool ok = false;
+    switch (spec.kind) {
+    case FilterKind::None:
+    case FilterKind::X86: ok = spec.param == 0; break;
+    case FilterKind::Delta: ok = spec.param >= 1; break;
+    case FilterKind::Transpose: ok = spec.param >= 2; break;
+    }
+    if (!ok) throw runtime_error("Corrupted KP08 stream (unknown filter).");
+}
+
+string filter_name(const FilterSpec &spec) {
+    switch (spec.kind) {
+    case FilterKind::None: return "none";
+    case FilterKind::X86: return "x86";
+    case FilterKind::Delta: return "delta:" + to_string(spec.param);
+    case FilterKind::Transpose: return "stride:" + to_string(spec.param);
+    }
+    return "?";
+}
+
+FilterStream::FilterStream(const FilterSpec &s, bool enc) : spec(s), encode(enc) {
+    filter_validate(spec);
+    if (spec.kind == FilterKind::Delta) last.assign(spec.param, 0);
+    if (spec.kind == FilterKind::Transpose) block = FILTER_TRANSPOSE_BLOCK / spec.param * spec.param;
+}
+
+void FilterStream::update(const uint8_t *data, size_t n, vector<uint8_t> &out) {
+    switch (spec.kind) {
+    case FilterKind::None: out.insert(out.end(), data, data + n); break;
+    case FilterKind::X86: x86(data, n, out); break;
+    case FilterKind::Delta: delta(data, n, out); break;
+    case FilterKind::Transpose: transpose(data, n, out); break;
+    }
+}
+
+void FilterStream::finish(vector<uint8_t> &out) {
+    // an E8 in the last four bytes has no whole operand, a partial block
+    // is not transposed: both directions pass these bytes through
+    out.insert(out.end(), held.begin(), held.end());
+    pos += held.size();
+    held.clear();
+}
+
+// Bytewise add/subtract within a word (no carries between bytes)
+const uint64_t HIGH_BITS = 0x8080808080808080ull;
+template <class W> inline W addBytes(W a, W b) {
+    const W h = (W)HIGH_BITS;
+    return ((a & ~h) + (b & ~h)) ^ ((a ^ b) & h);
+}
+template <class W> inline W subBytes(W a, W b) {
+    const W h = (W)HIGH_BITS;
+    return ((a | h) - (b & ~h)) ^ ((a ^ ~b) & h);
+}
+template <class W> inline W load(const uint8_t *p) {
+    W v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+template <class W> inline void store(uint8_t *p, W v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+// Delta over [from, n) a word at a time: W bytes never reach back into the
+// bytes being written when W <= stride
+template <class W> size_t deltaWords(const uint8_t *data, uint8_t *o, size_t from, size_t n, size_t stride, bool encode) {
+    size_t i = from;
+    if (encode)
+        for (; i + sizeof(W) <= n; i += sizeof(W)) store<W>(o + i, subBytes(load<W>(data + i), load<W>(data + i - stride)));
+    else if (stride == sizeof(W) && i + sizeof(W) <= n)  // the previous word stays in a register
+        for (W prev = load<W>(o + i - stride); i + sizeof(W) <= n; i += sizeof(W)) {
+            prev = addBytes(load<W>(data + i), prev);
+            store<W>(o + i, prev);
+        }
+    else
+        for (; i + sizeof(W) <= n; i += sizeof(W)) store<W>(o + i, addBytes(load<W>(data + i), load<W>(o + i - stride)));
+    return i;
+}
+
+// Offset of the first E8/E9 in p[0..n), or n
+static size_t findBranch(const uint8_t *p, size_t n) {
+    const uint64_t ones = 0x0101010101010101ull;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t y = (load<uint64_t>(p + i) ^ (0xE8 * ones)) & (0xFE * ones);  // zero byte where E8/E9
+        if ((y - ones) & ~y & HIGH_BITS) break;
+    }
+    while (i < n && (p[i] & 0xFE) != 0xE8) ++i;
+    return i;
+}
+
+// Converts operands in place over the held tail plus data; an operand is
+// converted only when its top byte is 00 or FF (a near target), and the
+// converted value keeps that form (25-bit arithmetic). The scan steps over
+// the operand of every E8/E9 it finds, converted or not, so no conversion
+// changes a byte an earlier decision read and the decoder sees the same
+// E8/E9 positions as the encoder
+void FilterStream::x86(const uint8_t *data, size_t n, vector<uint8_t> &out) {
+    size_t start = out.size();
+    out.insert(out.end(), held.begin(), held.end());
+    out.insert(out.end(), data, data + n);
+    uint8_t *p = out.data() + start;
+    size_t len = out.size() - start, i = 0;
+    while (i + 5 <= len) {
+        i += findBranch(p + i, len - 4 - i);
+        if (i + 5 > len) break;
+        if ((uint8_t)(p[i + 4] + 1) > 1) { i += 5; continue; }
+        uint32_t v;
+        memcpy(&v, p + i + 1, 4);
+        uint32_t at = (uint32_t)(pos + i + 5);
+        v = encode ? v + at : v - at;
+        v = ((v & 0x01FFFFFFu) ^ 0x01000000u) - 0x01000000u;  // sign-extend bit 24
+        memcpy(p + i + 1, &v, 4);
+        i += 5;
+    }
+    held.assign(p + i, p + len);
+    out.resize(start + i);
+    pos += i;
+}
+
+void FilterStream::delta(const uint8_t *data, size_t n, vector<uint8_t> &out) {
+    size_t stride = spec.param, start = out.size();
+    out.resize(start + n);
+    uint8_t *o = out.data() + start;
+    size_t head = min(n, stride);
+    for (size_t i = 0; i < head; ++i) o[i] = (uint8_t)(encode ? data[i] - last[i] : data[i] + last[i]);
+    size_t i = stride;
+    if (stride >= 8) i = deltaWords<uint64_t>(data, o, i, n, stride, encode);
+    else if (stride >= 4) i = deltaWords<uint32_t>(data, o, i, n, stride, encode);
+    if (encode)
+        for (; i < n; ++i) o[i] = (uint8_t)(data[i] - data[i - stride]);
+    else
+        for (; i < n; ++i) o[i] = (uint8_t)(data[i] + o[i - stride]);
+    const uint8_t *orig = encode ? data : o;
+    if (n >= stride) {
+        last.assign(orig + n - stride, orig + n);
+    } else {
+        last.erase(last.begin(), last.begin() + n);
+        last.insert(last.end(), orig, orig + n);
+    }
+}
+
+// One block of rows records; Width > 0 fixes the record width at compile
+// time so the inner loop unrolls
+template <size_t Width> static void transposeBlock(const uint8_t *in, uint8_t *o, size_t width, size_t rows, bool encode) {
+    const size_t w = Width ? Width : width;
+    if (encode) {
+        for (size_t r = 0; r < rows; ++r, in += w)
+            for (size_t c = 0; c < w; ++c) o[c * rows + r] = in[c];
+    } else {
+        for (size_t r = 0; r < rows; ++r, o += w)
+            for (size_t c = 0; c < w; ++c) o[c] = in[c * rows + r];
+    }
+}
+
+void FilterStream::transpose(const uint8_t *data, size_t n, vector<uint8_t> &out) {
+    size_t width = spec.param, rows = block / width;
+    auto flush = [&](const uint8_t *in) {
+        size_t start = out.size();
+        out.resize(start + block);
+        uint8_t *o = out.data() + start;
+        switch (width) {
+        case 2: transposeBlock<2>(in, o, width, rows, encode); break;
+        case 4: transposeBlock<4>(in, o, width, rows, encode); break;
+        case 8: transposeBlock<8>(in, o, width, rows, encode); break;
+        default: transposeBlock<0>(in, o, width, rows, encode); break;
+        }
+    };
+    if (!held.empty()) {
+        size_t take = min(n, block - held.size());
+        held.insert(held.end(), data, data + take);
+        data += take;
+        n -= take;
+        if (held.size() < block) return;
+        flush(held.data());
+        held.clear();
+    }
+    for (; n >= block; data += block, n -= block) flush(data);
+    held.assign(data, data + n);
+}
+
+FilterChain::FilterChain(vector<FilterBlock> b, bool enc) : blocks(move(b)), encode(enc) {
+    for (auto &block : blocks) {
+        filter_validate(block.spec);
+        if (block.length == 0) throw runtime_error("Corrupted KP08 stream (empty filter block).");
+    }
+    startBlock();
+}
+
+void FilterChain::startBlock() {
+    used = 0;
+    if (current < blocks.size()) stream.reset(new FilterStream(blocks[current].spec, encode));
+    else stream.reset();
+}
+
+void FilterChain::update(const uint8_t *data, size_t n, vector<uint8_t> &out) {
+    while (n > 0) {
+        if (!stream) throw runtime_error("Corrupted KP08 stream (data past the filter blocks).");
+        size_t take = (size_t)min<uint64_t>(n, blocks[current].length - used);
+        stream->update(data, take, out);
+        data += take;
+        n -= take;
+        used += take;
+        if (used == blocks[current].length) {
+            stream->finish(out);
+            ++current;
+            startBlock();
+        }
+    }
+}
+
+void FilterChain::finish(vector<uint8_t> &out) {
+    (void)out;  // every block was finished as its last byte arrived
+    if (current != blocks.size()) throw runtime_error("Corrupted KP08 stream (filter blocks longer than the data).");
+}
+
+// Estimated coded size in bits of data after a fast LZ77 pass: token bytes
+// times their order-0 entropy
+static double trialCost(const uint8_t *data, size_t n) {
+    LZ77StreamCompressor lz(FILTER_TRIAL_WINDOW, 255, LZ77_MIN_LEVEL);
+    lz.feed(vector<uint8_t>(data, data + n), true);
+    vector<uint8_t> tokens = lz.consumeOutput();
+    ByteHistogram hist = {};
+    histogram_add(hist, tokens.data(), tokens.size());
+    return histogram_entropy(hist) * (double)tokens.size();
+}
+
+FilterSpec filter_choose(const uint8_t *block, size_t n) {
+    FilterSpec none;
+    if (n < FILTER_MIN_BLOCK) return none;
+    KITTY_TRACE("filter trial");
+    // trial slices: the whole block when small, else slices spread over it
+    vector<pair<size_t, size_t>> slices;
+    if (n <= FILTER_TRIAL_SIZE) {
+        slices.push_back({ 0, n });
+    } else {
+        size_t slice = FILTER_TRIAL_SIZE / FILTER_TRIAL_SLICES;
+        for (size_t k = 0; k < FILTER_TRIAL_SLICES; ++k)
+            slices.push_back({ (n - slice) * k / (FILTER_TRIAL_SLICES - 1), slice });
+    }
+    vector<uint8_t> sample;
+    for (auto &sl : slices) sample.insert(sample.end(), block + sl.first, block + sl.first + sl.second);
+    const uint8_t *p = sample.data();
+    size_t len = sample.size();
+
+    size_t text = 0, calls = 0;
+    for (size_t i = 0; i < len; ++i) {
+        uint8_t b = p[i];
+        text += (b >= 0x20 && b < 0x7F) || b == '\n' || b == '\r' || b == '\t';
+        calls += i + 5 <= len && (b & 0xFE) == 0xE8 && (uint8_t)(p[i + 4] + 1) <= 1;
+    }
+    if (text * 20 >= len * 19) return none;
+
+    // record width: the distance at which bytes repeat most often (a
+    // multiple of the width only wins when clearly ahead)
+    size_t bestStride = 1, bestEqual = 0;
+    for (size_t s = 1; s <= 16; ++s) {
+        size_t equal = 0;
+        for (size_t i = s; i < len; ++i) equal += p[i] == p[i - s];
+        if (equal * 10 > bestEqual * 11) {
+            bestEqual = equal;
+            bestStride = s;
+        }
+    }
+
+    vector<FilterSpec> candidates;
+    if (calls * 1024 >= len) candidates.push_back({ FilterKind::X86, 0 });
+    candidates.push_back({ FilterKind::Delta, (uint8_t)bestStride });
+    if (bestStride >= 2) candidates.push_back({ FilterKind::Transpose, (uint8_t)bestStride });
+
+    double bestCost = trialCost(p, len) * 0.97;  // a filter has to save at least 3%
+    FilterSpec best = none;
+    vector<uint8_t> filtered;
+    for (auto &c : candidates) {
+        filtered.clear();
+        for (size_t at = 0, k = 0; k < slices.size(); at += slices[k++].second) {
+            FilterStream f(c, true);  // each slice on its own, as if it started a block
+            f.update(p + at, slices[k].second, filtered);
+            f.finish(filtered);
+        }
+        double cost = trialCost(filtered.data(), filtered.size());
+        if (cost < bestCost) {
+            bestCost = cost;
+            best = c;
+        }
+    }
+    return best;
+}
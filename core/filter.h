@@ -0,0 +1,101 @@
+// filter.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Reversible byte filters run before LZ77 on data whose repetition a byte
+// matcher cannot see:
+//   X86        x86 CALL/JMP (E8/E9) relative targets made absolute, so every
+//              call to one function has the same bytes
+//   Delta      each byte minus the byte `param` positions earlier (samples,
+//              counters, sorted integers of width param)
+//   Transpose  blocks of param-byte records rewritten column by column
+//              (byte 0 of every record, then byte 1, ...)
+// The encoder picks a filter per block of input (FilterBlock); a stream with
+// any filtered block is KP08: "KP08", u32 block count, per block {u64 length,
+// u8 kind, u8 param}, then the KP03 stream of the filtered bytes. Filters
+// restart at each block.
+enum class FilterKind : uint8_t { None = 0, X86 = 1, Delta = 2, Transpose = 3 };
+
+struct FilterSpec {
+    FilterKind kind = FilterKind::None;
+    uint8_t param = 0;  // Delta: stride, Transpose: record width
+};
+
+// Throws on an unknown kind or a param out of range (corrupted header)
+void filter_validate(const FilterSpec &spec);
+std::string filter_name(const FilterSpec &spec);  // "x86", "delta:4", "stride:8"
+
+// Transposed blocks hold this many bytes, rounded down to whole records
+const size_t FILTER_TRANSPOSE_BLOCK = 8 * 1024;
+
+// Streaming filter in either direction. update() appends the bytes that are
+// final so far to out and holds back the few a later call can still change
+// (the operand of an E8 near the end, a partial transpose block); finish()
+// appends the rest. Output length always equals input length.
+class FilterStream {
+public:
+    FilterStream(const FilterSpec &spec, bool encode);
+
+    void update(const uint8_t *data, size_t n, std::vector<uint8_t> &out);
+    void finish(std::vector<uint8_t> &out);
+
+private:
+    FilterSpec spec;
+    bool encode;
+    uint64_t pos = 0;            // X86: input position of held[0]
+    std::vector<uint8_t> held;   // X86: up to 4 tail bytes; Transpose: the partial block
+    std::vector<uint8_t> last;   // Delta: the previous `stride` original bytes
+    size_t block = 0;            // Transpose: bytes per block
+
+    void x86(const uint8_t *data, size_t n, std::vector<uint8_t> &out);
+    void delta(const uint8_t *data, size_t n, std::vector<uint8_t> &out);
+    void transpose(const uint8_t *data, size_t n, std::vector<uint8_t> &out);
+};
+
+struct FilterBlock {
+    uint64_t length = 0;
+    FilterSpec spec;
+};
+const size_t FILTER_BLOCK_RECORD = 10;  // serialized FilterBlock
+
+// FilterStream over consecutive blocks, each with its own filter; finish()
+// throws unless exactly the blocks' total length went through
+class FilterChain {
+public:
+    FilterChain(std::vector<FilterBlock> blocks, bool encode);
+
+    void update(const uint8_t *data, size_t n, std::vector<uint8_t> &out);
+    void finish(std::vector<uint8_t> &out);
+
+private:
+    std::vector<FilterBlock> blocks;
+    bool encode;
+    size_t current = 0;
+    uint64_t used = 0;  // bytes of the current block seen
+    std::unique_ptr<FilterStream> stream;
+
+    void startBlock();
+};
+
+// The encoder chooses a filter for every block of this many input bytes
+// (neighbours with the same choice share one record)
+const size_t FILTER_BLOCK_SIZE = 64 * 1024;
+// Blocks shorter than this are never filtered
+const size_t FILTER_MIN_BLOCK = 8 * 1024;
+// Bytes of a block the trial compresses, taken as FILTER_TRIAL_SLICES
+// slices spread over the block
+const size_t FILTER_TRIAL_SIZE = 32 * 1024;
+const size_t FILTER_TRIAL_SLICES = 4;
+// The trial matches within one slice only
+const size_t FILTER_TRIAL_WINDOW = FILTER_TRIAL_SIZE / FILTER_TRIAL_SLICES - 1;
+
+// Picks the filter for one block: text is left alone; otherwise the
+// plausible candidates (x86 when E8/E9 operands look like near calls, delta
+// and transpose at the stride with the most repeated bytes) are tried with
+// a fast LZ77 pass, and one is kept when its token bytes are clearly
+// cheaper than the unfiltered ones.
+FilterSpec filter_choose(const uint8_t *block, size_t n);
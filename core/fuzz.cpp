@@ -0,0 +1,330 @@
+// fuzz.cpp
+#include "fuzz.h"
+#include "archive.h"
+#include "bitstream.h"
+#include "codec.h"
+#include "delta.h"
+#include "dict.h"
+#include "huffman.h"
+#include "kitty.h"
+#include "rng.h"
+#include "xxhash.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Bytes a stream may decode to before the run counts as rejected: keeps a
+// mutated match run from turning one input into a long decode
+static const uint64_t FUZZ_OUTPUT_LIMIT = 64ull << 20;
+
+// Little-endian boundary values written over 1/2/4/8-byte fields
+static const uint64_t INTERESTING[] = {
+    0, 1, 0x7F, 0x80, 0xFF, 0x100, 0x7FFF, 0xFFFF, 0x10000, 0x7FFFFFFF, 0x80000000,
+    0xFFFFFFFF, 0x100000000ull, 0x7FFFFFFFFFFFFFFFull, ~0ull,
+};
+
+enum class FuzzTarget { Stream, Archive, Patch };
+
+struct FuzzSeed {
+    string name;
+    FuzzTarget target;
+    vector<uint8_t> bytes;
+};
+
+// Work directory plus what the decoders need besides the input
+struct FuzzContext {
+    fs::path dir;
+    unique_ptr<KittyDictionary> dict;  // KP06 seeds
+    fs::path reference;                // the file the patch seed was made against
+};
+
+// The archive and delta calls report progress on cout; this drops it while in scope
+class QuietCout {
+public:
+    QuietCout() : saved(cout.rdbuf(&null)) {}
+    ~QuietCout() { cout.rdbuf(saved); }
+private:
+    struct NullBuf : streambuf {
+        int overflow(int c) override { return c; }
+    } null;
+    streambuf *saved;
+};
+
+static vector<uint8_t> readFile(const fs::path &path) {
+    ifstream in(path, ios::binary);
+    if (!in) throw runtime_error("Cannot open " + path.string());
+    return vector<uint8_t>((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+}
+
+static void writeFile(const fs::path &path, const vector<uint8_t> &data) {
+    ofstream out(path, ios::binary);
+    out.write(reinterpret_cast<const char *>(data.data()), (streamsize)data.size());
+    if (!out) throw runtime_error("Cannot write " + path.string());
+}
+
+static FuzzTarget targetOf(const vector<uint8_t> &bytes) {
+    string magic(bytes.begin(), bytes.begin() + min<size_t>(4, bytes.size()));
+    if (magic == KITTY_MAGIC_V4) return FuzzTarget::Archive;
+    if (magic == KITTY_MAGIC_V7) return FuzzTarget::Patch;
+    return FuzzTarget::Stream;
+}
+
+static vector<uint8_t> textData(size_t n, KittyRng &rng) {
+    static const char *words[] = { "kitty", "press", "window", "match", "literal", "huffman",
+                                   "archive", "stream", "block", "the", "of", "and" };
+    vector<uint8_t> out;
+    while (out.size() < n) {
+        const char *w = words[rng.below(sizeof(words) / sizeof(words[0]))];
+        out.insert(out.end(), w, w + strlen(w));
+        out.push_back(rng.below(8) ? ' ' : '\n');
+    }
+    out.resize(n);
+    return out;
+}
+
+static vector<uint8_t> randomData(size_t n, KittyRng &rng) {
+    vector<uint8_t> out(n);
+    for (uint8_t &b : out) b = (uint8_t)rng.next();
+    return out;
+}
+
+// Slowly rising 32-bit counters: the delta/stride filters pick these up (KP08)
+static vector<uint8_t> counterData(size_t n, KittyRng &rng) {
+    vector<uint8_t> out(n / 4 * 4);
+    uint32_t v = 1000;
+    for (size_t i = 0; i < out.size(); i += 4) {
+        v += 1 + (uint32_t)rng.below(4);
+        memcpy(&out[i], &v, 4);
+    }
+    return out;
+}
+
+// KP01 (or KP02 with an extension, not compressed) as the old encoder wrote
+// them: a map of '0'/'1' code strings, the bit count and the packed bits
+static vector<uint8_t> legacyStream(const vector<uint8_t> &data, bool kp02) {
+    ByteHistogram freq{};
+    histogram_add(freq, data.data(), data.size());
+    auto codes = buildHuffmanCodes(freq);
+    ostringstream out;
+    auto put64 = [&out](uint64_t v) { out.write(reinterpret_cast<const char *>(&v), 8); };
+    out << (kp02 ? KITTY_MAGIC_V2 : KITTY_MAGIC_V1);
+    if (kp02) {
+        out.put(0);
+        put64(4);
+        out << ".txt";
+    }
+    put64(codes.size());
+    uint64_t bits = 0;
+    for (auto &p : codes) {
+        out.put((char)p.first);
+        put64(p.second.size());
+        out << p.second;
+        bits += freq[p.first] * p.second.size();
+    }
+    put64(bits);
+    BitWriter writer(out);
+    for (uint8_t c : data) writer.writeBits(codes[c]);
+    writer.flush();
+    string s = out.str();
+    return vector<uint8_t>(s.begin(), s.end());
+}
+
+// One seed per format and feature the decoders handle. Built from a fixed
+// RNG seed, not --seed, so a replay sees the same reference and dictionary.
+static vector<FuzzSeed> builtinSeeds(FuzzContext &ctx) {
+    KittyRng rng(1);
+    vector<uint8_t> text = textData(24 * 1024, rng);
+    vector<uint8_t> counters = counterData(96 * 1024, rng);
+    vector<uint8_t> noise = randomData(4096, rng);
+    vector<FuzzSeed> seeds;
+    seeds.push_back({ "kp03", FuzzTarget::Stream, compressBuffer(text, "txt") });
+    seeds.push_back({ "kp08", FuzzTarget::Stream, compressBuffer(counters, "bin") });
+    seeds.push_back({ "stored", FuzzTarget::Stream, compressBuffer(noise, "") });
+    vector<uint8_t> legacy(text.begin(), text.begin() + 2048);
+    seeds.push_back({ "kp01", FuzzTarget::Stream, legacyStream(legacy, false) });
+    seeds.push_back({ "kp02", FuzzTarget::Stream, legacyStream(legacy, true) });
+
+    vector<uint8_t> framed;
+    KittyFrameEncoder frames([&framed](const uint8_t *p, size_t n) { framed.insert(framed.end(), p, p + n); });
+    frames.update(text);
+    frames.update(noise);
+    frames.finish();
+    seeds.push_back({ "kp05", FuzzTarget::Stream, framed });
+
+    vector<vector<uint8_t>> samples;
+    for (int i = 0; i < 16; ++i) samples.push_back(textData(1024, rng));
+    ctx.dict = dict_train(samples, 4096);
+    vector<uint8_t> small = textData(2048, rng);
+    vector<uint8_t> dictStream(kitty_compress_bound(small.size(), "txt"));
+    dictStream.resize(kitty_compress_into(small.data(), small.size(), dictStream.data(), dictStream.size(),
+                                          LZ77_DEFAULT_LEVEL, "txt", nullptr, ctx.dict.get()));
+    seeds.push_back({ "kp06", FuzzTarget::Stream, dictStream });
+
+    // archive with a duplicate and two large members that share most chunks,
+    // then an update that supersedes the duplicated and the chunk source member
+    vector<uint8_t> big = textData(160 * 1024, rng), edited = big;
+    vector<uint8_t> change = randomData(8 * 1024, rng);
+    copy(change.begin(), change.end(), edited.begin() + 64 * 1024);
+    fs::path files = ctx.dir / "seed-files";
+    fs::remove_all(files);
+    fs::create_directories(files / "sub");
+    writeFile(files / "a.txt", text);
+    writeFile(files / "sub" / "a-copy.txt", text);
+    writeFile(files / "counters.bin", counters);
+    writeFile(files / "noise.bin", noise);
+    writeFile(files / "big.txt", big);
+    writeFile(files / "sub" / "big-edited.txt", edited);
+    ArchiveOptions archiveOpts;
+    archiveOpts.chunkDedup = true;
+    archiveOpts.order = ArchiveOrder::Name;
+    fs::path archive = ctx.dir / "seed.kitty";
+    ctx.reference = ctx.dir / "reference.bin";
+    writeFile(ctx.reference, big);
+    fs::path patch = ctx.dir / "seed-patch.kitty";
+    {
+        QuietCout quiet;
+        createArchive({ files.string() }, archive.string(), archiveOpts);
+        writeFile(files / "a.txt", noise);
+        writeFile(files / "big.txt", edited);
+        updateArchive({ files.string() }, archive.string(), archiveOpts);
+        createDelta(ctx.reference.string(), (files / "sub" / "big-edited.txt").string(), patch.string());
+    }
+    seeds.push_back({ "kp04", FuzzTarget::Archive, readFile(archive) });
+    seeds.push_back({ "kp07", FuzzTarget::Patch, readFile(patch) });
+    return seeds;
+}
+
+static void mutate(vector<uint8_t> &d, const vector<FuzzSeed> &seeds, KittyRng &rng) {
+    for (uint64_t round = 0, rounds = 1 + rng.below(4); round < rounds; ++round) {
+        size_t size = d.size();
+        switch (rng.below(7)) {
+        case 0:  // flip a bit
+            if (size) d[rng.below(size)] ^= (uint8_t)(1u << rng.below(8));
+            break;
+        case 1:  // overwrite a byte
+            if (size) d[rng.below(size)] = (uint8_t)rng.next();
+            break;
+        case 2:  // truncate
+            d.resize(rng.below(size + 1));
+            break;
+        case 3: {  // insert random bytes
+            vector<uint8_t> bytes = randomData(1 + rng.below(16), rng);
+            d.insert(d.begin() + rng.below(size + 1), bytes.begin(), bytes.end());
+            break;
+        }
+        case 4: {  // delete a range
+            if (!size) break;
+            size_t at = rng.below(size), n = min<size_t>(size - at, 1 + rng.below(16));
+            d.erase(d.begin() + at, d.begin() + at + n);
+            break;
+        }
+        case 5: {  // splice: keep a prefix, continue with the tail of a seed
+            const vector<uint8_t> &other = seeds[rng.below(seeds.size())].bytes;
+            if (other.empty()) break;
+            size_t from = rng.below(other.size());
+            d.resize(rng.below(size + 1));
+            d.insert(d.end(), other.begin() + from, other.end());
+            break;
+        }
+        default: {  // boundary value over a size or count field
+            size_t width = (size_t)1 << rng.below(4);
+            if (size < width) break;
+            uint64_t v = INTERESTING[rng.below(sizeof(INTERESTING) / sizeof(INTERESTING[0]))];
+            memcpy(&d[rng.below(size - width + 1)], &v, width);
+            break;
+        }
+        }
+    }
+}
+
+// Decodes input (already written to path) the way the CLI would; throws what the decoders throw
+static void runInput(const FuzzContext &ctx, FuzzTarget target, const fs::path &path, const vector<uint8_t> &input) {
+    QuietCout quiet;
+    if (target == FuzzTarget::Stream) {
+        KittyDecoder dec([](const uint8_t *, size_t) {}, nullptr, ctx.dict.get());
+        dec.setOutputLimit(FUZZ_OUTPUT_LIMIT);
+        // pieces of varying size reach the split header and split token paths;
+        // drawn from the input's hash so a replay splits the same way
+        KittyRng pieces(xxh64(input.data(), input.size()));
+        for (size_t at = 0; at < input.size();) {
+            size_t n = (size_t)min<uint64_t>(input.size() - at, 1 + pieces.below(8192));
+            dec.update(input.data() + at, n);
+            at += n;
+        }
+        dec.finish();
+    } else if (target == FuzzTarget::Archive) {
+        fs::path out = ctx.dir / "extract";
+        fs::remove_all(out);
+        listArchive(path.string());
+        testArchive(path.string(), nullptr, 1, ctx.dict.get());
+        extractArchive(path.string(), out.string(), nullptr, 1, DuplicateLinks::Copy, ctx.dict.get());
+        // an archive that passed must still pass once compacted
+        fs::path compacted = ctx.dir / "compacted.kitty";
+        fs::copy_file(path, compacted, fs::copy_options::overwrite_existing);
+        compactArchive(compacted.string());
+        testArchive(compacted.string(), nullptr, 1, ctx.dict.get());
+    } else {
+        applyDelta(ctx.reference.string(), path.string(), (ctx.dir / "patched.bin").string());
+    }
+}
+
+int runFuzz(const FuzzOptions &opts) {
+    FuzzContext ctx;
+    ctx.dir = opts.outDir;
+    fs::create_directories(ctx.dir);
+    vector<FuzzSeed> seeds = builtinSeeds(ctx);  // also sets up the dictionary and patch reference
+    if (!opts.seeds.empty()) {
+        seeds.clear();
+        for (const string &path : opts.seeds) {
+            vector<uint8_t> bytes = readFile(path);
+            seeds.push_back({ path, targetOf(bytes), move(bytes) });
+        }
+    }
+    cout << "Fuzzing " << seeds.size() << " seed(s):";
+    for (const FuzzSeed &s : seeds) cout << ' ' << s.name << " (" << s.bytes.size() << ")";
+    cout << "\n";
+
+    KittyRng rng(opts.seed);
+    uint64_t runs = opts.iterations ? opts.iterations : seeds.size();
+    uint64_t accepted = 0, rejected = 0, failures = 0;
+    fs::path last = ctx.dir / "last.kitty";
+    auto start = chrono::steady_clock::now();
+    for (uint64_t i = 0; i < runs; ++i) {
+        const FuzzSeed &seed = opts.iterations ? seeds[rng.below(seeds.size())] : seeds[i];
+        vector<uint8_t> input = seed.bytes;
+        if (opts.iterations) mutate(input, seeds, rng);
+        writeFile(last, input);
+        string failure;
+        try {
+            runInput(ctx, seed.target, last, input);
+            ++accepted;
+            if (!opts.iterations) cout << "  " << seed.name << ": decoded\n";
+        } catch (const runtime_error &e) {
+            ++rejected;
+            if (!opts.iterations) cout << "  " << seed.name << ": rejected: " << e.what() << "\n";
+        } catch (const exception &e) {
+            failure = e.what();
+        } catch (...) {
+            failure = "unknown exception";
+        }
+        if (!failure.empty()) {
+            ++failures;
+            fs::path saved = ctx.dir / ("failure-" + to_string(i) + ".kitty");
+            writeFile(saved, input);
+            cout << "  FAILED run " << i << " (" << seed.name << "): " << failure << " → " << saved.string() << "\n";
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Fuzz: " << runs << " run(s), " << accepted << " decoded, " << rejected << " rejected, "
+         << failures << " failure(s) in " << seconds << " s\n";
+    return failures ? 1 : 0;
+}
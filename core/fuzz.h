@@ -0,0 +1,24 @@
+// fuzz.h
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct FuzzOptions {
+    std::vector<std::string> seeds;   // .kitty files to mutate; empty = built-in seeds
+    uint64_t iterations = 1000;       // mutated runs (0 = run the seeds once as they are)
+    uint64_t seed = 1;
+    std::string outDir = "kitty-fuzz";  // work files, last input and saved failures
+};
+
+// Mutation fuzzer for the decoders (`kittypress fuzz`). Each run mutates a
+// seed (bit flips, overwrites, truncation, insertions, deletions, splices,
+// boundary values over size fields) and decodes it: streams through
+// KittyDecoder in pieces of random size, archives through list, test,
+// extract and (once they pass) compact, patches through applyDelta against
+// the built-in reference. A runtime_error is a clean rejection; any other
+// exception is a failure and its input is saved under outDir. Every input is
+// written to outDir/last.kitty before it runs, so a crash can be replayed
+// with `kittypress fuzz <outDir>/last.kitty --iterations=0`.
+// Returns the process exit code: 1 if any run failed.
+int runFuzz(const FuzzOptions &opts);
@@ -0,0 +1,107 @@
+// histogram.cpp
+#include "histogram.h"
+#include "cpu.h"
+#include <cmath>
+#include <cstring>
+
+// Each 32-bit table receives at most a quarter of a slab, so slabs of 1 GiB
+// can never overflow a counter before being folded into the 64-bit result.
+static const size_t HIST_SLAB = size_t(1) << 30;
+
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void histogram_slab4(ByteHistogram &hist, const uint8_t *p, size_t n) {
+    uint32_t t0[256] = {}, t1[256] = {}, t2[256] = {}, t3[256] = {};
+    const uint8_t *end = p + n;
+
+    // 16 bytes per iteration: two 64-bit loads, bytes spread round-robin over
+    // the four tables (byte order does not matter for counting)
+    while (end - p >= 16) {
+        uint64_t a = load64(p);
+        uint64_t b = load64(p + 8);
+        p += 16;
+        t0[(uint8_t)a]++;         t1[(uint8_t)(a >> 8)]++;
+        t2[(uint8_t)(a >> 16)]++; t3[(uint8_t)(a >> 24)]++;
+        t0[(uint8_t)(a >> 32)]++; t1[(uint8_t)(a >> 40)]++;
+        t2[(uint8_t)(a >> 48)]++; t3[(uint8_t)(a >> 56)]++;
+        t0[(uint8_t)b]++;         t1[(uint8_t)(b >> 8)]++;
+        t2[(uint8_t)(b >> 16)]++; t3[(uint8_t)(b >> 24)]++;
+        t0[(uint8_t)(b >> 32)]++; t1[(uint8_t)(b >> 40)]++;
+        t2[(uint8_t)(b >> 48)]++; t3[(uint8_t)(b >> 56)]++;
+    }
+    while (p < end) t0[*p++]++;
+
+    for (int i = 0; i < 256; ++i)
+        hist[i] += (uint64_t)t0[i] + t1[i] + t2[i] + t3[i];
+}
+
+// Plain C++ like slab4 with twice the tables (no vector instructions); the
+// kernel table uses it from the AVX2 tier up
+static void histogram_slab8(ByteHistogram &hist, const uint8_t *p, size_t n) {
+    uint32_t t[8][256] = {};
+    const uint8_t *end = p + n;
+
+    // 32 bytes per iteration, one table per byte position mod 8
+    while (end - p >= 32) {
+        for (int k = 0; k < 32; k += 8) {
+            uint64_t w = load64(p + k);
+            t[0][(uint8_t)w]++;         t[1][(uint8_t)(w >> 8)]++;
+            t[2][(uint8_t)(w >> 16)]++; t[3][(uint8_t)(w >> 24)]++;
+            t[4][(uint8_t)(w >> 32)]++; t[5][(uint8_t)(w >> 40)]++;
+            t[6][(uint8_t)(w >> 48)]++; t[7][(uint8_t)(w >> 56)]++;
+        }
+        p += 32;
+    }
+    while (p < end) t[0][*p++]++;
+
+    for (int i = 0; i < 256; ++i) {
+        uint64_t sum = 0;
+        for (int k = 0; k < 8; ++k) sum += t[k][i];
+        hist[i] += sum;
+    }
+}
+
+void histogram_add_scalar(ByteHistogram &hist, const uint8_t *data, size_t n) {
+    while (n > 0) {
+        size_t len = n < HIST_SLAB ? n : HIST_SLAB;
+        histogram_slab4(hist, data, len);
+        data += len;
+        n -= len;
+    }
+}
+
+void histogram_add_slab8(ByteHistogram &hist, const uint8_t *data, size_t n) {
+    while (n > 0) {
+        size_t len = n < HIST_SLAB ? n : HIST_SLAB;
+        histogram_slab8(hist, data, len);
+        data += len;
+        n -= len;
+    }
+}
+
+void histogram_add(ByteHistogram &hist, const uint8_t *data, size_t n) {
+    kernels().histogram(hist, data, n);
+}
+
+uint64_t histogram_total(const ByteHistogram &hist) {
+    uint64_t total = 0;
+    for (uint64_t c : hist) total += c;
+    return total;
+}
+
+double histogram_entropy(const ByteHistogram &hist) {
+    uint64_t total = histogram_total(hist);
+    if (total == 0) return 0.0;
+    double entropy = 0.0;
+    const double N = (double)total;
+    for (uint64_t c : hist) {
+        if (c == 0) continue;
+        double p = (double)c / N;
+        entropy -= p * std::log2(p);
+    }
+    return entropy;
+}
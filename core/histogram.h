@@ -0,0 +1,23 @@
+// histogram.h
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// 256-entry byte frequency table shared by the entropy probe and the Huffman pass
+using ByteHistogram = std::array<uint64_t, 256>;
+
+// Adds the byte counts of data[0..n) to hist (hist is not cleared first).
+// Uses interleaved 32-bit count tables so consecutive equal bytes do not
+// serialize on the same counter (store-to-load forwarding stall).
+// Dispatches to the kernel selected in cpu.h.
+void histogram_add(ByteHistogram &hist, const uint8_t *data, size_t n);
+
+void histogram_add_scalar(ByteHistogram &hist, const uint8_t *data, size_t n); // 4 tables, 64-bit loads
+void histogram_add_slab8(ByteHistogram &hist, const uint8_t *data, size_t n);  // 8 tables, 32 B/iteration
+
+// Total number of bytes counted in hist
+uint64_t histogram_total(const ByteHistogram &hist);
+
+// Order-0 entropy in bits/byte (0 for an empty histogram)
+double histogram_entropy(const ByteHistogram &hist);
@@ -0,0 +1,125 @@
+// huffdec.cpp
+#include "huffdec.h"
+#include "cpu.h"
+#include <algorithm>
+#include <stdexcept>
+
+void HuffmanDecodeTable::build(const std::unordered_map<unsigned char, std::string> &codes) {
+    if (codes.empty()) throw std::runtime_error("Corrupt Huffman table (empty).");
+
+    nodes.assign(1, { 0, 0 });
+    maxLen = 0;
+    for (auto &p : codes) {
+        const std::string &code = p.second;
+        if (code.empty()) throw std::runtime_error("Corrupt Huffman table (empty code).");
+        size_t node = 0;
+        for (size_t k = 0; k < code.size(); ++k) {
+            if (code[k] != '0' && code[k] != '1')
+                throw std::runtime_error("Corrupt Huffman table (bad code).");
+            int bit = code[k] - '0';
+            int32_t child = nodes[node][bit];
+            if (child < 0) throw std::runtime_error("Corrupt Huffman table (not prefix-free).");
+            if (k + 1 == code.size()) {
+                if (child != 0) throw std::runtime_error("Corrupt Huffman table (not prefix-free).");
+                nodes[node][bit] = -(int32_t)p.first - 1;
+            } else {
+                if (child == 0) {
+                    child = (int32_t)nodes.size();
+                    nodes[node][bit] = child;
+                    nodes.push_back({ 0, 0 });
+                }
+                node = (size_t)child;
+            }
+        }
+        maxLen = std::max(maxLen, (unsigned)code.size());
+    }
+    guardBytes = maxLen / 8 + 2;
+
+    // resolve every LOOKUP_BITS-bit pattern by walking the tree
+    lookup.assign(size_t(1) << LOOKUP_BITS, Entry{ 0, 0 });
+    for (size_t pat = 0; pat < lookup.size(); ++pat) {
+        int32_t node = 0;
+        for (unsigned k = 0; k < LOOKUP_BITS; ++k) {
+            int bit = (int)((pat >> (LOOKUP_BITS - 1 - k)) & 1);
+            int32_t child = nodes[(size_t)node][bit];
+            if (child < 0) {
+                lookup[pat] = Entry{ (uint8_t)(-child - 1), (uint8_t)(k + 1) };
+                break;
+            }
+            if (child == 0) break; // invalid prefix: the slow path reports it
+            node = child;
+        }
+    }
+}
+
+#if defined(__GNUC__)
+#define KITTY_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define KITTY_ALWAYS_INLINE inline
+#endif
+
+static KITTY_ALWAYS_INLINE void refill(HuffmanBitSource &s) {
+    while (s.count <= 56 && s.p < s.end) {
+        s.bits |= (uint64_t)*s.p++ << (56 - s.count);
+        s.count += 8;
+    }
+}
+
+static KITTY_ALWAYS_INLINE size_t decode_body(const HuffmanDecodeTable &t, HuffmanBitSource &s,
+                                              bool final, uint8_t *out, size_t cap) {
+    const unsigned shift = 64 - HuffmanDecodeTable::LOOKUP_BITS;
+    const uint64_t need = t.maxLen;
+    size_t o = 0;
+    while (o < cap && s.remaining > 0) {
+        if (!final && (size_t)(s.end - s.p) < t.guardBytes &&
+            (uint64_t)(s.end - s.p) * 8 + s.count < std::min(need, s.remaining))
+            break; // a code may straddle into the next slice
+
+        refill(s);
+        const HuffmanDecodeTable::Entry e = t.lookup[(size_t)(s.bits >> shift)];
+        if (e.len != 0 && e.len <= s.count) {
+            if (e.len > s.remaining) throw std::runtime_error("Corrupt Huffman stream (code past end).");
+            out[o++] = e.sym;
+            s.bits <<= e.len;
+            s.count -= e.len;
+            s.remaining -= e.len;
+            continue;
+        }
+
+        // long code or short final bits: walk the tree one bit at a time
+        int32_t node = 0;
+        for (;;) {
+            if (s.count == 0) {
+                refill(s);
+                if (s.count == 0) throw std::runtime_error("Truncated Huffman stream.");
+            }
+            if (s.remaining == 0) throw std::runtime_error("Corrupt Huffman stream (code past end).");
+            int bit = (int)(s.bits >> 63);
+            s.bits <<= 1;
+            s.count--;
+            s.remaining--;
+            int32_t child = t.nodes[(size_t)node][bit];
+            if (child < 0) { out[o++] = (uint8_t)(-child - 1); break; }
+            if (child == 0) throw std::runtime_error("Corrupt Huffman stream (invalid code).");
+            node = child;
+        }
+    }
+    return o;
+}
+
+size_t huffman_decode_scalar(const HuffmanDecodeTable &table, HuffmanBitSource &src,
+                             bool final, uint8_t *out, size_t cap) {
+    return decode_body(table, src, final, out, cap);
+}
+
+// Same loop compiled with BMI2 so the variable shifts become shlx/shrx
+KITTY_TARGET("bmi2")
+size_t huffman_decode_bmi2(const HuffmanDecodeTable &table, HuffmanBitSource &src,
+                           bool final, uint8_t *out, size_t cap) {
+    return decode_body(table, src, final, out, cap);
+}
+
+size_t huffman_decode(const HuffmanDecodeTable &table, HuffmanBitSource &src,
+                      bool final, uint8_t *out, size_t cap) {
+    return kernels().huffman_decode(table, src, final, out, cap);
+}
@@ -0,0 +1,50 @@
+// huffdec.h
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Table-driven decoder for the prefix codes stored in .kitty headers.
+// Codes up to LOOKUP_BITS long resolve with one table lookup; longer codes
+// fall back to walking the code tree bit by bit.
+struct HuffmanDecodeTable {
+    static const unsigned LOOKUP_BITS = 11;
+
+    struct Entry {
+        uint8_t sym;
+        uint8_t len;  // 0 = code longer than LOOKUP_BITS (or invalid prefix): walk the tree
+    };
+
+    std::vector<Entry> lookup;                 // indexed by the next LOOKUP_BITS bits
+    std::vector<std::array<int32_t, 2>> nodes; // child > 0: node, < 0: leaf -(sym + 1), 0: none
+    unsigned maxLen = 0;                       // longest code in bits
+    size_t guardBytes = 0;                     // input bytes needed to decode any one code
+
+    // Builds the table from a symbol -> "0101" code map; throws if the codes
+    // are empty, contain other characters or are not prefix-free
+    void build(const std::unordered_map<unsigned char, std::string> &codes);
+};
+
+// MSB-first bit source over an in-memory slice of the encoded stream.
+// bits/count/remaining carry over when p/end are re-pointed at the next slice.
+struct HuffmanBitSource {
+    const uint8_t *p = nullptr;
+    const uint8_t *end = nullptr;
+    uint64_t bits = 0;      // next bits, left-aligned
+    unsigned count = 0;     // valid bits in `bits`
+    uint64_t remaining = 0; // encoded bits not yet decoded
+};
+
+// Decodes up to cap symbols into out. Stops early when the slice may not hold
+// a complete code, unless final is set (no more input will follow).
+// Throws on an invalid code or a stream that ends mid-code.
+size_t huffman_decode(const HuffmanDecodeTable &table, HuffmanBitSource &src,
+                      bool final, uint8_t *out, size_t cap);
+
+size_t huffman_decode_scalar(const HuffmanDecodeTable &table, HuffmanBitSource &src,
+                             bool final, uint8_t *out, size_t cap);
+size_t huffman_decode_bmi2(const HuffmanDecodeTable &table, HuffmanBitSource &src,
+                           bool final, uint8_t *out, size_t cap);
@@ -1,17 +1,13 @@
-// huffman.cpp  (KP04-compatible; streaming compress + full decompressFile implementation)
+// huffman.cpp  (Huffman tree builder + file front ends over the codec.h encoder/decoder)
 #include "huffman.h"
-#include "bitstream.h"
-#include "kitty.h"
-#include "lz77.h"
+#include "codec.h"
+#include "trace.h"
+#include "memtrack.h"
 #include <iostream>
-#include <bitset>
 #include <iomanip>
 #include <filesystem>
 #include <algorithm>
 #include <cstdint>
-#include <sstream>
-#include <array>
-#include <cmath>
 
 using namespace std;
 namespace fs = std::filesystem;
@@ -33,154 +29,10 @@ void freeTree(HuffmanNode* root) {
     delete root;
 }
 
-void storeRawFile(const string &inputPath, const string &outputPath) {
-    ifstream in(inputPath, ios::binary);
-    if (!in.is_open()) throw runtime_error("Cannot open input file.");
-
-    vector<uint8_t> buffer((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
-    in.close();
-
-    ofstream out(outputPath, ios::binary);
-    if (!out.is_open()) throw runtime_error("Cannot open output file for writing.");
-
-    out.write(KITTY_MAGIC_V3.c_str(), KITTY_MAGIC_V3.size());
-    bool isCompressed = false;
-    out.write(reinterpret_cast<const char*>(&isCompressed), sizeof(isCompressed));
-
-    string ext = filesystem::path(inputPath).extension().string();
-    uint64_t extLen = ext.size();
-    out.write(reinterpret_cast<const char*>(&extLen), sizeof(extLen));
-    if (extLen > 0) out.write(ext.c_str(), extLen);
-
-    uint64_t rawSize = buffer.size();
-    out.write(reinterpret_cast<const char*>(&rawSize), sizeof(rawSize));
-    if (rawSize > 0) out.write(reinterpret_cast<const char*>(buffer.data()), rawSize);
-
-    out.close();
-}
-
-void restoreRawFile(std::ifstream &inStream, const string &outputPath) {
-    uint64_t rawSize;
-    inStream.read(reinterpret_cast<char*>(&rawSize), sizeof(rawSize));
-    if (!inStream.good()) throw runtime_error("Failed to read raw size.");
-    vector<char> buffer;
-    buffer.resize(rawSize);
-    if (rawSize > 0) {
-        inStream.read(reinterpret_cast<char*>(buffer.data()), rawSize);
-        if ((uint64_t)inStream.gcount() != rawSize) {
-            throw runtime_error("Unexpected EOF while reading raw payload.");
-        }
-    }
-    ofstream out(outputPath, ios::binary);
-    if (!out.is_open()) throw runtime_error("Cannot open output file for writing.");
-    if (rawSize > 0) out.write(buffer.data(), rawSize);
-    out.close();
-}
-
-// compressFile: two-pass streamed approach (LZ77 streaming -> .lz77 tmp -> Huffman scan + encode)
-void compressFile(const string &inputPath, const string &outputPath) {
-    const size_t READ_CHUNK = 64 * 1024;
-    const size_t ENTROPY_SAMPLE = 1024 * 1024; // 1 MiB
-    const double ENTROPY_SKIP_THRESHOLD = 7.7; // bits/byte threshold to skip compression
-
-    if (!fs::exists(inputPath)) throw runtime_error("Input not found.");
-
-    ifstream in(inputPath, ios::binary);
-    if (!in.is_open()) throw runtime_error("Cannot open input file.");
-
-    // compute original size
-    uint64_t originalSize = (uint64_t)fs::file_size(inputPath);
-
-    // Smart-skip: quick entropy estimate on first up-to-ENTROPY_SAMPLE bytes 
-    {
-        size_t sampleLen = (size_t)min<uint64_t>(ENTROPY_SAMPLE, originalSize);
-        if (sampleLen > 0) {
-            vector<uint8_t> sample;
-            sample.resize(sampleLen);
-            in.read(reinterpret_cast<char*>(sample.data()), (std::streamsize)sampleLen);
-            streamsize got = in.gcount();
-            sample.resize((size_t)got);
-
-            if (got > 0) {
-                array<uint64_t, 256> freq = {};
-                freq.fill(0);
-                for (uint8_t b : sample) freq[b]++;
-
-                double entropy = 0.0;
-                const double N = (double)got;
-                for (int i = 0; i < 256; ++i) {
-                    if (freq[i] == 0) continue;
-                    double p = (double)freq[i] / N;
-                    entropy -= p * log2(p);
-                }
-
-                cout << fixed << setprecision(3);
-                if (entropy >= ENTROPY_SKIP_THRESHOLD) {
-                    cout << "\n⚡ Smart Skip: High-entropy file detected (H=" << entropy
-                         << " bits/byte) — skipping compression and storing raw.\n";
-                    in.close();
-                    storeRawFile(inputPath, outputPath);
-                    return;
-                } else {
-                    cout << "\nℹ️ Entropy check: H=" << entropy << " bits/byte — will attempt compression.\n";
-                }
-            }
-            // rewind stream for normal processing
-            in.clear();
-            in.seekg(0, ios::beg);
-        }
-    }
-
-    fs::path outPath(outputPath);
-    fs::path tmpLzPath = outPath.string() + ".lz77.tmp";
-    try { if (fs::exists(tmpLzPath)) fs::remove(tmpLzPath); } catch(...) {}
-
-    ofstream lzOut(tmpLzPath, ios::binary);
-    if (!lzOut.is_open()) { in.close(); throw runtime_error("Cannot open temporary LZ77 output file for writing."); }
-
-    LZ77StreamCompressor lzstream;
-    unordered_map<unsigned char, uint64_t> freq;
-
-    // feed chunks
-    vector<uint8_t> buf;
-    buf.reserve(READ_CHUNK);
-    while (true) {
-        buf.clear();
-        buf.resize(READ_CHUNK);
-        in.read(reinterpret_cast<char*>(buf.data()), (std::streamsize)READ_CHUNK);
-        streamsize got = in.gcount();
-        if (got <= 0) break;
-        buf.resize((size_t)got);
-        lzstream.feed(buf, false);
-        auto outBytes = lzstream.consumeOutput();
-        if (!outBytes.empty()) {
-            lzOut.write(reinterpret_cast<const char*>(outBytes.data()), outBytes.size());
-            for (uint8_t b : outBytes) freq[static_cast<unsigned char>(b)]++;
-        }
-        if (got < (streamsize)READ_CHUNK) break;
-    }
-
-    // finalize
-    lzstream.feed(vector<uint8_t>(), true);
-    auto finalBytes = lzstream.consumeOutput();
-    if (!finalBytes.empty()) {
-        lzOut.write(reinterpret_cast<const char*>(finalBytes.data()), finalBytes.size());
-        for (uint8_t b : finalBytes) freq[static_cast<unsigned char>(b)]++;
-    }
-
-    in.close();
-    lzOut.flush();
-    lzOut.close();
-
-    if (freq.empty()) {
-        try { fs::remove(tmpLzPath); } catch(...) {}
-        storeRawFile(inputPath, outputPath);
-        return;
-    }
-
-    // Build Huffman tree
+unordered_map<unsigned char, string> buildHuffmanCodes(const ByteHistogram &freq) {
     priority_queue<HuffmanNode*, vector<HuffmanNode*>, Compare> pq;
-    for (auto &p : freq) pq.push(new HuffmanNode(p.first, (int)p.second));
+    for (int c = 0; c < 256; ++c)
+        if (freq[c] > 0) pq.push(new HuffmanNode((unsigned char)c, (int)freq[c]));
     while (pq.size() > 1) {
         HuffmanNode *left = pq.top(); pq.pop();
         HuffmanNode *right = pq.top(); pq.pop();
@@ -191,284 +43,166 @@ void compressFile(const string &inputPath, const string &outputPath) {
     HuffmanNode *root = pq.top();
     unordered_map<unsigned char, string> huffmanCode;
     buildCodes(root, "", huffmanCode);
+    freeTree(root);
+    return huffmanCode;
+}
+
+unordered_map<unsigned char, string> canonicalCodes(const array<uint8_t, 256> &lengths) {
+    vector<pair<uint8_t, uint8_t>> order;  // (length, symbol)
+    for (int c = 0; c < 256; ++c)
+        if (lengths[c]) order.push_back({ lengths[c], (uint8_t)c });
+    sort(order.begin(), order.end());
+
+    unordered_map<unsigned char, string> codes;
+    uint64_t code = 0;
+    unsigned prevLen = order.empty() ? 0 : order[0].first;
+    for (auto &e : order) {
+        unsigned len = e.first;
+        if (len > MAX_CANONICAL_CODE_LEN) throw runtime_error("Corrupted code table (bad code lengths).");
+        code <<= (len - prevLen);
+        prevLen = len;
+        if ((code >> len) != 0) throw runtime_error("Corrupted code table (bad code lengths).");
+        string bits(len, '0');
+        for (unsigned b = 0; b < len; ++b)
+            if ((code >> (len - 1 - b)) & 1) bits[b] = '1';
+        codes[e.second] = bits;
+        ++code;
+    }
+    return codes;
+}
 
-    // Compute encoded length by scanning tmpLzPath
-    uint64_t encodedLen = 0;
-    {
-        ifstream scan(tmpLzPath, ios::binary);
-        if (!scan.is_open()) { freeTree(root); try { fs::remove(tmpLzPath); } catch(...) {} throw runtime_error("Failed to open temp LZ77 file for scanning."); }
-        const size_t SCAN_BUF = 64 * 1024;
-        vector<uint8_t> scanbuf;
-        scanbuf.reserve(SCAN_BUF);
-        while (true) {
-            scanbuf.clear();
-            scanbuf.resize(SCAN_BUF);
-            scan.read(reinterpret_cast<char*>(scanbuf.data()), (std::streamsize)SCAN_BUF);
-            streamsize got = scan.gcount();
-            if (got <= 0) break;
-            scanbuf.resize((size_t)got);
-            for (uint8_t b : scanbuf) {
-                auto it = huffmanCode.find(static_cast<unsigned char>(b));
-                if (it == huffmanCode.end()) { freeTree(root); scan.close(); try { fs::remove(tmpLzPath); } catch(...) {} throw runtime_error("Huffman code missing for byte (unexpected)."); }
-                encodedLen += it->second.size();
-            }
-            if (got < (streamsize)SCAN_BUF) break;
+// Feeds a whole stream to f in plan-sized reads
+static void forEachChunk(istream &in, const KittySink &f) {
+    const size_t chunk = mem_plan().ioChunk;
+    MemCharge charge(MemSubsystem::IO, chunk);
+    vector<uint8_t> buf(chunk);
+    while (true) {
+        streamsize got;
+        {
+            KITTY_TRACE("file read");
+            in.read(reinterpret_cast<char*>(buf.data()), (streamsize)chunk);
+            got = in.gcount();
         }
-        scan.close();
+        if (got <= 0) break;
+        f(buf.data(), (size_t)got);
+        if (got < (streamsize)chunk) break;
     }
+}
 
-    // Prepare encoded temp and write header + map
-    fs::path tmpEncPath = outPath.string() + ".enc.tmp";
-    try { if (fs::exists(tmpEncPath)) fs::remove(tmpEncPath); } catch(...) {}
+static KittySink fileSink(ostream &out) {
+    return [&out](const uint8_t *data, size_t n) {
+        out.write(reinterpret_cast<const char*>(data), (streamsize)n);
+        if (!out) throw runtime_error("Failed to write output file.");
+    };
+}
 
-    ofstream encOut(tmpEncPath, ios::binary);
-    if (!encOut.is_open()) { freeTree(root); try { fs::remove(tmpLzPath); } catch(...) {} throw runtime_error("Cannot open temporary encoded output file for writing."); }
+// Streams inputPath through a KittyEncoder into outputPath; report runs after finish()
+static void encodeFile(const string &inputPath, const string &outputPath, KittyEncoderOptions opts,
+                       const function<void(const KittyEncoder &)> &report) {
+    if (!fs::exists(inputPath)) throw runtime_error("Input not found.");
+    ifstream in(inputPath, ios::binary);
+    if (!in.is_open()) throw runtime_error("Cannot open input file.");
+    ofstream out(outputPath, ios::binary);
+    if (!out.is_open()) throw runtime_error("Cannot open output file for writing.");
 
-    encOut.write(KITTY_MAGIC_V3.c_str(), KITTY_MAGIC_V3.size());
-    bool isCompressed = true;
-    encOut.write(reinterpret_cast<const char*>(&isCompressed), sizeof(isCompressed));
+    opts.ext = fs::path(inputPath).extension().string();
+    opts.sizeHint = (uint64_t)fs::file_size(inputPath);
+    opts.sizeHintSet = true;
+    opts.peek = kitty_file_peek(inputPath);
+    KittyEncoder enc(fileSink(out), opts);
+    forEachChunk(in, [&enc](const uint8_t *data, size_t n) { enc.update(data, n); });
+    enc.finish();
+    out.close();
+    if (!out) throw runtime_error("Failed to write output file.");
+    report(enc);
+}
 
-    string ext = filesystem::path(inputPath).extension().string();
-    uint64_t extLen = ext.size();
-    encOut.write(reinterpret_cast<const char*>(&extLen), sizeof(extLen));
-    if (extLen > 0) encOut.write(ext.c_str(), extLen);
+void storeRawFile(const string &inputPath, const string &outputPath) {
+    KittyEncoderOptions opts;
+    opts.storeRaw = true;
+    encodeFile(inputPath, outputPath, opts, [](const KittyEncoder &) {});
+}
 
-    uint64_t mapSize = huffmanCode.size();
-    encOut.write(reinterpret_cast<const char*>(&mapSize), sizeof(mapSize));
-    for (auto &pair : huffmanCode) {
-        unsigned char c = pair.first;
-        const string &code = pair.second;
-        uint64_t len = code.size();
-        encOut.write(reinterpret_cast<const char*>(&c), sizeof(c));
-        encOut.write(reinterpret_cast<const char*>(&len), sizeof(len));
-        encOut.write(code.c_str(), len);
+// Streams rawSize + payload from in to out
+static void copyRawPayload(istream &in, ostream &out) {
+    uint64_t rawSize;
+    in.read(reinterpret_cast<char*>(&rawSize), sizeof(rawSize));
+    if (!in.good()) throw runtime_error("Failed to read raw size.");
+    MemCharge charge(MemSubsystem::IO, min<uint64_t>(rawSize, mem_plan().ioChunk));
+    vector<char> buffer((size_t)min<uint64_t>(rawSize, mem_plan().ioChunk));
+    uint64_t left = rawSize;
+    while (left > 0) {
+        size_t want = (size_t)min<uint64_t>(left, buffer.size());
+        in.read(buffer.data(), (streamsize)want);
+        if ((size_t)in.gcount() != want) throw runtime_error("Unexpected EOF while reading raw payload.");
+        out.write(buffer.data(), (streamsize)want);
+        left -= want;
     }
+}
 
-    encOut.write(reinterpret_cast<const char*>(&encodedLen), sizeof(encodedLen));
-    encOut.flush();
+void restoreRawFile(std::ifstream &inStream, const string &outputPath) {
+    ofstream out(outputPath, ios::binary);
+    if (!out.is_open()) throw runtime_error("Cannot open output file for writing.");
+    copyRawPayload(inStream, out);
+    out.close();
+}
 
-    // Read tmpLzPath and write codes
-    {
-        ifstream readLz(tmpLzPath, ios::binary);
-        if (!readLz.is_open()) { freeTree(root); encOut.close(); try { fs::remove(tmpLzPath); } catch(...) {} try { fs::remove(tmpEncPath); } catch(...) {} throw runtime_error("Failed to open temp LZ77 file for second pass."); }
-        BitWriter writer(encOut);
-        const size_t PASS_BUF = 64 * 1024;
-        vector<uint8_t> passbuf;
-        passbuf.reserve(PASS_BUF);
-        while (true) {
-            passbuf.clear();
-            passbuf.resize(PASS_BUF);
-            readLz.read(reinterpret_cast<char*>(passbuf.data()), (std::streamsize)PASS_BUF);
-            streamsize got = readLz.gcount();
-            if (got <= 0) break;
-            passbuf.resize((size_t)got);
-            for (uint8_t b : passbuf) {
-                const string &code = huffmanCode[static_cast<unsigned char>(b)];
-                writer.writeBits(code);
-            }
-            if (got < (streamsize)PASS_BUF) break;
+// compressFile: one streamed pass (probe -> LZ77 -> tokens held in memory or
+// <output>.lz77.tmp -> Huffman), written straight to outputPath
+void compressFile(const string &inputPath, const string &outputPath, int level, KittyStats *stats) {
+    KittyEncoderOptions opts;
+    opts.level = level;
+    opts.spillPath = outputPath + ".lz77.tmp";
+    opts.stats = stats;
+    encodeFile(inputPath, outputPath, opts, [](const KittyEncoder &enc) {
+        cout << fixed << setprecision(3);
+        if (enc.skippedByProbe()) {
+            cout << "\n⚡ Smart Skip: High-entropy file detected (H=" << enc.entropy()
+                 << " bits/byte) — skipping compression and storing raw.\n";
+            return;
         }
-        writer.flush();
-        readLz.close();
-    }
-
-    encOut.flush();
-    encOut.close();
-    freeTree(root);
-
-    // Compare sizes and keep encoded or fallback to raw
-    size_t encodedSize = 0;
-    try { encodedSize = (size_t)fs::file_size(tmpEncPath); } catch(...) { encodedSize = SIZE_MAX; }
-
-    if (encodedSize < originalSize) {
-        try { fs::rename(tmpEncPath, outputPath); } catch(...) {
-            ifstream src(tmpEncPath, ios::binary);
-            ofstream dst(outputPath, ios::binary);
-            dst << src.rdbuf();
-            src.close(); dst.close();
-            try { fs::remove(tmpEncPath); } catch(...) {}
+        if (enc.probed())
+            cout << "\nℹ️ Entropy check: H=" << enc.entropy() << " bits/byte — will attempt compression.\n";
+        if (!enc.storedRaw()) {
+            cout << "\n🐾 Smart Mode: Compression effective ("
+                 << fixed << setprecision(2)
+                 << 100.0 * (1.0 - (double)enc.bytesOut() / enc.bytesIn())
+                 << "% saved)\n";
+            cout << "Final size: " << enc.bytesOut() << " bytes (original " << enc.bytesIn() << ")\n";
+        } else if (enc.bytesIn() > 0) {
+            cout << "\n⚡ Smart Mode: Compression skipped (file too compact)\n";
         }
-        cout << "\n🐾 Smart Mode: Compression effective ("
-             << fixed << setprecision(2)
-             << 100.0 * (1.0 - (double)encodedSize / originalSize)
-             << "% saved)\n";
-        cout << "Final size: " << encodedSize << " bytes (original " << originalSize << ")\n";
-        try { fs::remove(tmpLzPath); } catch(...) {}
-    } else {
-        try { fs::remove(tmpEncPath); } catch(...) {}
-        try { fs::remove(tmpLzPath); } catch(...) {}
-        cout << "\n⚡ Smart Mode: Compression skipped (file too compact)\n";
-        storeRawFile(inputPath, outputPath);
-    }
+    });
 }
 
 // decompressFile: full implementation (KP01, KP02, KP03)
-void decompressFile(const string &inputPath, const string &outputPath) {
+void decompressFile(const string &inputPath, const string &outputPath, KittyStats *stats) {
     ifstream in(inputPath, ios::binary);
     if (!in.is_open()) throw runtime_error("Cannot open input file.");
-
-    string magic(4, '\0');
-    in.read(&magic[0], 4);
-    if (!in) throw runtime_error("Failed to read file signature.");
-
-    // KP01 (old single-layer Huffman)
-    if (magic == KITTY_MAGIC_V1) {
-        uint64_t mapSize;
-        in.read(reinterpret_cast<char*>(&mapSize), sizeof(mapSize));
-        unordered_map<unsigned char, string> huffmanCode;
-        for (uint64_t i = 0; i < mapSize; ++i) {
-            unsigned char c; uint64_t len;
-            in.read(reinterpret_cast<char*>(&c), sizeof(c));
-            in.read(reinterpret_cast<char*>(&len), sizeof(len));
-            string code(len, '\0');
-            in.read(&code[0], len);
-            huffmanCode[c] = code;
-        }
-        uint64_t encodedLen;
-        in.read(reinterpret_cast<char*>(&encodedLen), sizeof(encodedLen));
-        BitReader reader(in);
-        bool bit;
-        string bitstream; bitstream.reserve(encodedLen);
-        while (reader.readBit(bit)) bitstream += (bit ? '1' : '0');
-        in.close();
-        if (bitstream.size() > encodedLen) bitstream.resize(encodedLen);
-        unordered_map<string, unsigned char> reverseCode;
-        for (auto &p : huffmanCode) reverseCode[p.second] = p.first;
-        string current;
-        vector<char> decoded;
-        for (char b : bitstream) {
-            current += b;
-            auto it = reverseCode.find(current);
-            if (it != reverseCode.end()) {
-                decoded.push_back((char)it->second);
-                current.clear();
-            }
-        }
-        ofstream out(outputPath, ios::binary);
-        if (!out.is_open()) throw runtime_error("Cannot open output file for writing.");
-        if (!decoded.empty()) out.write(decoded.data(), decoded.size());
-        out.close();
-        cout << "Decompressed (KP01) successfully → " << outputPath << endl;
-        return;
-    }
-
-    // KP02 (store or Huffman-on-bytes)
-    if (magic == KITTY_MAGIC_V2) {
-        bool isCompressed = false;
-        in.read(reinterpret_cast<char*>(&isCompressed), sizeof(isCompressed));
-        uint64_t extLen = 0; in.read(reinterpret_cast<char*>(&extLen), sizeof(extLen));
-        if (extLen > 0) {
-            string ext; ext.resize(extLen);
-            in.read(&ext[0], extLen);
-        }
-        if (!isCompressed) {
-            restoreRawFile(in, outputPath);
-            in.close();
-            cout << "Restored raw file (KP02) → " << outputPath << endl;
-            return;
-        }
-        uint64_t mapSize;
-        in.read(reinterpret_cast<char*>(&mapSize), sizeof(mapSize));
-        unordered_map<unsigned char, string> huffmanCode;
-        for (uint64_t i = 0; i < mapSize; ++i) {
-            unsigned char c; uint64_t len;
-            in.read(reinterpret_cast<char*>(&c), sizeof(c));
-            in.read(reinterpret_cast<char*>(&len), sizeof(len));
-            string code(len, '\0');
-            in.read(&code[0], len);
-            huffmanCode[c] = code;
-        }
-        uint64_t encodedLen; in.read(reinterpret_cast<char*>(&encodedLen), sizeof(encodedLen));
-        BitReader reader(in);
-        bool bit; string bitstream; bitstream.reserve(encodedLen);
-        while (reader.readBit(bit)) bitstream += (bit ? '1' : '0');
-        in.close();
-        if (bitstream.size() > encodedLen) bitstream.resize(encodedLen);
-        unordered_map<string, unsigned char> reverseCode;
-        for (auto &p : huffmanCode) reverseCode[p.second] = p.first;
-        string current; vector<char> decoded;
-        for (char b : bitstream) {
-            current += b;
-            auto it = reverseCode.find(current);
-            if (it != reverseCode.end()) {
-                decoded.push_back((char)it->second);
-                current.clear();
-            }
-        }
-        ofstream out(outputPath, ios::binary);
-        if (!out.is_open()) throw runtime_error("Cannot open output file for writing.");
-        if (!decoded.empty()) out.write(decoded.data(), decoded.size());
-        out.close();
-        cout << "Decompressed (KP02) successfully → " << outputPath << endl;
-        return;
-    }
-
-    // KP03 (LZ77 + Huffman)
-    if (magic != KITTY_MAGIC_V3) {
-        throw runtime_error("Unknown or corrupted .kitty file (bad signature).");
-    }
-
-    bool isCompressed = false;
-    in.read(reinterpret_cast<char*>(&isCompressed), sizeof(isCompressed));
-    uint64_t extLen = 0; in.read(reinterpret_cast<char*>(&extLen), sizeof(extLen));
-    string ext;
-    if (extLen > 0) {
-        ext.resize(extLen);
-        in.read(&ext[0], extLen);
-    }
-
-    if (!isCompressed) {
-        restoreRawFile(in, outputPath);
-        in.close();
-        cout << "Restored raw file (KP03) → " << outputPath << endl;
-        return;
-    }
-
-    // read Huffman map
-    uint64_t mapSize = 0;
-    in.read(reinterpret_cast<char*>(&mapSize), sizeof(mapSize));
-    unordered_map<unsigned char, string> huffmanCode;
-    for (uint64_t i = 0; i < mapSize; ++i) {
-        unsigned char c; uint64_t len;
-        in.read(reinterpret_cast<char*>(&c), sizeof(c));
-        in.read(reinterpret_cast<char*>(&len), sizeof(len));
-        string code(len, '\0');
-        in.read(&code[0], len);
-        huffmanCode[c] = code;
-    }
-
-    uint64_t encodedLen = 0;
-    in.read(reinterpret_cast<char*>(&encodedLen), sizeof(encodedLen));
-
-    // read Huffman bitstream into string of bits
-    BitReader reader(in);
-    bool bit; string bitstream; bitstream.reserve(encodedLen);
-    while (reader.readBit(bit)) bitstream += (bit ? '1' : '0');
-    in.close();
-    if (bitstream.size() > encodedLen) bitstream.resize(encodedLen);
-
-    // Decode to get serialized LZ77 bytes
-    unordered_map<string, unsigned char> reverseCode;
-    for (auto &p : huffmanCode) reverseCode[p.second] = p.first;
-    string current;
-    vector<uint8_t> tokenBytes;
-    for (char b : bitstream) {
-        current += b;
-        auto it = reverseCode.find(current);
-        if (it != reverseCode.end()) {
-            tokenBytes.push_back(it->second);
-            current.clear();
-        }
-    }
-
-    // Deserialize tokens and LZ77-decompress
-    auto tokens_out = lz77_deserialize(tokenBytes);
-    auto original = lz77_decompress(tokens_out);
-
     ofstream out(outputPath, ios::binary);
     if (!out.is_open()) throw runtime_error("Cannot open output file for writing.");
-    if (!original.empty()) out.write(reinterpret_cast<const char*>(original.data()), original.size());
+
+    KittyDecoder dec(fileSink(out), stats);
+    forEachChunk(in, [&dec](const uint8_t *data, size_t n) { dec.update(data, n); });
+    dec.finish();
+    in.close();
     out.close();
+    cout << dec.formatLabel() << " → " << outputPath << endl;
+}
+
+void compressStream(istream &in, ostream &out, int level, KittyStats *stats) {
+    KittyFrameEncoder enc(fileSink(out), level, stats);
+    forEachChunk(in, [&enc](const uint8_t *data, size_t n) { enc.update(data, n); });
+    enc.finish();
+    out.flush();
+    if (!out) throw runtime_error("Failed to write output.");
+}
 
-    cout << "Decompressed (KP03) successfully → " << outputPath << endl;
+string decompressStream(istream &in, ostream &out, KittyStats *stats) {
+    KittyDecoder dec(fileSink(out), stats);
+    forEachChunk(in, [&dec](const uint8_t *data, size_t n) { dec.update(data, n); });
+    dec.finish();
+    out.flush();
+    if (!out) throw runtime_error("Failed to write output.");
+    return dec.formatLabel();
 }
@@ -1,5 +1,6 @@
 // huffman.h
 #pragma once
+#include <array>
 #include <string>
 #include <unordered_map>
 #include <queue>
@@ -8,6 +9,9 @@
 #include <bitset>
 #include <memory>
 #include <cstdint>
+#include "lz77.h"
+#include "histogram.h"
+#include "stats.h"
 
 // Use unsigned char for full 0-255 byte support
 struct HuffmanNode {
@@ -26,10 +30,34 @@ struct Compare {
     }
 };
 
+// Byte -> '0'/'1' code string for every symbol with a non-zero count
+std::unordered_map<unsigned char, std::string> buildHuffmanCodes(const ByteHistogram &freq);
+
+// Canonical prefix codes are built in a uint64_t
+const unsigned MAX_CANONICAL_CODE_LEN = 56;
+
+// Canonical prefix codes from code lengths (0 = symbol unused): symbols
+// ordered by (length, value), each code one more than the last, shifted left
+// as lengths grow. Throws if the lengths cannot form a prefix code.
+std::unordered_map<unsigned char, std::string> canonicalCodes(const std::array<uint8_t, 256> &lengths);
+
 // Main API (KP03 aware)
-void compressFile(const std::string &inputPath, const std::string &outputPath); // writes KP03 with LZ77+Huffman (or KP02 raw/Huffman)
-void decompressFile(const std::string &inputPath, const std::string &outputPath); // handles KP01, KP02, KP03
+// stats (optional) accumulates counters and stage times across calls
+void compressFile(const std::string &inputPath, const std::string &outputPath,
+                  int level = LZ77_DEFAULT_LEVEL,
+                  KittyStats *stats = nullptr); // writes KP03 with LZ77+Huffman (or KP02 raw/Huffman)
+void decompressFile(const std::string &inputPath, const std::string &outputPath,
+                    KittyStats *stats = nullptr); // handles KP01, KP02, KP03
+
+// Pipe mode: any input stream (stdin included, no size or seeking needed) to
+// a KP05 framed stream, and any single .kitty stream (KP01-KP03, KP05) back;
+// decompressStream returns the format label
+void compressStream(std::istream &in, std::ostream &out, int level = LZ77_DEFAULT_LEVEL,
+                    KittyStats *stats = nullptr);
+std::string decompressStream(std::istream &in, std::ostream &out, KittyStats *stats = nullptr);
 
 // Helpers for storing raw files inside .kitty (KP02/KP03 with isCompressed = false)
 void storeRawFile(const std::string &inputPath, const std::string &outputPath);
 void restoreRawFile(std::ifstream &inStream, const std::string &outputPath);
+
+// Buffer and streaming (path-free) variants live in codec.h
@@ -6,3 +6,8 @@ const std::string KITTY_MAGIC_V1 = "KP01";
 const std::string KITTY_MAGIC_V2 = "KP02";
 const std::string KITTY_MAGIC_V3 = "KP03"; 
 const std::string KITTY_MAGIC_V4 = "KP04";
+const std::string KITTY_MAGIC_V5 = "KP05";  // framed stream (pipe mode)
+const std::string KITTY_MAGIC_V6 = "KP06";  // KP03-style stream compressed against a dictionary
+const std::string KITTY_MAGIC_V7 = "KP07";  // delta patch against a reference file (delta.h)
+const std::string KITTY_MAGIC_V8 = "KP08";  // filter header + KP03 stream of the filtered bytes (filter.h)
+const std::string KITTY_DICT_MAGIC = "KPD1";  // .kd dictionary file
@@ -1,8 +1,12 @@
 // lz77.cpp
 #include "lz77.h"
+#include "lzkernels.h"
+#include "cpu.h"
+#include "tables.h"
 #include <algorithm>
 #include <cstring>
 #include <iostream>
+#include <stdexcept>
 
 // (serialize/deserialize/decompress)
 
@@ -29,11 +33,11 @@ std::vector<LZ77Token> lz77_deserialize(const std::vector<uint8_t> &bytes) {
     while (i < n) {
         uint8_t tag = bytes[i++];
         if (tag == 0x00) {
-            if (i >= n) break; // malformed, but break
+            if (i >= n) throw std::runtime_error("Truncated LZ77 stream.");
             LZ77Token t; t.offset = 0; t.length = 0; t.lit = bytes[i++];
             tokens.push_back(t);
         } else if (tag == 0x01) {
-            if (i + 2 >= n) break;
+            if (i + 2 >= n) throw std::runtime_error("Truncated LZ77 stream.");
             uint16_t lo = bytes[i++];
             uint16_t hi = bytes[i++];
             uint16_t offset = (hi << 8) | lo;
@@ -41,32 +45,58 @@ std::vector<LZ77Token> lz77_deserialize(const std::vector<uint8_t> &bytes) {
             LZ77Token t; t.offset = offset; t.length = length; t.lit = 0;
             tokens.push_back(t);
         } else {
-            // unknown tag — break for safety
-            break;
+            throw std::runtime_error("Corrupt LZ77 stream (bad token tag).");
         }
     }
     return tokens;
 }
 
-std::vector<uint8_t> lz77_decompress(const std::vector<LZ77Token> &tokens) {
-    std::vector<uint8_t> out;
-    out.reserve(tokens.size() * 2);
+size_t lz77_decoded_size(const std::vector<LZ77Token> &tokens) {
+    size_t n = 0;
+    for (const auto &t : tokens)
+        n += (t.offset == 0 && t.length == 0) ? 1 : t.length;
+    return n;
+}
+
+size_t lz77_decompress_into(const std::vector<LZ77Token> &tokens, uint8_t *out, size_t capacity) {
+    const KittyKernels &K = kernels();
+    uint8_t *op = out;
+    uint8_t *const oend = out + capacity;
     for (const auto &t : tokens) {
         if (t.offset == 0 && t.length == 0) {
-            out.push_back(t.lit);
+            if (op == oend) throw std::runtime_error("LZ77 output exceeds buffer.");
+            *op++ = t.lit;
+            continue;
+        }
+        size_t offset = t.offset, len = t.length;
+        if (offset == 0 || offset > (size_t)(op - out))
+            throw std::runtime_error("LZ77 match offset out of range.");
+        if (len > (size_t)(oend - op))
+            throw std::runtime_error("LZ77 output exceeds buffer.");
+
+        if ((size_t)(oend - op) >= len + WILDCOPY_MARGIN) {
+            if (offset >= K.wild_copy_step) K.wild_copy(op, op - offset, len);
+            else if (offset >= 16) wild_copy16(op, op - offset, len);
+            else match_copy_exact(op, offset, len);
         } else {
-            size_t start = out.size() - t.offset;
-            for (size_t k = 0; k < t.length; ++k) {
-                out.push_back(out[start + k]);
-            }
+            match_copy_exact(op, offset, len);
         }
+        op += len;
     }
+    return (size_t)(op - out);
+}
+
+std::vector<uint8_t> lz77_decompress(const std::vector<LZ77Token> &tokens) {
+    size_t size = lz77_decoded_size(tokens);
+    std::vector<uint8_t> out(size + WILDCOPY_MARGIN);
+    out.resize(lz77_decompress_into(tokens, out.data(), out.size()));
     return out;
 }
 
 // simple non-stream LZ77 compressor (kept for compatibility) 
 // naive implementation kept for API completeness (may be slower)
 std::vector<LZ77Token> lz77_compress(const std::vector<uint8_t> &data, size_t windowSize, size_t maxMatch) {
+    const KittyKernels &K = kernels();
     std::vector<LZ77Token> tokens;
     size_t n = data.size();
     size_t i = 0;
@@ -76,9 +106,9 @@ std::vector<LZ77Token> lz77_compress(const std::vector<uint8_t> &data, size_t wi
         size_t bestLen = 0;
         size_t bestOffset = 0;
         size_t start = (i > windowSize) ? (i - windowSize) : 0;
+        size_t limit = std::min(maxMatch, n - i);
         for (size_t j = start; j < i; ++j) {
-            size_t k = 0;
-            while (k < maxMatch && i + k < n && data[j + k] == data[i + k]) ++k;
+            size_t k = K.match_length(&data[j], &data[i], limit);
             if (k > bestLen) {
                 bestLen = k;
                 bestOffset = i - j;
@@ -103,123 +133,300 @@ std::vector<LZ77Token> lz77_compress(const std::vector<uint8_t> &data, size_t wi
     return tokens;
 }
 
-// Streaming compressor class implementation 
+// Streaming compressor class implementation
+
+// Compile-time matcher configuration. Each level gets its own instantiation of
+// parseChunk so hashing, the chain walk bound and the lazy step constant-fold.
+template <unsigned HashBits, unsigned MinMatch, unsigned SearchDepth, bool Lazy>
+struct LZ77MatcherParams {
+    static constexpr unsigned hashBits = HashBits;
+    static constexpr unsigned minMatch = MinMatch;     // also the number of hashed bytes (3 or 4)
+    static constexpr unsigned searchDepth = SearchDepth;
+    static constexpr bool lazy = Lazy;
+
+    static_assert(MinMatch == 3 || MinMatch == 4, "hash covers 3 or 4 bytes");
+
+    static inline uint32_t hash(const uint8_t* p) {
+        uint32_t v;
+        if (MinMatch == 4) v = uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+        else               v = (uint32_t(p[0]) << 8) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 24);
+        return (v * 2654435761u) >> (32 - HashBits);
+    }
+};
+
+struct LZ77LevelConfig {
+    unsigned hashBits;
+    unsigned minMatch;
+    void (LZ77StreamCompressor::*parse)(const std::vector<uint8_t>&);
+    void (LZ77StreamCompressor::*prime)(const uint8_t*, size_t);
+    void (LZ77StreamCompressor::*rehash)();
+};
+
+#define KITTY_LEVEL(bits, minMatch, depth, lazy) \
+    { bits, minMatch, \
+      &LZ77StreamCompressor::parseChunk<LZ77MatcherParams<bits, minMatch, depth, lazy>>, \
+      &LZ77StreamCompressor::primeChunk<LZ77MatcherParams<bits, minMatch, depth, lazy>>, \
+      &LZ77StreamCompressor::rehashChunk<LZ77MatcherParams<bits, minMatch, depth, lazy>> }
+
+static int clampLevel(int level) {
+    return std::min(std::max(level, LZ77_MIN_LEVEL), LZ77_MAX_LEVEL);
+}
+
+const LZ77LevelConfig& LZ77StreamCompressor::levelConfig(int level) {
+    static const LZ77LevelConfig LEVELS[] = {
+        KITTY_LEVEL(14, 4,    4, false),  // 1
+        KITTY_LEVEL(15, 4,    8, false),  // 2
+        KITTY_LEVEL(15, 3,   16, false),  // 3
+        KITTY_LEVEL(16, 3,   24, false),  // 4
+        KITTY_LEVEL(16, 3,   32, false),  // 5 (previous fixed behaviour: 32 tries, greedy)
+        KITTY_LEVEL(16, 3,   64, true),   // 6
+        KITTY_LEVEL(16, 3,  128, true),   // 7
+        KITTY_LEVEL(16, 3,  256, true),   // 8
+        KITTY_LEVEL(16, 3, 1024, true),   // 9
+    };
+    return LEVELS[clampLevel(level) - 1];
+}
+
+LZ77StreamCompressor::LZ77StreamCompressor(size_t w, size_t m, int lvl)
+    : windowSize(w), maxMatch(m), level(clampLevel(lvl)), inserted(0), absolutePos(0) {
+    const LZ77LevelConfig& cfg = levelConfig(level);
+    parse = cfg.parse;
+    primeWindow = cfg.prime;
+    rehashWindow = cfg.rehash;
+    head.assign(size_t(1) << cfg.hashBits, 0);
+
+    // ring larger than the window so a live chain link is never overwritten
+    size_t ring = 1;
+    while (ring <= windowSize) ring <<= 1;
+    prev.assign(ring, 0);
+    prevMask = ring - 1;
+    memory.set((head.capacity() + prev.capacity()) * sizeof(size_t));
+}
+
+#undef KITTY_LEVEL
+
+LZ77StreamCompressor::LZ77StreamCompressor(const LZ77StreamCompressor& o)
+    : windowSize(o.windowSize), maxMatch(o.maxMatch), level(o.level), history(o.history),
+      head(o.head), prev(o.prev), prevMask(o.prevMask), inserted(o.inserted),
+      pendingTokens(o.pendingTokens), absolutePos(o.absolutePos), stats(o.stats),
+      parse(o.parse), primeWindow(o.primeWindow), rehashWindow(o.rehashWindow) {
+    memory.set((head.capacity() + prev.capacity()) * sizeof(size_t) + history.capacity()
+               + pendingTokens.capacity() * sizeof(LZ77Token));
+}
+
+void LZ77StreamCompressor::prime(const uint8_t* data, size_t n) {
+    if (absolutePos != 0) throw std::runtime_error("LZ77StreamCompressor::prime after feed().");
+    if (n > windowSize) {
+        data += n - windowSize;
+        n = windowSize;
+    }
+    (this->*primeWindow)(data, n);
+}
+
+// Hashes every dictionary position whose minMatch bytes are all known; the
+// rest are hashed by the first parseChunk once the input follows them
+template <class P>
+void LZ77StreamCompressor::primeChunk(const uint8_t* data, size_t n) {
+    history.assign(data, data + n);
+    for (size_t pos = 0; pos + P::minMatch <= n; ++pos) {
+        uint32_t h = P::hash(history.data() + pos);
+        prev[pos & prevMask] = head[h];
+        head[h] = pos + 1;
+    }
+    inserted = n >= P::minMatch ? n - P::minMatch + 1 : 0;
+    absolutePos = n;
+    memory.set((head.capacity() + prev.capacity()) * sizeof(size_t) + history.capacity());
+}
 
-inline uint32_t LZ77StreamCompressor::make_key(const uint8_t* p) {
-    // pack 3 bytes into 24-bit key; safeguard if not enough bytes (caller ensures KEY_LEN usage)
-    return (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | uint32_t(p[2]);
+// Rebuilds the hash chains over the window after setLevel changed the hash
+template <class P>
+void LZ77StreamCompressor::rehashChunk() {
+    const size_t n = history.size();
+    const size_t histStart = absolutePos - n;
+    for (size_t rel = 0; rel + P::minMatch <= n; ++rel) {
+        uint32_t h = P::hash(history.data() + rel);
+        size_t pos = histStart + rel;
+        prev[pos & prevMask] = head[h];
+        head[h] = pos + 1;
+    }
+    inserted = histStart + (n >= P::minMatch ? n - P::minMatch + 1 : 0);
+    memory.set((head.capacity() + prev.capacity()) * sizeof(size_t) + history.capacity()
+               + pendingTokens.capacity() * sizeof(LZ77Token));
 }
 
-LZ77StreamCompressor::LZ77StreamCompressor(size_t w, size_t m)
-    : windowSize(w), maxMatch(m), absolutePos(0) {
-    dict.reserve(65536);
+void LZ77StreamCompressor::setLevel(int lvl) {
+    lvl = clampLevel(lvl);
+    if (lvl == level) return;
+    const LZ77LevelConfig& from = levelConfig(level);
+    const LZ77LevelConfig& to = levelConfig(lvl);
+    level = lvl;
+    parse = to.parse;
+    primeWindow = to.prime;
+    rehashWindow = to.rehash;
+    if (from.hashBits == to.hashBits && from.minMatch == to.minMatch) return;
+    head.assign(size_t(1) << to.hashBits, 0);
+    std::fill(prev.begin(), prev.end(), 0);
+    (this->*rehashWindow)();
 }
 
 void LZ77StreamCompressor::feed(const std::vector<uint8_t>& chunk, bool isLast) {
     processChunk(chunk, isLast);
 }
 
+// Positions of these bytes are hashed by the next parseChunk as far as they
+// are still inside the window
+void LZ77StreamCompressor::feedLiterals(const std::vector<uint8_t>& chunk) {
+    const size_t n = chunk.size();
+    pendingTokens.reserve(pendingTokens.size() + n);
+    for (uint8_t b : chunk) pendingTokens.push_back(LZ77Token{ 0, 0, b });
+    KITTY_STAT(stats.literals += n);
+    if (n >= windowSize) {
+        history.assign(chunk.end() - windowSize, chunk.end());
+    } else {
+        history.insert(history.end(), chunk.begin(), chunk.end());
+        if (history.size() > windowSize)
+            history.erase(history.begin(), history.end() - windowSize);
+    }
+    absolutePos += n;
+    memory.set((head.capacity() + prev.capacity()) * sizeof(size_t) + history.capacity()
+               + pendingTokens.capacity() * sizeof(LZ77Token));
+}
+
 void LZ77StreamCompressor::processChunk(const std::vector<uint8_t>& chunk, bool /*isLast*/) {
+    if (chunk.empty()) return;
+    (this->*parse)(chunk);
+}
+
+template <class P>
+void LZ77StreamCompressor::parseChunk(const std::vector<uint8_t>& chunk) {
     const size_t n = chunk.size();
-    if (n == 0) return;
 
-    const size_t MIN_MATCH = 3;
-    const size_t KEY_LEN = 3;
-    const size_t MAX_POS_PER_KEY = 64;
+    // history holds the window tail followed by this chunk, so candidates in
+    // either part (and matches overlapping the current position) are contiguous
+    const size_t base = history.size();
+    history.insert(history.end(), chunk.begin(), chunk.end());
+    const uint8_t* hist = history.data();
+    const size_t histEnd = history.size();
+    const size_t histStart = absolutePos - base; // absolute position of history[0]
+    const KittyKernels& K = kernels();
+
+    // rel: index into hist; needs P::minMatch bytes available
+    auto insert = [&](size_t rel) {
+        uint32_t h = P::hash(hist + rel);
+        size_t pos = histStart + rel;
+        prev[pos & prevMask] = head[h];
+        head[h] = pos + 1;
+    };
+
+    // counters stay in locals inside the loop (no stores through this)
+    uint64_t positions = 0, probes = 0, depthHits = 0, literals = 0, matches = 0, matchBytes = 0;
+
+    auto findMatch = [&](size_t rel, size_t limit, size_t& bestOffset) -> size_t {
+        const uint8_t* cur = hist + rel;
+        const size_t curPos = histStart + rel;
+        size_t cand = head[P::hash(cur)];
+        size_t bestLen = 0;
+        unsigned depth = 0;
+        for (; depth < P::searchDepth && cand != 0; ++depth) {
+            size_t j = cand - 1;
+            size_t offset = curPos - j;
+            if (offset > windowSize || j < histStart) break; // chains run from near to far
+            const uint8_t* c = hist + (j - histStart);
+            // cheap reject: a longer match must also agree at bestLen
+            if (c[bestLen] == cur[bestLen]) {
+                size_t k = K.match_length(c, cur, limit);
+                if (k > bestLen) {
+                    bestLen = k;
+                    bestOffset = offset;
+                    if (k == limit) break;
+                }
+            }
+            size_t next = prev[j & prevMask];
+            if (next >= cand) break; // ring slot reused by a newer position
+            cand = next;
+        }
+        KITTY_STAT(positions++);
+        KITTY_STAT(probes += depth);
+        KITTY_STAT(depthHits += (depth == P::searchDepth && cand != 0));
+        return bestLen;
+    };
+
+    // hash the previous chunk's tail now that the bytes after it are known
+    for (size_t pos = std::max(inserted, histStart); pos < absolutePos; ++pos)
+        if (pos - histStart + P::minMatch <= histEnd) insert(pos - histStart);
 
     size_t i = 0;
+    bool haveNext = false;
+    size_t nextLen = 0, nextOffset = 0;
     while (i < n) {
+        const size_t rel = base + i;
+        const size_t limit = std::min(maxMatch, n - i);
+        const bool hashable = i + P::minMatch <= n;
+
         size_t bestLen = 0;
         size_t bestOffset = 0;
+        if (haveNext) {
+            bestLen = nextLen;
+            bestOffset = nextOffset;
+            haveNext = false;
+        } else if (hashable) {
+            bestLen = findMatch(rel, limit, bestOffset);
+        }
+        if (hashable) insert(rel);
 
-        if (i + KEY_LEN <= n && window.size() + (n - i) >= KEY_LEN) {
-            // Build a temporary accessible buffer view that combines window tail and remaining chunk
-            // For candidate matching we use positions stored relative to absolutePos.
-            uint32_t key = make_key(&chunk[i]);
-            auto it = dict.find(key);
-            if (it != dict.end()) {
-                auto& dq = it->second;
-                size_t tries = 0;
-                const size_t MAX_TRIES = 32;
-                for (auto rit = dq.rbegin(); rit != dq.rend() && tries < MAX_TRIES; ++rit, ++tries) {
-                    size_t j = *rit; // absolute position of candidate
-                    size_t offset = absolutePos + i - j;
-                    if (offset == 0 || offset > windowSize) continue;
-
-                    // Compare bytes: we need to read from the window / chunk combined
-                    size_t k = 0;
-                    size_t limit = std::min(maxMatch, n - i);
-                    while (k < limit) {
-                        size_t posCandidate = j + k;
-                        size_t posCurrent = absolutePos + i + k;
-                        uint8_t candidateByte;
-                        if (posCandidate < absolutePos) { // in older window (should not happen because we evict old positions)
-                            break;
-                        } else if (posCandidate < absolutePos + window.size()) {
-                            candidateByte = window[posCandidate - absolutePos];
-                        } else {
-                            // candidate lies in already processed chunk area — safe to break early
-                            break;
-                        }
-
-                        // current byte from chunk
-                        uint8_t currentByte = chunk[i + k];
-                        if (candidateByte != currentByte) break;
-                        ++k;
-                    }
-
-                    if (k > bestLen) {
-                        bestLen = k;
-                        bestOffset = offset;
-                        if (bestLen == maxMatch) break;
-                    }
-                }
+        // a 3-byte match is 4 token bytes for 3 literals (6 bytes, but cheap
+        // tags); it only wins after Huffman when the offset's high byte is the
+        // common 0, i.e. the offset is under 256
+        if (bestLen == P::minMatch && P::minMatch == 3 && offset_bucket((uint32_t)bestOffset) > 8)
+            bestLen = 0;
+
+        if (P::lazy && bestLen >= P::minMatch && bestLen < limit && i + 1 + P::minMatch <= n) {
+            // lazy step: prefer a longer match starting one byte later
+            nextLen = findMatch(rel + 1, std::min(maxMatch, n - i - 1), nextOffset);
+            if (nextLen > bestLen) {
+                haveNext = true;
+                bestLen = 0;
             }
         }
 
-        if (bestLen >= MIN_MATCH) {
+        if (bestLen >= P::minMatch) {
             if (bestOffset > 0xFFFF) bestOffset = 0xFFFF;
             if (bestLen > 0xFF) bestLen = 0xFF;
             LZ77Token t{ static_cast<uint16_t>(bestOffset), static_cast<uint8_t>(bestLen), 0 };
             pendingTokens.push_back(t);
+            KITTY_STAT(matches++);
+            KITTY_STAT(matchBytes += bestLen);
+            KITTY_STAT(stats.offsetBuckets[offset_bucket((uint32_t)bestOffset)]++);
 
-            // register matched positions
-            size_t end = i + bestLen;
-            for (size_t p = i; p < end; ++p) {
-                if (absolutePos + p >= absolutePos) {
-                    // register key at position absolutePos + p if possible
-                    if (p + KEY_LEN <= n) {
-                        uint32_t k = make_key(&chunk[p]);
-                        auto &dq = dict[k];
-                        dq.push_back(absolutePos + p);
-                        if (dq.size() > MAX_POS_PER_KEY) dq.pop_front();
-                    }
-                }
-            }
+            // register the remaining matched positions
+            for (size_t p = i + 1; p < i + bestLen && p + P::minMatch <= n; ++p)
+                insert(base + p);
             i += bestLen;
         } else {
             // literal
             LZ77Token t{ 0, 0, chunk[i] };
             pendingTokens.push_back(t);
-
-            if (i + KEY_LEN <= n) {
-                uint32_t k = make_key(&chunk[i]);
-                auto &dq = dict[k];
-                dq.push_back(absolutePos + i);
-                if (dq.size() > MAX_POS_PER_KEY) dq.pop_front();
-            }
+            KITTY_STAT(literals++);
             ++i;
         }
     }
+#if KITTY_STATS_ENABLED
+    stats.positions += positions;
+    stats.probes += probes;
+    stats.depthLimitHits += depthHits;
+    stats.literals += literals;
+    stats.matches += matches;
+    stats.matchBytes += matchBytes;
+#endif
+    inserted = absolutePos + (n >= P::minMatch ? n - P::minMatch + 1 : 0);
 
-    // append chunk to sliding window
-    for (uint8_t b : chunk) window.push_back(b);
-    while (window.size() > windowSize) {
-        // remove positions that move out of window: optional pruning of dict entries
-        window.pop_front();
-    }
+    // keep only the last windowSize bytes as history for the next chunk
+    if (history.size() > windowSize)
+        history.erase(history.begin(), history.end() - windowSize);
 
     absolutePos += n;
+    memory.set((head.capacity() + prev.capacity()) * sizeof(size_t) + history.capacity()
+               + pendingTokens.capacity() * sizeof(LZ77Token));
 }
 
 std::vector<uint8_t> LZ77StreamCompressor::consumeOutput() {
@@ -227,3 +434,122 @@ std::vector<uint8_t> LZ77StreamCompressor::consumeOutput() {
     pendingTokens.clear();
     return out;
 }
+
+// Streaming decompressor class implementation
+
+LZ77StreamDecompressor::LZ77StreamDecompressor(size_t w)
+    : windowSize(w), used(0), outStart(0), partialLen(0) {}
+
+void LZ77StreamDecompressor::prime(const uint8_t* data, size_t n) {
+    if (used != 0) throw std::runtime_error("LZ77StreamDecompressor::prime after feed().");
+    if (n > windowSize) {
+        data += n - windowSize;
+        n = windowSize;
+    }
+    reserve(n);
+    std::memcpy(buf.data(), data, n);
+    used = outStart = n;
+}
+
+void LZ77StreamDecompressor::reserve(size_t extra) {
+    size_t need = used + extra + WILDCOPY_MARGIN;
+    if (need > buf.size()) {
+        size_t grown = std::max(need, buf.size() * 2 + 64 * 1024);
+        memory.set(grown);
+        buf.resize(grown);
+    }
+}
+
+inline void LZ77StreamDecompressor::putLiteral(uint8_t b) {
+    if (used + 1 + WILDCOPY_MARGIN > buf.size()) reserve(1);
+    buf[used++] = b;
+}
+
+inline void LZ77StreamDecompressor::putMatch(size_t offset, size_t length) {
+    if (offset == 0 || offset > used || offset > windowSize)
+        throw std::runtime_error("LZ77 match offset out of range.");
+    if (used + length + WILDCOPY_MARGIN > buf.size()) reserve(length);
+    uint8_t* op = buf.data() + used;
+    const KittyKernels& K = kernels();
+    if (offset >= K.wild_copy_step) K.wild_copy(op, op - offset, length);
+    else if (offset >= 16) wild_copy16(op, op - offset, length);
+    else match_copy_exact(op, offset, length);
+    used += length;
+}
+
+// Token bytes the fast loop in feed() decodes per capacity check; their
+// output is at most 255 bytes per 4-byte match token
+static const size_t DECODE_BATCH = 1024;
+
+void LZ77StreamDecompressor::feed(const uint8_t* data, size_t n) {
+    size_t i = 0;
+    // finish a token left over from the previous feed
+    while (partialLen > 0 && i < n) {
+        partial[partialLen++] = data[i++];
+        size_t need = partial[0] == 0x00 ? 2 : partial[0] == 0x01 ? 4 : 0;
+        if (need == 0) throw std::runtime_error("Corrupt LZ77 stream (bad token tag).");
+        if (partialLen < need) continue;
+        if (partial[0] == 0x00) putLiteral(partial[1]);
+        else putMatch((size_t)partial[1] | ((size_t)partial[2] << 8), partial[3]);
+        partialLen = 0;
+    }
+
+    // fast loop: whole tokens only, with room for a batch's largest output
+    // reserved up front, so a token costs its tag test and (for a match) one
+    // offset check; the last few bytes take the checked path below
+    const KittyKernels& K = kernels();
+    while (n - i >= 4) {
+        size_t batchEnd = i + std::min(n - i, DECODE_BATCH);
+        reserve(((batchEnd - i) / 4 + 1) * 255);
+        uint8_t* base = buf.data();
+        size_t pos = used;
+        while (i + 4 <= batchEnd) {
+            uint8_t tag = data[i];
+            if (tag == 0x00) {
+                base[pos++] = data[i + 1];
+                i += 2;
+            } else if (tag == 0x01) {
+                size_t offset = (size_t)data[i + 1] | ((size_t)data[i + 2] << 8), length = data[i + 3];
+                if (offset - 1 >= std::min(pos, windowSize))  // also catches offset 0
+                    throw std::runtime_error("LZ77 match offset out of range.");
+                uint8_t* op = base + pos;
+                if (offset >= K.wild_copy_step) K.wild_copy(op, op - offset, length);
+                else if (offset >= 16) wild_copy16(op, op - offset, length);
+                else match_copy_exact(op, offset, length);
+                pos += length;
+                i += 4;
+            } else {
+                throw std::runtime_error("Corrupt LZ77 stream (bad token tag).");
+            }
+        }
+        used = pos;
+    }
+
+    while (i < n) {
+        uint8_t tag = data[i];
+        if (tag == 0x00) {
+            if (i + 2 > n) break;
+            putLiteral(data[i + 1]);
+            i += 2;
+        } else if (tag == 0x01) {
+            if (i + 4 > n) break;
+            putMatch((size_t)data[i + 1] | ((size_t)data[i + 2] << 8), data[i + 3]);
+            i += 4;
+        } else {
+            throw std::runtime_error("Corrupt LZ77 stream (bad token tag).");
+        }
+    }
+    while (i < n) partial[partialLen++] = data[i++];
+}
+
+std::vector<uint8_t> LZ77StreamDecompressor::consumeOutput() {
+    std::vector<uint8_t> out(buf.begin() + outStart, buf.begin() + used);
+    // keep only the window needed for future matches
+    if (used > windowSize) {
+        size_t drop = used - windowSize;
+        std::memmove(buf.data(), buf.data() + drop, windowSize);
+        used = windowSize;
+    }
+    outStart = used;
+    return out;
+}
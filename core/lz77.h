@@ -1,10 +1,10 @@
 // lz77.h 
 #pragma once
 #include <vector>
-#include <deque>
 #include <cstdint>
-#include <unordered_map>
 #include <ostream>
+#include "stats.h"
+#include "memtrack.h"
 
 struct LZ77Token {
     uint16_t offset;
@@ -16,28 +16,115 @@ std::vector<LZ77Token> lz77_compress(const std::vector<uint8_t>& data,
                                      size_t windowSize = 65535,
                                      size_t maxMatch = 255);
 std::vector<uint8_t> lz77_serialize(const std::vector<LZ77Token>& tokens);
-std::vector<LZ77Token> lz77_deserialize(const std::vector<uint8_t>& bytes);
+std::vector<LZ77Token> lz77_deserialize(const std::vector<uint8_t>& bytes);  // throws on a malformed stream
 std::vector<uint8_t> lz77_decompress(const std::vector<LZ77Token>& tokens);
 
+// Number of bytes the tokens expand to
+size_t lz77_decoded_size(const std::vector<LZ77Token>& tokens);
+
+// Decode into a preallocated buffer out[0..capacity); returns the decoded size.
+// Matches use 16/32-byte wild copies while at least WILDCOPY_MARGIN bytes of
+// slack remain, exact copies otherwise. Throws on an offset that points before
+// the start of the output or on output that would exceed capacity.
+size_t lz77_decompress_into(const std::vector<LZ77Token>& tokens,
+                            uint8_t* out, size_t capacity);
+
+// Compression levels: 1 = fastest ... 9 = strongest
+const int LZ77_MIN_LEVEL = 1;
+const int LZ77_MAX_LEVEL = 9;
+const int LZ77_DEFAULT_LEVEL = 5;
+const int LZ77_FAST_LEVEL = 2;  // ceiling for blocks the probe finds little to match in (probe.h)
+
+struct LZ77LevelConfig;  // lz77.cpp
+
 // Streaming compressor class 
 class LZ77StreamCompressor {
 public:
-    LZ77StreamCompressor(size_t windowSize = 65535, size_t maxMatch = 255);
+    LZ77StreamCompressor(size_t windowSize = 65535, size_t maxMatch = 255,
+                         int level = LZ77_DEFAULT_LEVEL);
+    LZ77StreamCompressor(const LZ77StreamCompressor& other);  // copies window and hash tables
+
+    // Presets the window with dictionary bytes (the last windowSize of them)
+    // before the first feed(): matches may reach back into them, no tokens
+    // are emitted for them. A primed compressor can be copied per input.
+    void prime(const uint8_t* data, size_t n);
 
     // Feed next chunk of input bytes (append to internal window)
     void feed(const std::vector<uint8_t>& chunk, bool isLast = false);
 
+    // Emits chunk as literals without searching (input the probe judged
+    // incompressible); the bytes still join the window for later chunks
+    void feedLiterals(const std::vector<uint8_t>& chunk);
+
+    // Switches the match finder between chunks; the window is kept (and
+    // hashed again when the new level hashes differently)
+    void setLevel(int level);
+    int currentLevel() const { return level; }
+
     // Get serialized output bytes for all emitted tokens so far
     std::vector<uint8_t> consumeOutput();
 
+    // Match finder counters since construction (all zero with KITTY_NO_STATS)
+    const LZ77MatchStats& matchStats() const { return stats; }
+
 private:
     size_t windowSize;
     size_t maxMatch;
-    std::deque<uint8_t> window;  // sliding window
-    std::unordered_map<uint32_t, std::deque<size_t>> dict;
+    int level;
+    std::vector<uint8_t> history;  // last windowSize bytes followed by the chunk being parsed
+    std::vector<size_t> head;      // hash -> most recent absolute position + 1 (0 = empty)
+    std::vector<size_t> prev;      // ring indexed by position: previous position + 1 with the same hash
+    size_t prevMask;
+    size_t inserted;               // positions below this are already hashed
     std::vector<LZ77Token> pendingTokens;
     size_t absolutePos;
+    LZ77MatchStats stats;
+    MemCharge memory{ MemSubsystem::LZ77 };  // hash tables + history + pending tokens
+
+    // match finder specialized per level (see LZ77MatcherParams in lz77.cpp)
+    void (LZ77StreamCompressor::*parse)(const std::vector<uint8_t>& chunk);
+    void (LZ77StreamCompressor::*primeWindow)(const uint8_t* data, size_t n);
+    void (LZ77StreamCompressor::*rehashWindow)();
+    template <class Params> void parseChunk(const std::vector<uint8_t>& chunk);
+    template <class Params> void primeChunk(const uint8_t* data, size_t n);
+    template <class Params> void rehashChunk();
+    static const LZ77LevelConfig& levelConfig(int level);
 
     void processChunk(const std::vector<uint8_t>& chunk, bool isLast);
-    static inline uint32_t make_key(const uint8_t* p);
+};
+
+// Streaming decompressor class (inverse of LZ77StreamCompressor)
+class LZ77StreamDecompressor {
+public:
+    LZ77StreamDecompressor(size_t windowSize = 65535);
+
+    // Same dictionary bytes as LZ77StreamCompressor::prime, before the first feed()
+    void prime(const uint8_t* data, size_t n);
+
+    // Feed next chunk of serialized token bytes; tokens may span chunk boundaries.
+    // Throws on a malformed token or an offset outside the window.
+    void feed(const uint8_t* data, size_t n);
+    void feed(const std::vector<uint8_t>& chunk) { feed(chunk.data(), chunk.size()); }
+
+    // Get decoded bytes produced since the last call
+    std::vector<uint8_t> consumeOutput();
+
+    // Number of decoded bytes waiting in consumeOutput()
+    size_t pendingOutput() const { return used - outStart; }
+
+    // True if the bytes fed so far end in the middle of a token
+    bool hasPartialToken() const { return partialLen > 0; }
+
+private:
+    size_t windowSize;
+    std::vector<uint8_t> buf;  // window tail + unconsumed output + wild-copy slack
+    size_t used;               // valid bytes in buf
+    size_t outStart;           // start of unconsumed output in buf
+    uint8_t partial[4];        // bytes of a token split across feed() calls
+    size_t partialLen;
+    MemCharge memory{ MemSubsystem::Decode };
+
+    void reserve(size_t extra);
+    void putLiteral(uint8_t b);
+    void putMatch(size_t offset, size_t length);
 };
@@ -0,0 +1,149 @@
+// lzkernels.cpp
+#include "lzkernels.h"
+#include "cpu.h"
+#include <cstring>
+
+#ifdef KITTY_X86
+#include <immintrin.h>
+#endif
+
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline unsigned ctz64(uint64_t v) {
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctzll(v);
+#else
+    unsigned n = 0;
+    while (!(v & 1)) { v >>= 1; ++n; }
+    return n;
+#endif
+}
+
+static inline bool little_endian() {
+    const uint16_t one = 1;
+    uint8_t b;
+    std::memcpy(&b, &one, 1);
+    return b == 1;
+}
+
+size_t match_length_scalar(const uint8_t *a, const uint8_t *b, size_t limit) {
+    size_t k = 0;
+    if (little_endian()) {
+        while (k + 8 <= limit) {
+            uint64_t diff = load64(a + k) ^ load64(b + k);
+            if (diff) return k + (ctz64(diff) >> 3);
+            k += 8;
+        }
+    }
+    while (k < limit && a[k] == b[k]) ++k;
+    return k;
+}
+
+#ifdef KITTY_X86
+// First mismatch in a 16-byte block, or 16 if the blocks are equal
+KITTY_TARGET("sse2")
+static inline unsigned mismatch16(const uint8_t *a, const uint8_t *b) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+    unsigned eq = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+    return eq == 0xFFFFu ? 16 : ctz64(~eq & 0xFFFFu);
+}
+
+KITTY_TARGET("sse2")
+size_t match_length_sse2(const uint8_t *a, const uint8_t *b, size_t limit) {
+    if (limit < 16) return match_length_scalar(a, b, limit);
+    size_t k = 0;
+    while (k + 16 <= limit) {
+        unsigned m = mismatch16(a + k, b + k);
+        if (m != 16) return k + m;
+        k += 16;
+    }
+    if (k == limit) return k;
+    // overlapping final block; everything before k is known to match
+    size_t t = limit - 16;
+    return t + mismatch16(a + t, b + t);
+}
+
+KITTY_TARGET("avx2")
+static inline unsigned mismatch32(const uint8_t *a, const uint8_t *b) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+    uint32_t eq = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+    return eq == 0xFFFFFFFFu ? 32 : ctz64(~(uint64_t)eq & 0xFFFFFFFFu);
+}
+
+KITTY_TARGET("avx2")
+size_t match_length_avx2(const uint8_t *a, const uint8_t *b, size_t limit) {
+    if (limit < 32) {
+        if (limit < 16) return match_length_scalar(a, b, limit);
+        unsigned m = mismatch16(a, b);
+        if (m != 16) return m;
+        return (limit - 16) + mismatch16(a + limit - 16, b + limit - 16);
+    }
+    size_t k = 0;
+    while (k + 32 <= limit) {
+        unsigned m = mismatch32(a + k, b + k);
+        if (m != 32) return k + m;
+        k += 32;
+    }
+    if (k == limit) return k;
+    size_t t = limit - 32;
+    return t + mismatch32(a + t, b + t);
+}
+#else
+size_t match_length_sse2(const uint8_t *a, const uint8_t *b, size_t limit) {
+    return match_length_scalar(a, b, limit);
+}
+
+size_t match_length_avx2(const uint8_t *a, const uint8_t *b, size_t limit) {
+    return match_length_scalar(a, b, limit);
+}
+#endif
+
+size_t match_length(const uint8_t *a, const uint8_t *b, size_t limit) {
+    return kernels().match_length(a, b, limit);
+}
+
+void wild_copy16(uint8_t *dst, const uint8_t *src, size_t len) {
+    uint8_t *end = dst + len;
+    do {
+        std::memcpy(dst, src, 16);
+        dst += 16; src += 16;
+    } while (dst < end);
+}
+
+#ifdef KITTY_X86
+KITTY_TARGET("avx2")
+void wild_copy32(uint8_t *dst, const uint8_t *src, size_t len) {
+    uint8_t *end = dst + len;
+    do {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+                            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)));
+        dst += 32; src += 32;
+    } while (dst < end);
+}
+#else
+void wild_copy32(uint8_t *dst, const uint8_t *src, size_t len) {
+    uint8_t *end = dst + len;
+    do {
+        std::memcpy(dst, src, 32);
+        dst += 32; src += 32;
+    } while (dst < end);
+}
+#endif
+
+void match_copy_exact(uint8_t *dst, size_t offset, size_t len) {
+    const uint8_t *src = dst - offset;
+    if (offset >= 8) {
+        // non-overlapping within each 8-byte step
+        while (len >= 8) {
+            std::memcpy(dst, src, 8);
+            dst += 8; src += 8; len -= 8;
+        }
+    }
+    while (len--) *dst++ = *src++;
+}
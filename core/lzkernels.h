@@ -0,0 +1,28 @@
+// lzkernels.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Match-length and copy kernels used by the LZ77 coder.
+
+// Number of leading bytes equal in a[0..limit) and b[0..limit).
+// Never reads past limit on either side.
+size_t match_length_scalar(const uint8_t *a, const uint8_t *b, size_t limit); // 8 bytes/step
+size_t match_length_sse2(const uint8_t *a, const uint8_t *b, size_t limit);   // 16 bytes/step
+size_t match_length_avx2(const uint8_t *a, const uint8_t *b, size_t limit);   // 32 bytes/step
+
+// Dispatches to the kernel selected in cpu.h
+size_t match_length(const uint8_t *a, const uint8_t *b, size_t limit);
+
+// Slack a wild copy may write past the requested end
+const size_t WILDCOPY_MARGIN = 32;
+
+// Copies len bytes from src to dst in 16/32-byte steps, possibly writing up to
+// WILDCOPY_MARGIN - 1 bytes past dst + len. Requires dst - src >= 16 (or 32)
+// when the ranges overlap, i.e. the copy must never read bytes it wrote.
+void wild_copy16(uint8_t *dst, const uint8_t *src, size_t len);
+void wild_copy32(uint8_t *dst, const uint8_t *src, size_t len);
+
+// Exact copy of an LZ77 match (dst - offset) for any offset >= 1, including
+// short overlapping offsets that replicate a pattern.
+void match_copy_exact(uint8_t *dst, size_t offset, size_t len);
@@ -2,8 +2,21 @@
 #include <iostream>
 #include <string>
 #include <filesystem>
+#include <fstream>
 #include "huffman.h"
 #include "archive.h"
+#include "bench.h"
+#include "corpus.h"
+#include "fuzz.h"
+#include "trace.h"
+#include "memtrack.h"
+#include "cpu.h"
+#include "delta.h"
+#include "dict.h"
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 using namespace std;
 namespace fs = std::filesystem;
@@ -14,30 +27,295 @@ void printUsage() {
     cout << "Universal lossless archiver using LZ77 + Huffman (multi-file supported)\n\n";
     cout << "Usage:\n"
          << "  kittypress compress <input1> [<input2> ...] <output.kitty>\n"
-         << "  kittypress decompress <archive.kitty> <outputFolder>\n";
+         << "  kittypress decompress <archive.kitty> <outputFolder>\n"
+         << "  kittypress update <archive.kitty> <input1> [<input2> ...]   (append new and changed files)\n"
+         << "  kittypress compact <archive.kitty>     (drop members replaced by update)\n"
+         << "  kittypress list <archive.kitty>\n"
+         << "  kittypress test <archive.kitty>       (decode and CRC-check every member, write nothing)\n"
+         << "  kittypress bench [<file|dir> ...]     (default corpus: samples/)\n"
+         << "  kittypress gen-corpus <outputFolder>\n"
+         << "  kittypress fuzz [<seed.kitty> ...] [-o <workDir>]   (mutate and decode; default: built-in seeds)\n"
+         << "  kittypress train-dict <sample|dir> ... -o <dict.kd>   (dictionary for many small files)\n"
+         << "  kittypress delta --ref <old> <new> -o <patch.kitty>   (patch holding only the changes)\n"
+         << "  kittypress patch --ref <old> <patch.kitty> -o <new>\n"
+         << "  kittypress -c [<input>|-] [<output>|-]   stream compress (default stdin → stdout)\n"
+         << "  kittypress -d [<input>|-] [<output>|-]   stream decompress (default stdin → stdout)\n"
+         << "  (compress/decompress also take - for a single input or output stream)\n"
+         << "  kittypress --cpu-features\n\n"
+         << "Options:\n"
+         << "  -1 ... -9, --level=<1-9>         compression level (default " << LZ77_DEFAULT_LEVEL << ")\n"
+         << "  --cpu=<scalar|sse4.2|avx2|bmi2>  force a kernel tier (also KITTY_CPU env)\n"
+         << "  --stats[=json|<file.json>]       print counters and stage times (text, JSON, or JSON file)\n"
+         << "  --max-memory=<size>              cap KittyPress buffers, e.g. 8M (buffers and window shrink to fit)\n"
+         << "  --threads=<n>                    decompress/test: members decoded in parallel (default: all cores);\n"
+         << "                                   compress: directory walk threads\n"
+         << "  --chunk-dedup                    compress/update: store repeated chunks once across large files\n"
+         << "  --no-filters                     compress/update: skip the x86/delta/stride preprocessing filters\n"
+         << "  --base <previous.kitty>          compress: copy unchanged files' payloads from an earlier archive\n"
+         << "  --links=<copy|hard|reflink>      decompress: how duplicate members are written (default copy)\n"
+         << "  --sort=<name|size|ext>           compress/update: member order (default: as the directory walk finds them)\n"
+         << "  --dict=<dict.kd>                 compress/update/decompress/test: preset dictionary from train-dict\n"
+         << "  --dict-size=<size>               train-dict: dictionary bytes (default 32K, at most 65535)\n"
+         << "  --trace <out.json>               write a Chrome/Perfetto timeline of the run\n"
+         << "  --iterations=<n>                 bench: runs per file (default 3); fuzz: mutated runs\n"
+         << "                                   (default 1000, 0 = decode the seeds as they are)\n"
+         << "  --json[=<file>]                  bench: JSON report to stdout or file\n"
+         << "  --baseline=<file.json>           bench: exit 2 on regression vs an earlier --json report\n"
+         << "  --threshold=<percent>            bench: allowed regression (default 5)\n"
+         << "  --size=<bytes>, --seed=<n>       gen-corpus: bytes per dataset (default 4 MiB), seed\n"
+         << "                                   (--seed also picks the fuzz mutations)\n";
+}
+
+// "-" is stdin/stdout (switched to binary mode), anything else a file
+static istream& openInput(const string& path, ifstream& file) {
+    if (path == "-") {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        return cin;
+    }
+    file.open(path, ios::binary);
+    if (!file) throw runtime_error("Cannot open input file " + path);
+    return file;
+}
+
+static ostream& openOutput(const string& path, ofstream& file) {
+    if (path == "-") {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        return cout;
+    }
+    file.open(path, ios::binary);
+    if (!file) throw runtime_error("Cannot open output file " + path);
+    return file;
 }
 
 int main(int argc, char* argv[]) {
-    cout << "KittyPress launched! argc=" << argc << endl;
-    if (argc < 3) { printUsage(); return 1; }
+    // bench output is machine-read and pipe mode may own stdout, so keep the
+    // launch/done chatter out of both
+    bool benchMode = argc > 1 && string(argv[1]) == "bench";
+    bool pipeMode = false;
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        if (a == "-" || a == "-c" || a == "-d") pipeMode = true;
+    }
+    if (pipeMode) ios::sync_with_stdio(false);
+    if (!benchMode && !pipeMode) cout << "KittyPress launched! argc=" << argc << endl;
 
-    string mode = argv[1];
+    // global options may appear anywhere; everything else is positional
+    vector<string> args;
+    bool showCpu = false;
+    int level = LZ77_DEFAULT_LEVEL;
+    BenchOptions bench;
+    CorpusOptions corpus;
+    FuzzOptions fuzz;
+    string statsMode;  // "", "text", "json" or a JSON output path
+    string tracePath;
+    string streamMode;  // "-c" or "-d"
+    unsigned threads = 0;
+    ArchiveOptions archiveOpts;
+    DuplicateLinks links = DuplicateLinks::Copy;
+    string dictPath;
+    string outputPath;  // train-dict, delta, patch -o; fuzz work directory
+    string refPath;     // delta, patch --ref
+    size_t dictSize = DICT_DEFAULT_SIZE;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string a = argv[i];
+            if (a == "--cpu-features") {
+                showCpu = true;
+            } else if (a == "-c" || a == "-d") {
+                streamMode = a;
+            } else if (a.rfind("--cpu=", 0) == 0) {
+                CpuTier tier;
+                if (!cpu_parse_tier(a.substr(6), tier))
+                    throw runtime_error("Unknown CPU tier: " + a.substr(6));
+                cpu_force_tier(tier);
+            } else if (a.size() == 2 && a[0] == '-' && a[1] >= '1' && a[1] <= '9') {
+                level = a[1] - '0';
+            } else if (a.rfind("--level=", 0) == 0) {
+                level = stoi(a.substr(8));
+                if (level < LZ77_MIN_LEVEL || level > LZ77_MAX_LEVEL)
+                    throw runtime_error("Level must be between 1 and 9.");
+            } else if (a.rfind("--threads=", 0) == 0) {
+                threads = (unsigned)stoul(a.substr(10));
+            } else if (a.rfind("--sort=", 0) == 0) {
+                if (!parseArchiveOrder(a.substr(7), archiveOpts.order))
+                    throw runtime_error("Unknown sort order: " + a.substr(7));
+            } else if (a == "--no-filters") {
+                archiveOpts.filters = false;
+            } else if (a == "--chunk-dedup") {
+                archiveOpts.chunkDedup = true;
+            } else if (a.rfind("--links=", 0) == 0) {
+                if (!parseDuplicateLinks(a.substr(8), links))
+                    throw runtime_error("Unknown link mode: " + a.substr(8));
+            } else if (a.rfind("--dict=", 0) == 0) {
+                dictPath = a.substr(7);
+            } else if (a.rfind("--dict-size=", 0) == 0) {
+                dictSize = (size_t)mem_parse_size(a.substr(12));
+                if (dictSize == 0 || dictSize > DICT_MAX_SIZE)
+                    throw runtime_error("Dictionary size must be between 1 and " + to_string(DICT_MAX_SIZE) + " bytes.");
+            } else if (a == "--base" || a.rfind("--base=", 0) == 0) {
+                if (a == "--base" && i + 1 >= argc) throw runtime_error("--base needs an archive.");
+                archiveOpts.basePath = a == "--base" ? argv[++i] : a.substr(7);
+            } else if (a == "--ref" || a.rfind("--ref=", 0) == 0) {
+                if (a == "--ref" && i + 1 >= argc) throw runtime_error("--ref needs a reference file.");
+                refPath = a == "--ref" ? argv[++i] : a.substr(6);
+            } else if (a == "-o") {
+                if (i + 1 >= argc) throw runtime_error("-o needs an output file.");
+                outputPath = argv[++i];
+            } else if (a.rfind("--iterations=", 0) == 0) {
+                bench.iterations = stoi(a.substr(13));
+                fuzz.iterations = stoull(a.substr(13));
+            } else if (a == "--json") {
+                bench.json = true;
+            } else if (a.rfind("--json=", 0) == 0) {
+                bench.json = true;
+                bench.jsonPath = a.substr(7);
+            } else if (a == "--trace" || a.rfind("--trace=", 0) == 0) {
+                if (a == "--trace" && i + 1 >= argc) throw runtime_error("--trace needs an output file.");
+                tracePath = a == "--trace" ? argv[++i] : a.substr(8);
+            } else if (a.rfind("--max-memory=", 0) == 0) {
+                mem_set_budget(mem_parse_size(a.substr(13)));
+                mem_plan(); // fail early if nothing fits
+            } else if (a == "--stats") {
+                statsMode = "text";
+            } else if (a.rfind("--stats=", 0) == 0) {
+                statsMode = a.substr(8);
+            } else if (a.rfind("--baseline=", 0) == 0) {
+                bench.baselinePath = a.substr(11);
+            } else if (a.rfind("--threshold=", 0) == 0) {
+                bench.threshold = stod(a.substr(12));
+            } else if (a.rfind("--size=", 0) == 0) {
+                corpus.size = stoull(a.substr(7));
+            } else if (a.rfind("--seed=", 0) == 0) {
+                corpus.seed = stoull(a.substr(7));
+                fuzz.seed = corpus.seed;
+            } else {
+                args.push_back(a);
+            }
+        }
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    if (showCpu) {
+        cout << cpu_feature_report();
+        if (args.empty()) return 0;
+    }
+    if (benchMode) {
+        try {
+            bench.inputs.assign(args.begin() + 1, args.end());
+            bench.level = level;
+            return runBench(bench);
+        } catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+    }
+    if (!args.empty() && args[0] == "fuzz") {
+        try {
+            fuzz.seeds.assign(args.begin() + 1, args.end());
+            if (!outputPath.empty()) fuzz.outDir = outputPath;
+            return runFuzz(fuzz);
+        } catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+    }
+    // -c/-d [input] [output] is compress/decompress with - defaults
+    if (!streamMode.empty()) {
+        if (args.size() > 2) { printUsage(); return 1; }
+        args.resize(2, "-");
+        args.insert(args.begin(), streamMode == "-c" ? "compress" : "decompress");
+    }
+    if (args.size() < 2) { printUsage(); return 1; }
+
+    string mode = args[0];
+    unique_ptr<KittyDictionary> dict;
+    KittyStats stats;
+    KittyStats* statsPtr = statsMode.empty() ? nullptr : &stats;
+    if (!tracePath.empty()) trace_start();
 
     try {
+        if (!dictPath.empty()) {
+            if (pipeMode) throw runtime_error("--dict is not supported in stream mode.");
+            dict.reset(new KittyDictionary(dictPath));
+        }
         if (mode == "compress") {
-            if (argc < 4) { printUsage(); return 1; }
-            vector<string> inputs;
-            for (int i = 2; i < argc - 1; ++i)
-                inputs.push_back(argv[i]);
-            string output = argv[argc - 1];
+            if (args.size() < 3) { printUsage(); return 1; }
+            vector<string> inputs(args.begin() + 1, args.end() - 1);
+            string output = args.back();
 
-            createArchive(inputs, output);
+            if (pipeMode) {
+                if (inputs.size() != 1) throw runtime_error("Stream mode takes exactly one input.");
+                ifstream inFile;
+                ofstream outFile;
+                compressStream(openInput(inputs[0], inFile), openOutput(output, outFile), level, statsPtr);
+            } else {
+                archiveOpts.level = level;
+                archiveOpts.stats = statsPtr;
+                archiveOpts.threads = threads;
+                archiveOpts.dict = dict.get();
+                createArchive(inputs, output, archiveOpts);
+            }
         }
         else if (mode == "decompress") {
-            if (argc < 4) { printUsage(); return 1; }
-            string archive = argv[2];
-            string folder  = argv[3];
-            extractArchive(archive, folder);
+            if (args.size() < 3) { printUsage(); return 1; }
+            string archive = args[1];
+            string folder  = args[2];
+            if (pipeMode) {
+                ifstream inFile;
+                ofstream outFile;
+                decompressStream(openInput(archive, inFile), openOutput(folder, outFile), statsPtr);
+            } else {
+                extractArchive(archive, folder, statsPtr, threads, links, dict.get());
+            }
+        }
+        else if (mode == "update") {
+            if (args.size() < 3) { printUsage(); return 1; }
+            archiveOpts.level = level;
+            archiveOpts.stats = statsPtr;
+            archiveOpts.dict = dict.get();
+            updateArchive(vector<string>(args.begin() + 2, args.end()), args[1], archiveOpts);
+        }
+        else if (mode == "compact") {
+            compactArchive(args[1]);
+        }
+        else if (mode == "list") {
+            listArchive(args[1]);
+        }
+        else if (mode == "test") {
+            testArchive(args[1], statsPtr, threads, dict.get());
+        }
+        else if (mode == "train-dict") {
+            if (outputPath.empty()) throw runtime_error("train-dict needs -o <dict.kd>.");
+            vector<vector<uint8_t>> samples;
+            for (auto& f : collectArchiveInputs(vector<string>(args.begin() + 1, args.end()))) {
+                ifstream in(f.absPath, ios::binary);
+                if (!in) throw runtime_error("Cannot open " + f.absPath);
+                samples.emplace_back(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+            }
+            unique_ptr<KittyDictionary> trained = dict_train(samples, dictSize, level);
+            trained->save(outputPath);
+            cout << "Dictionary " << dict_id_hex(trained->id()) << " (" << trained->content().size()
+                 << " bytes from " << samples.size() << " sample(s)) → " << outputPath << endl;
+        }
+        else if (mode == "delta" || mode == "patch") {
+            if (refPath.empty() || outputPath.empty() || args.size() != 2) { printUsage(); return 1; }
+            if (mode == "delta") {
+                DeltaOptions deltaOpts;
+                deltaOpts.level = level;
+                deltaOpts.stats = statsPtr;
+                createDelta(refPath, args[1], outputPath, deltaOpts);
+            } else {
+                applyDelta(refPath, args[1], outputPath, statsPtr);
+            }
+        }
+        else if (mode == "gen-corpus") {
+            generateCorpus(args[1], corpus);
         }
         else {
             printUsage();
@@ -48,7 +326,27 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    cout << "[KittyPress] Done.\n";
+    if (!tracePath.empty()) {
+        try {
+            trace_write(tracePath);
+        } catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+    }
+
+    ostream& report = pipeMode ? cerr : cout;
+    if (statsMode == "text") {
+        stats_print(report, stats);
+    } else if (statsMode == "json") {
+        stats_write_json(report, stats);
+    } else if (!statsMode.empty()) {
+        ofstream statsOut(statsMode);
+        if (!statsOut) { cerr << "Error: Cannot open " << statsMode << endl; return 1; }
+        stats_write_json(statsOut, stats);
+    }
+
+    if (!pipeMode) cout << "[KittyPress] Done.\n";
     return 0;
 }
 
@@ -0,0 +1,86 @@
+// mapfile.cpp
+#include "mapfile.h"
+#include <fstream>
+#include <stdexcept>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const string &path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) throw runtime_error("Cannot open " + path);
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) { CloseHandle(file); throw runtime_error("Cannot stat " + path); }
+    len = (uint64_t)size.QuadPart;
+    if (len == 0) { CloseHandle(file); return; }
+
+    HANDLE map = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void *view = map ? MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (map) CloseHandle(map);
+        CloseHandle(file);
+        readFallback(path);
+        return;
+    }
+    fileHandle = file;
+    mapHandle = map;
+    ptr = static_cast<const uint8_t*>(view);
+}
+
+MappedFile::~MappedFile() {
+    if (mapHandle) {
+        UnmapViewOfFile(ptr);
+        CloseHandle((HANDLE)mapHandle);
+        CloseHandle((HANDLE)fileHandle);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw runtime_error("Cannot open " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); throw runtime_error("Cannot stat " + path); }
+    len = (uint64_t)st.st_size;
+    if (len == 0) { close(fd); return; }
+
+    void *view = mmap(nullptr, (size_t)len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // the mapping keeps the file referenced
+    if (view == MAP_FAILED) {
+        readFallback(path);
+        return;
+    }
+    madvise(view, (size_t)len, MADV_SEQUENTIAL);
+    mapping = view;
+    ptr = static_cast<const uint8_t*>(view);
+}
+
+MappedFile::~MappedFile() {
+    if (mapping) munmap(mapping, (size_t)len);
+}
+
+#endif
+
+void MappedFile::readFallback(const string &path) {
+    ifstream in(path, ios::binary);
+    if (!in) throw runtime_error("Cannot open " + path);
+    charge.set(len);
+    copy.resize((size_t)len);
+    in.read(reinterpret_cast<char*>(copy.data()), (streamsize)len);
+    if ((uint64_t)in.gcount() != len) throw runtime_error("Failed to read " + path);
+    ptr = copy.data();
+}
@@ -0,0 +1,36 @@
+// mapfile.h
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "memtrack.h"
+
+// Read-only view of a whole file: mmap on POSIX, a file mapping on Windows,
+// and a plain read into memory where mapping is not possible. The view is
+// immutable, so any number of threads may read it at once.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path);  // throws if the file cannot be opened
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *data() const { return ptr; }
+    uint64_t size() const { return len; }
+    bool mapped() const { return copy.empty() && len > 0; }  // false: read fallback (or empty file)
+
+private:
+    const uint8_t *ptr = nullptr;
+    uint64_t len = 0;
+    std::vector<uint8_t> copy;  // fallback storage
+    MemCharge charge{ MemSubsystem::Archive };
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mapHandle = nullptr;
+#else
+    void *mapping = nullptr;
+#endif
+
+    void readFallback(const std::string &path);
+};
@@ -0,0 +1,100 @@
+// memstream.h
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+// std::istream over a caller-owned byte range (no copy)
+class MemoryInBuf : public std::streambuf {
+public:
+    MemoryInBuf(const uint8_t *data, size_t size) {
+        char *p = const_cast<char*>(reinterpret_cast<const char*>(data));
+        setg(p, p, p + size);
+    }
+
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which = std::ios_base::in) override {
+        if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+        char *base = dir == std::ios_base::beg ? eback() : dir == std::ios_base::cur ? gptr() : egptr();
+        char *target = base + off;
+        if (target < eback() || target > egptr()) return pos_type(off_type(-1));
+        setg(eback(), target, egptr());
+        return pos_type(target - eback());
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in) override {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};
+
+class MemoryIStream : private MemoryInBuf, public std::istream {
+public:
+    MemoryIStream(const uint8_t *data, size_t size)
+        : MemoryInBuf(data, size), std::istream(static_cast<std::streambuf*>(this)) {}
+};
+
+// std::ostream appending to a caller-owned vector
+class VectorOutBuf : public std::streambuf {
+public:
+    explicit VectorOutBuf(std::vector<uint8_t> &target) : out(target) {}
+
+protected:
+    int_type overflow(int_type ch) override {
+        if (ch != traits_type::eof()) out.push_back((uint8_t)ch);
+        return ch;
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+        out.insert(out.end(), reinterpret_cast<const uint8_t*>(s), reinterpret_cast<const uint8_t*>(s) + n);
+        return n;
+    }
+
+private:
+    std::vector<uint8_t> &out;
+};
+
+class VectorOStream : private VectorOutBuf, public std::ostream {
+public:
+    explicit VectorOStream(std::vector<uint8_t> &target)
+        : VectorOutBuf(target), std::ostream(static_cast<std::streambuf*>(this)) {}
+};
+
+// std::ostream that batches writes into a fixed buffer and hands each full
+// buffer (and the tail, on flush()) to a callback. Exceptions thrown by the
+// callback propagate out of the stream call.
+class CallbackOutBuf : public std::streambuf {
+public:
+    using Callback = std::function<void(const uint8_t *data, size_t size)>;
+    explicit CallbackOutBuf(Callback cb, size_t bufferSize = 64 * 1024) : emit(std::move(cb)), buf(bufferSize) {
+        setp(buf.data(), buf.data() + buf.size());
+    }
+protected:
+    int_type overflow(int_type ch) override {
+        sync();
+        if (ch != traits_type::eof()) {
+            *pptr() = (char)ch;
+            pbump(1);
+        }
+        return ch;
+    }
+    int sync() override {
+        if (pptr() > pbase()) emit(reinterpret_cast<const uint8_t*>(pbase()), (size_t)(pptr() - pbase()));
+        setp(buf.data(), buf.data() + buf.size());
+        return 0;
+    }
+private:
+    Callback emit;
+    std::vector<char> buf;
+};
+
+class CallbackOStream : private CallbackOutBuf, public std::ostream {
+public:
+    explicit CallbackOStream(Callback cb, size_t bufferSize = 64 * 1024)
+        : CallbackOutBuf(std::move(cb), bufferSize), std::ostream(static_cast<std::streambuf*>(this)) {
+        exceptions(std::ios_base::badbit);
+    }
+};
@@ -0,0 +1,146 @@
+// memtrack.cpp
+#include "memtrack.h"
+#include "filter.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <stdexcept>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+static atomic<uint64_t> g_budget{ 0 };
+static atomic<uint64_t> g_current{ 0 };
+static atomic<uint64_t> g_peak{ 0 };
+static atomic<uint64_t> g_subCurrent[MEM_SUBSYSTEMS];
+static atomic<uint64_t> g_subPeak[MEM_SUBSYSTEMS];
+
+// Untracked allocations (code maps, iostream buffers, strings) planned for
+// on top of the accounted buffers
+static const uint64_t UNTRACKED_RESERVE = 256 * 1024;
+
+const char *mem_subsystem_name(MemSubsystem s) {
+    switch (s) {
+        case MemSubsystem::IO: return "io";
+        case MemSubsystem::LZ77: return "lz77";
+        case MemSubsystem::Huffman: return "huffman";
+        case MemSubsystem::Decode: return "decode";
+        case MemSubsystem::Archive: return "archive";
+        default: return "?";
+    }
+}
+
+void mem_set_budget(uint64_t bytes) { g_budget.store(bytes); }
+uint64_t mem_budget() { return g_budget.load(); }
+
+static void raisePeak(atomic<uint64_t> &peak, uint64_t value) {
+    uint64_t seen = peak.load(memory_order_relaxed);
+    while (value > seen && !peak.compare_exchange_weak(seen, value, memory_order_relaxed)) {}
+}
+
+void mem_charge(MemSubsystem s, uint64_t bytes) {
+    uint64_t total = g_current.fetch_add(bytes) + bytes;
+    uint64_t budget = g_budget.load(memory_order_relaxed);
+    if (budget && total > budget) {
+        g_current.fetch_sub(bytes);
+        throw runtime_error(string("Memory budget exceeded (") + mem_subsystem_name(s) + " needs "
+                            + to_string(bytes) + " more bytes, " + to_string(total - bytes) + " of "
+                            + to_string(budget) + " in use).");
+    }
+    size_t i = (size_t)s;
+    raisePeak(g_subPeak[i], g_subCurrent[i].fetch_add(bytes) + bytes);
+    raisePeak(g_peak, total);
+}
+
+void mem_release(MemSubsystem s, uint64_t bytes) {
+    g_subCurrent[(size_t)s].fetch_sub(bytes);
+    g_current.fetch_sub(bytes);
+}
+
+uint64_t mem_current() { return g_current.load(); }
+uint64_t mem_peak() { return g_peak.load(); }
+uint64_t mem_peak(MemSubsystem s) { return g_subPeak[(size_t)s].load(); }
+
+uint64_t mem_process_peak_rss() {
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+    return (uint64_t)usage.ru_maxrss;         // bytes
+#else
+    return (uint64_t)usage.ru_maxrss * 1024;  // kilobytes
+#endif
+#else
+    return 0;
+#endif
+}
+
+uint64_t mem_parse_size(const string &text) {
+    size_t used = 0;
+    uint64_t value;
+    try { value = stoull(text, &used); } catch (...) { throw runtime_error("Bad size: " + text); }
+    string suffix = text.substr(used);
+    if (!suffix.empty() && (suffix.back() == 'B' || suffix.back() == 'b')) suffix.pop_back();
+    if (suffix.size() > 1) throw runtime_error("Bad size: " + text);
+    int shift = 0;
+    if (!suffix.empty()) {
+        switch (toupper((unsigned char)suffix[0])) {
+            case 'K': shift = 10; break;
+            case 'M': shift = 20; break;
+            case 'G': shift = 30; break;
+            default: throw runtime_error("Bad size: " + text);
+        }
+    }
+    return value << shift;
+}
+
+// Accounted bytes of one file's compress pipeline at a given chunk and
+// window: LZ77 hash head (largest level) + chain ring + history, token
+// vectors, the read/serialized/spill/pass buffers and the probe sample (16
+// chunks, then the filter block). With filters, one chunk of filtered
+// bytes plus a partial transpose block, and the filter trial: its level-1
+// LZ77 (hash head + ring) and the sample, filtered sample and token copies
+static uint64_t compressBytes(uint64_t chunk, uint64_t window, bool filters) {
+    uint64_t ring = 1;
+    while (ring <= window) ring <<= 1;
+    uint64_t lz = (uint64_t(1) << 16) * 8 + ring * 8 + 2 * (window + chunk) + 8 * chunk;
+    uint64_t io = chunk + 2 * chunk + 2 * chunk + chunk + 16 * chunk;
+    uint64_t trialRing = 1;
+    while (trialRing <= FILTER_TRIAL_WINDOW) trialRing <<= 1;
+    uint64_t filter = chunk + FILTER_TRANSPOSE_BLOCK + (uint64_t(1) << 14) * 8 + trialRing * 8 + 8 * FILTER_TRIAL_SIZE;
+    return lz + io + (filters ? filter : 0);
+}
+
+// Decode side: a slice of chunk/16 token bytes expands to at most 4 chunks;
+// the 64 KiB window buffer (grown by doubling), the handed-out copy, the
+// input/symbol buffers and the Huffman table
+static uint64_t decompressBytes(uint64_t chunk) {
+    return 2 * (65536 + 4 * chunk) + 65536 + 4 * chunk + 2 * chunk + 32 * 1024;
+}
+
+static uint64_t pipelineBytes(uint64_t chunk, uint64_t window, bool filters) {
+    return max(compressBytes(chunk, window, filters), decompressBytes(chunk));
+}
+
+MemPlan mem_plan() {
+    MemPlan plan{ 64 * 1024, 65535, 1024 * 1024, 64 * 1024, 8 * 1024 * 1024, true };
+    uint64_t budget = g_budget.load();
+    if (budget == 0) return plan;
+
+    // shrink the chunk first (throughput barely changes), then the window
+    // (ratio does); filters go last, since on binary input they are worth
+    // more than any window step
+    static const size_t CHUNKS[] = { 64 * 1024, 32 * 1024, 16 * 1024, 8 * 1024, 4 * 1024 };
+    static const size_t WINDOWS[] = { 65535, 32767, 16383, 8191, 4095 };
+    for (bool filters : { true, false })
+        for (size_t window : WINDOWS)
+            for (size_t chunk : CHUNKS)
+                if (pipelineBytes(chunk, window, filters) + UNTRACKED_RESERVE <= budget)
+                    return { chunk, window, 16 * chunk, max<size_t>(256, chunk / 16), 2 * chunk, filters };
+
+    throw runtime_error("--max-memory is too small: need at least "
+                        + to_string((pipelineBytes(4 * 1024, 4095, false) + UNTRACKED_RESERVE + 1023) / 1024)
+                        + " KiB.");
+}
@@ -0,0 +1,61 @@
+// memtrack.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Accounting of KittyPress's own large buffers (not every heap allocation):
+// each subsystem charges what it holds, peaks are kept per subsystem and in
+// total, and an optional budget (--max-memory) turns an overrun into an error.
+
+enum class MemSubsystem { IO = 0, LZ77, Huffman, Decode, Archive, Count };
+const size_t MEM_SUBSYSTEMS = (size_t)MemSubsystem::Count;
+
+const char *mem_subsystem_name(MemSubsystem s);
+
+void mem_set_budget(uint64_t bytes);  // 0 = unlimited
+uint64_t mem_budget();
+
+// Throws runtime_error when the charge would push the total over the budget
+void mem_charge(MemSubsystem s, uint64_t bytes);
+void mem_release(MemSubsystem s, uint64_t bytes);
+
+uint64_t mem_current();
+uint64_t mem_peak();
+uint64_t mem_peak(MemSubsystem s);
+uint64_t mem_process_peak_rss();  // OS high-water mark in bytes, 0 if unknown
+
+// Parses "512K", "64M", "1G" or plain bytes; throws on bad input
+uint64_t mem_parse_size(const std::string &text);
+
+// RAII charge that can be resized as a buffer grows or shrinks
+class MemCharge {
+public:
+    explicit MemCharge(MemSubsystem s, uint64_t bytes = 0) : sub(s), held(0) { set(bytes); }
+    ~MemCharge() { if (held) mem_release(sub, held); }
+    MemCharge(const MemCharge &) = delete;
+    MemCharge &operator=(const MemCharge &) = delete;
+
+    void set(uint64_t bytes) {
+        if (bytes > held) mem_charge(sub, bytes - held);
+        else if (bytes < held) mem_release(sub, held - bytes);
+        held = bytes;
+    }
+
+private:
+    MemSubsystem sub;
+    uint64_t held;
+};
+
+// Buffer sizes that keep one file's compress or decompress pipeline inside
+// the budget (the largest that fit; defaults when unlimited)
+struct MemPlan {
+    size_t ioChunk;      // read / LZ77 chunk / decode buffers
+    size_t lzWindow;     // LZ77 compressor window (the decoder still accepts 64 KiB)
+    size_t probeSample;  // entropy probe sample
+    size_t decodeSlice;  // LZ77 token bytes fed per decode step (bounds its output)
+    size_t spillBuffer;  // encoder token bytes held in memory before spilling to disk
+    bool filters;        // room for the filter trial (filter.h); off only under tight budgets
+};
+
+MemPlan mem_plan();
@@ -0,0 +1,284 @@
+// microbench.cpp
+// Standalone kernel microbenchmarks (separate build target, no file I/O):
+//   kittypress-microbench [--filter=<substr>] [--iterations=<n>] [--warmup=<n>] [--size=<bytes>]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "bitstream.h"
+#include "chunker.h"
+#include "cpu.h"
+#include "crc32c.h"
+#include "filter.h"
+#include "histogram.h"
+#include "huffman.h"
+#include "lz77.h"
+#include "memstream.h"
+#include "xxhash.h"
+
+using namespace std;
+
+// Synthetic input: symbols drawn uniformly from 2^alphabetBits values, with a
+// repeatFraction share of the bytes copied in runs from repeatDistance back.
+// alphabetBits controls the order-0 entropy, repeatDistance where LZ77 finds
+// its matches (0 = no repeats).
+static vector<uint8_t> synthData(size_t size, int alphabetBits, size_t repeatDistance,
+                                 double repeatFraction, uint32_t seed) {
+    mt19937 rng(seed);
+    uniform_int_distribution<int> sym(0, (1 << alphabetBits) - 1);
+    uniform_int_distribution<int> runLen(4, 64);
+    uniform_real_distribution<double> coin(0.0, 1.0);
+    vector<uint8_t> data;
+    data.reserve(size);
+    while (data.size() < size) {
+        if (repeatDistance > 0 && data.size() >= repeatDistance && coin(rng) < repeatFraction / 8.0) {
+            size_t len = min<size_t>(runLen(rng), size - data.size());
+            for (size_t i = 0; i < len; ++i) data.push_back(data[data.size() - repeatDistance]);
+        } else {
+            data.push_back((uint8_t)sym(rng));
+        }
+    }
+    return data;
+}
+
+struct MicroOptions {
+    string filter;
+    int iterations = 15;
+    int warmup = 3;
+    size_t size = 4 * 1024 * 1024;
+};
+
+struct Summary {
+    double min = 0, median = 0, mean = 0, stddev = 0;
+};
+
+static Summary summarize(vector<double> t) {
+    Summary s;
+    sort(t.begin(), t.end());
+    s.min = t.front();
+    s.median = t.size() % 2 ? t[t.size() / 2] : (t[t.size() / 2 - 1] + t[t.size() / 2]) / 2;
+    for (double x : t) s.mean += x;
+    s.mean /= t.size();
+    for (double x : t) s.stddev += (x - s.mean) * (x - s.mean);
+    s.stddev = t.size() > 1 ? sqrt(s.stddev / (t.size() - 1)) : 0;
+    return s;
+}
+
+// Optimizer barrier for results the benchmark would otherwise discard
+static volatile uint64_t sink;
+
+// Times body() after warmup runs; bytes is the work per call for MB/s
+static void runCase(const MicroOptions &opts, const string &name, size_t bytes,
+                    const function<void()> &body) {
+    if (!opts.filter.empty() && name.find(opts.filter) == string::npos) return;
+    for (int i = 0; i < opts.warmup; ++i) body();
+    vector<double> times;
+    for (int i = 0; i < opts.iterations; ++i) {
+        auto start = chrono::steady_clock::now();
+        body();
+        times.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    Summary s = summarize(times);
+    double mb = (double)bytes / (1024.0 * 1024.0);
+    cout << left << setw(36) << name << right << fixed
+         << setw(10) << setprecision(3) << s.median * 1e3
+         << setw(10) << s.min * 1e3
+         << setw(8) << setprecision(1) << (s.mean > 0 ? 100.0 * s.stddev / s.mean : 0.0)
+         << setw(11) << setprecision(1) << (s.median > 0 ? mb / s.median : 0.0) << "\n";
+}
+
+static vector<uint8_t> lzCompress(const vector<uint8_t> &data, size_t windowSize, int level) {
+    LZ77StreamCompressor lz(windowSize, 255, level);
+    lz.feed(data, true);
+    return lz.consumeOutput();
+}
+
+static void benchBitstream(const MicroOptions &opts) {
+    vector<uint8_t> data = synthData(opts.size / 8, 8, 0, 0, 1);
+    // codes of 1..16 bits, like a skewed Huffman table
+    vector<string> codes(256);
+    for (int c = 0; c < 256; ++c) {
+        int len = 1 + c % 16;
+        for (int b = 0; b < len; ++b) codes[c] += (char)('0' + ((c >> (b % 8)) & 1));
+    }
+    size_t totalBits = 0;
+    for (uint8_t c : data) totalBits += codes[c].size();
+
+    auto writeAll = [&](vector<uint8_t> &packed) {
+        packed.clear();
+        VectorOStream out(packed);
+        BitWriter w(out);
+        for (uint8_t c : data) w.writeBits(codes[c]);
+        w.flush();
+    };
+    // the readers decode this whether or not the writer case runs
+    vector<uint8_t> packed;
+    writeAll(packed);
+    vector<uint8_t> written;
+    runCase(opts, "bitwriter.writeBits", totalBits / 8, [&] { writeAll(written); });
+    runCase(opts, "bitreader.readBit", packed.size(), [&] {
+        MemoryIStream in(packed.data(), packed.size());
+        BitReader r(in);
+        bool bit;
+        uint64_t ones = 0;
+        while (r.readBit(bit)) ones += bit;
+        sink = ones;
+    });
+    runCase(opts, "bitreader.readBitString", packed.size(), [&] {
+        MemoryIStream in(packed.data(), packed.size());
+        BitReader r(in);
+        string bits;
+        sink = r.readBitString(bits, (uint64_t)packed.size() * 8);
+    });
+}
+
+static void benchMatchFinder(const MicroOptions &opts) {
+    // text-like alphabet, repeats spread across near and far distances
+    for (size_t window : { (size_t)4096, (size_t)16384, (size_t)65535 }) {
+        vector<uint8_t> data = synthData(opts.size, 5, window / 2, 0.6, 2);
+        for (int level : { 1, LZ77_DEFAULT_LEVEL, 9 }) {
+            ostringstream name;
+            name << "lz77.match w=" << window << " L" << level;
+            runCase(opts, name.str(), data.size(), [&] {
+                sink = lzCompress(data, window, level).size();
+            });
+        }
+    }
+}
+
+static void benchHuffman(const MicroOptions &opts) {
+    for (int bits : { 2, 5, 8 }) {
+        vector<uint8_t> data = synthData(opts.size, bits, 0, 0, 3);
+        ByteHistogram freq = {};
+        histogram_add(freq, data.data(), data.size());
+
+        ostringstream suffix;
+        suffix << " H~" << bits;
+        // bytes: the input the table codes, so MB/s compares with the encode case
+        unordered_map<unsigned char, string> codes = buildHuffmanCodes(freq);
+        runCase(opts, "huffman.build" + suffix.str(), data.size(), [&] {
+            sink = buildHuffmanCodes(freq).size();
+        });
+        array<const string*, 256> lookup{};
+        for (auto &p : codes) lookup[p.first] = &p.second;
+        vector<uint8_t> packed;
+        runCase(opts, "huffman.encode" + suffix.str(), data.size(), [&] {
+            packed.clear();
+            VectorOStream out(packed);
+            BitWriter w(out);
+            for (uint8_t c : data) w.writeBits(*lookup[c]);
+            w.flush();
+        });
+    }
+}
+
+static void benchLZ77Decode(const MicroOptions &opts) {
+    struct Shape { const char *label; int alphabetBits; size_t distance; double repeat; };
+    for (const Shape &sh : { Shape{ "short-rep", 5, 16, 0.8 }, Shape{ "far-rep", 5, 30000, 0.8 },
+                             Shape{ "literal", 8, 0, 0 } }) {
+        vector<uint8_t> data = synthData(opts.size, sh.alphabetBits, sh.distance, sh.repeat, 4);
+        vector<uint8_t> serialized = lzCompress(data, 65535, LZ77_DEFAULT_LEVEL);
+        vector<LZ77Token> tokens = lz77_deserialize(serialized);
+        string label = sh.label;
+
+        runCase(opts, "lz77.deserialize " + label, serialized.size(), [&] {
+            sink = lz77_deserialize(serialized).size();
+        });
+        runCase(opts, "lz77.decompress " + label, data.size(), [&] {
+            sink = lz77_decompress(tokens).size();
+        });
+        runCase(opts, "lz77.stream-decode " + label, data.size(), [&] {
+            LZ77StreamDecompressor dec;
+            dec.feed(serialized);
+            sink = dec.consumeOutput().size();
+        });
+    }
+}
+
+static void benchDedup(const MicroOptions &opts) {
+    vector<uint8_t> data = synthData(opts.size, 8, 0, 0, 5);
+    runCase(opts, "cdc.cut", data.size(), [&] {
+        size_t chunks = 0;
+        for (size_t pos = 0; pos < data.size(); ++chunks) pos += cdc_cut(data.data() + pos, data.size() - pos);
+        sink = chunks;
+    });
+    runCase(opts, "xxh64", data.size(), [&] {
+        sink = xxh64(data.data(), data.size());
+    });
+}
+
+// Member/block checksums: the active kernel and the table fallback
+static void benchChecksum(const MicroOptions &opts) {
+    vector<uint8_t> data = synthData(opts.size, 8, 0, 0, 7);
+    runCase(opts, "crc32c", data.size(), [&] {
+        sink = crc32c(data.data(), data.size());
+    });
+    runCase(opts, "crc32c.scalar", data.size(), [&] {
+        sink = crc32c_scalar(0, data.data(), data.size());
+    });
+}
+
+// Preprocessing filters, encode and decode, fed in 64 KiB pieces as the encoder does
+static void benchFilters(const MicroOptions &opts) {
+    vector<uint8_t> data = synthData(opts.size, 8, 0, 0, 6);
+    vector<uint8_t> out;
+    out.reserve(data.size());
+    const FilterSpec specs[] = { { FilterKind::X86, 0 }, { FilterKind::Delta, 4 }, { FilterKind::Transpose, 12 } };
+    for (const FilterSpec &spec : specs) {
+        for (bool encode : { true, false }) {
+            runCase(opts, "filter." + filter_name(spec) + (encode ? ".encode" : ".decode"), data.size(), [&] {
+                out.clear();
+                FilterStream f(spec, encode);
+                for (size_t at = 0; at < data.size(); at += 64 * 1024)
+                    f.update(data.data() + at, min<size_t>(64 * 1024, data.size() - at), out);
+                f.finish(out);
+                sink = out.size();
+            });
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    MicroOptions opts;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string a = argv[i];
+            if (a.rfind("--filter=", 0) == 0) opts.filter = a.substr(9);
+            else if (a.rfind("--iterations=", 0) == 0) opts.iterations = max(1, stoi(a.substr(13)));
+            else if (a.rfind("--warmup=", 0) == 0) opts.warmup = max(0, stoi(a.substr(9)));
+            else if (a.rfind("--size=", 0) == 0) opts.size = max<size_t>(4096, stoull(a.substr(7)));
+            else if (a.rfind("--cpu=", 0) == 0) {
+                CpuTier tier;
+                if (!cpu_parse_tier(a.substr(6), tier)) throw runtime_error("Unknown CPU tier: " + a.substr(6));
+                cpu_force_tier(tier);
+            } else {
+                cerr << "Usage: kittypress-microbench [--filter=<substr>] [--iterations=<n>] "
+                        "[--warmup=<n>] [--size=<bytes>] [--cpu=<tier>]\n";
+                return 1;
+            }
+        }
+
+        cout << "kernels: " << cpu_tier_name(kernels().tier) << ", input " << opts.size
+             << " bytes, " << opts.warmup << " warmup + " << opts.iterations << " timed runs\n\n";
+        cout << left << setw(36) << "case" << right << setw(10) << "med ms" << setw(10) << "min ms"
+             << setw(8) << "cv %" << setw(11) << "MB/s(med)" << "\n";
+        benchBitstream(opts);
+        benchMatchFinder(opts);
+        benchHuffman(opts);
+        benchLZ77Decode(opts);
+        benchDedup(opts);
+        benchChecksum(opts);
+        benchFilters(opts);
+    } catch (const exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
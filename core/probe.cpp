@@ -0,0 +1,61 @@
+// probe.cpp
+#include "probe.h"
+#include "histogram.h"
+#include "lz77.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+static const double ENTROPY_SKIP_THRESHOLD = 7.7;  // bits/byte at or above which a block may be stored
+static const double STORE_MATCH_RATE = 0.10;       // ... unless at least this share of it repeats
+static const double FAST_MATCH_RATE = 0.15;        // below this, deeper match search buys little
+
+// match estimate: PROBE_WINDOWS windows of PROBE_WINDOW bytes (the whole
+// sample when it is no larger than all of them together)
+static const size_t PROBE_WINDOWS = 4;
+static const size_t PROBE_WINDOW = 32 * 1024;
+static const unsigned PROBE_HASH_BITS = 13;
+
+static inline uint32_t load32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+ProbeResult probe_sample(const uint8_t *data, size_t n) {
+    ProbeResult r;
+    if (n == 0) return r;
+    ByteHistogram hist = {};
+    histogram_add(hist, data, n);
+    r.entropy = histogram_entropy(hist);
+    if (n < 8) return r;
+
+    size_t windows = n <= PROBE_WINDOWS * PROBE_WINDOW ? 1 : PROBE_WINDOWS;
+    size_t len = windows == 1 ? n : PROBE_WINDOW;
+    uint32_t table[1u << PROBE_HASH_BITS];  // position + 1 of the last prefix with this hash
+    uint64_t positions = 0, hits = 0;
+    for (size_t w = 0; w < windows; ++w) {
+        const uint8_t *p = data + (windows == 1 ? 0 : (n - len) / (windows - 1) * w);
+        memset(table, 0, sizeof(table));
+        for (size_t i = 0; i + 4 <= len; ++i) {
+            uint32_t v = load32(p + i);
+            uint32_t h = (v * 2654435761u) >> (32 - PROBE_HASH_BITS);
+            uint32_t cand = table[h];
+            hits += cand != 0 && load32(p + cand - 1) == v;
+            table[h] = (uint32_t)i + 1;
+        }
+        positions += len - 3;
+    }
+    r.matchRate = (double)hits / (double)positions;
+    return r;
+}
+
+ProbeMode probe_mode(const ProbeResult &r) {
+    if (r.entropy >= ENTROPY_SKIP_THRESHOLD && r.matchRate < STORE_MATCH_RATE) return ProbeMode::Store;
+    return r.matchRate < FAST_MATCH_RATE ? ProbeMode::Fast : ProbeMode::Strong;
+}
+
+int probe_level(ProbeMode mode, int level) {
+    return mode == ProbeMode::Fast ? min(level, LZ77_FAST_LEVEL) : level;
+}
@@ -0,0 +1,36 @@
+// probe.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Compressibility probe run before LZ77 on each block of input. Order-0
+// entropy alone misses repetition (a high-entropy block that repeats is still
+// worth matching), so the probe also estimates match potential: a few windows
+// spread over the sample are hashed by their 4-byte prefixes into a small
+// table of recent positions, and matchRate is the share of positions whose
+// prefix occurred earlier in the window, roughly the share of bytes LZ77
+// would cover with matches.
+struct ProbeResult {
+    double entropy = 0;    // bits/byte
+    double matchRate = 0;  // 0..1
+};
+
+ProbeResult probe_sample(const uint8_t *data, size_t n);
+
+// What each 64 KiB piece of a block gets:
+//   Store   no match search: a raw KP05 block, literal tokens in KP03
+//   Fast    LZ77 at no more than LZ77_FAST_LEVEL (little to match; the
+//           entropy coder carries the gain)
+//   Strong  LZ77 at the requested level
+enum class ProbeMode : uint8_t { Store = 0, Fast = 1, Strong = 2 };
+
+ProbeMode probe_mode(const ProbeResult &r);
+
+// Level for a Fast or Strong block compressed at the requested level
+int probe_level(ProbeMode mode, int level);
+
+// The whole-input decision samples up to this many regions of
+// PROBE_REGION_SIZE bytes spread evenly over the input, not just its first
+// block (an input under PROBE_REGIONS regions is covered region by region)
+const size_t PROBE_REGIONS = 8;
+const size_t PROBE_REGION_SIZE = 64 * 1024;
@@ -0,0 +1,22 @@
+// rng.h
+#pragma once
+#include <cstdint>
+
+// splitmix64 for gen-corpus and fuzz: the <random> distributions are
+// implementation-defined, this gives the same bytes for a --seed with every
+// compiler
+class KittyRng {
+public:
+    explicit KittyRng(uint64_t seed) : state(seed) {}
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    uint64_t below(uint64_t n) { return next() % n; }
+    // roughly Zipf-like pick from [0, n): small indices are much more common
+    uint64_t skewed(uint64_t n) { return below(below(n) + 1); }
+private:
+    uint64_t state;
+};
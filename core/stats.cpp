@@ -0,0 +1,143 @@
+// stats.cpp
+#include "stats.h"
+#include <algorithm>
+#include <iomanip>
+
+using namespace std;
+
+void LZ77MatchStats::add(const LZ77MatchStats &o) {
+    positions += o.positions;
+    probes += o.probes;
+    depthLimitHits += o.depthLimitHits;
+    literals += o.literals;
+    matches += o.matches;
+    matchBytes += o.matchBytes;
+    for (size_t b = 0; b < offsetBuckets.size(); ++b) offsetBuckets[b] += o.offsetBuckets[b];
+}
+
+void KittyStats::add(const KittyStats &o) {
+    files += o.files;
+    storedRaw += o.storedRaw;
+    entropySkips += o.entropySkips;
+    entropySum += o.entropySum;
+    probedFiles += o.probedFiles;
+    for (size_t i = 0; i < probeBlocks.size(); ++i) probeBlocks[i] += o.probeBlocks[i];
+    filteredBlocks += o.filteredBlocks;
+    dedupFiles += o.dedupFiles;
+    dedupBytes += o.dedupBytes;
+    chunks += o.chunks;
+    chunkHits += o.chunkHits;
+    chunkHitBytes += o.chunkHitBytes;
+    baseFiles += o.baseFiles;
+    baseBytes += o.baseBytes;
+    bytesIn += o.bytesIn;
+    lzBytes += o.lzBytes;
+    bytesOut += o.bytesOut;
+    lz.add(o.lz);
+    huffmanTables += o.huffmanTables;
+    huffmanSymbols += o.huffmanSymbols;
+    encodedBits += o.encodedBits;
+    times.probe += o.times.probe;
+    times.lz77 += o.times.lz77;
+    times.histogram += o.times.histogram;
+    times.huffmanBuild += o.times.huffmanBuild;
+    times.encode += o.times.encode;
+    times.decode += o.times.decode;
+    memoryBudget = max(memoryBudget, o.memoryBudget);
+    memoryPeak = max(memoryPeak, o.memoryPeak);
+    for (size_t i = 0; i < MEM_SUBSYSTEMS; ++i) memoryPeakBy[i] = max(memoryPeakBy[i], o.memoryPeakBy[i]);
+    processPeakRss = max(processPeakRss, o.processPeakRss);
+}
+
+void stats_capture_memory(KittyStats &s) {
+    s.memoryBudget = mem_budget();
+    s.memoryPeak = mem_peak();
+    for (size_t i = 0; i < MEM_SUBSYSTEMS; ++i) s.memoryPeakBy[i] = mem_peak((MemSubsystem)i);
+    s.processPeakRss = mem_process_peak_rss();
+}
+
+static double ratioOf(uint64_t num, uint64_t den) {
+    return den ? (double)num / (double)den : 0.0;
+}
+
+void stats_print(ostream &os, const KittyStats &s) {
+    const LZ77MatchStats &lz = s.lz;
+    const KittyStageTimes &t = s.times;
+    os << fixed << setprecision(3);
+    os << "\n📊 KittyPress stats\n";
+#if !KITTY_STATS_ENABLED
+    os << "  (counters compiled out with KITTY_NO_STATS; only stage times are recorded)\n";
+#endif
+    os << "  files            " << s.files << " (" << s.storedRaw << " stored raw, "
+       << s.entropySkips << " by entropy probe; " << s.filteredBlocks << " block(s) filtered)\n"
+       << "  entropy probe    avg " << (s.probedFiles ? s.entropySum / s.probedFiles : 0.0)
+       << " bits/byte over " << s.probedFiles << " file(s)\n"
+       << "  block probe      " << s.probeBlocks[0] << " stored, " << s.probeBlocks[1] << " fast, "
+       << s.probeBlocks[2] << " strong\n"
+       << "  dedup            " << s.dedupFiles << " duplicate file(s), " << s.dedupBytes << " bytes not stored again; "
+       << s.chunkHits << " of " << s.chunks << " chunk(s) shared, " << s.chunkHitBytes << " bytes\n"
+       << "  base archive     " << s.baseFiles << " file(s), " << s.baseBytes << " bytes copied without recompressing\n"
+       << "  bytes            in " << s.bytesIn << " → lz77 " << s.lzBytes << " → out " << s.bytesOut
+       << " (ratio " << ratioOf(s.bytesOut, s.bytesIn) << ")\n"
+       << "  tokens           " << lz.literals << " literals, " << lz.matches << " matches, avg length "
+       << ratioOf(lz.matchBytes, lz.matches) << "\n"
+       << "  match finder     " << ratioOf(lz.probes, lz.positions) << " probes/position, "
+       << lz.depthLimitHits << " depth-limit hits over " << lz.positions << " positions\n"
+       << "  offset buckets  ";
+    for (size_t b = 0; b < lz.offsetBuckets.size(); ++b)
+        if (lz.offsetBuckets[b]) os << " <2^" << b << ":" << lz.offsetBuckets[b];
+    os << "\n"
+       << "  huffman          " << s.huffmanTables << " table(s), avg "
+       << ratioOf(s.huffmanSymbols, s.huffmanTables) << " symbols, avg code length "
+       << ratioOf(s.encodedBits, s.lzBytes) << " bits\n"
+       << "  time (s)         probe " << t.probe << ", lz77 " << t.lz77 << ", histogram " << t.histogram
+       << ", huffman build " << t.huffmanBuild << ", encode " << t.encode << ", decode " << t.decode << "\n"
+       << "  memory peak      " << s.memoryPeak / 1024 << " KiB accounted (";
+    for (size_t i = 0; i < MEM_SUBSYSTEMS; ++i)
+        os << (i ? ", " : "") << mem_subsystem_name((MemSubsystem)i) << " " << s.memoryPeakBy[i] / 1024;
+    os << "), process RSS " << s.processPeakRss / 1024 << " KiB";
+    if (s.memoryBudget) os << ", budget " << s.memoryBudget / 1024 << " KiB";
+    os << "\n";
+    os.unsetf(ios::floatfield);
+}
+
+void stats_write_json(ostream &os, const KittyStats &s) {
+    const LZ77MatchStats &lz = s.lz;
+    const KittyStageTimes &t = s.times;
+    os << setprecision(6);
+    os << "{\n"
+       << "  \"counters_enabled\": " << (KITTY_STATS_ENABLED ? "true" : "false") << ",\n"
+       << "  \"files\": " << s.files << ",\n"
+       << "  \"stored_raw\": " << s.storedRaw << ",\n"
+       << "  \"entropy_skips\": " << s.entropySkips << ",\n"
+       << "  \"filtered_blocks\": " << s.filteredBlocks << ",\n"
+       << "  \"entropy_avg\": " << (s.probedFiles ? s.entropySum / s.probedFiles : 0.0) << ",\n"
+       << "  \"probe_blocks\": {\"stored\": " << s.probeBlocks[0] << ", \"fast\": " << s.probeBlocks[1]
+       << ", \"strong\": " << s.probeBlocks[2] << "},\n"
+       << "  \"dedup\": {\"files\": " << s.dedupFiles << ", \"bytes\": " << s.dedupBytes
+       << ", \"chunks\": " << s.chunks << ", \"chunk_hits\": " << s.chunkHits
+       << ", \"chunk_hit_bytes\": " << s.chunkHitBytes << "},\n"
+       << "  \"base\": {\"files\": " << s.baseFiles << ", \"bytes\": " << s.baseBytes << "},\n"
+       << "  \"bytes\": {\"in\": " << s.bytesIn << ", \"lz77\": " << s.lzBytes
+       << ", \"out\": " << s.bytesOut << "},\n"
+       << "  \"lz77\": {\"literals\": " << lz.literals << ", \"matches\": " << lz.matches
+       << ", \"match_bytes\": " << lz.matchBytes
+       << ", \"avg_match_length\": " << ratioOf(lz.matchBytes, lz.matches)
+       << ", \"positions\": " << lz.positions << ", \"probes\": " << lz.probes
+       << ", \"probes_per_position\": " << ratioOf(lz.probes, lz.positions)
+       << ", \"depth_limit_hits\": " << lz.depthLimitHits << ", \"offset_buckets\": [";
+    for (size_t b = 0; b < lz.offsetBuckets.size(); ++b)
+        os << (b ? ", " : "") << lz.offsetBuckets[b];
+    os << "]},\n"
+       << "  \"huffman\": {\"tables\": " << s.huffmanTables << ", \"symbols\": " << s.huffmanSymbols
+       << ", \"encoded_bits\": " << s.encodedBits
+       << ", \"avg_code_length\": " << ratioOf(s.encodedBits, s.lzBytes) << "},\n"
+       << "  \"time_sec\": {\"probe\": " << t.probe << ", \"lz77\": " << t.lz77
+       << ", \"histogram\": " << t.histogram << ", \"huffman_build\": " << t.huffmanBuild
+       << ", \"encode\": " << t.encode << ", \"decode\": " << t.decode << "},\n"
+       << "  \"memory\": {\"budget\": " << s.memoryBudget << ", \"peak\": " << s.memoryPeak;
+    for (size_t i = 0; i < MEM_SUBSYSTEMS; ++i)
+        os << ", \"peak_" << mem_subsystem_name((MemSubsystem)i) << "\": " << s.memoryPeakBy[i];
+    os << ", \"process_peak_rss\": " << s.processPeakRss << "}\n"
+       << "}\n";
+}
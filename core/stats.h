@@ -0,0 +1,83 @@
+// stats.h
+#pragma once
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include "memtrack.h"
+
+// Build with -DKITTY_NO_STATS to compile the counters out of the hot loops
+// (stage timers stay: they run once per stage, not per byte)
+#ifdef KITTY_NO_STATS
+#define KITTY_STATS_ENABLED 0
+#define KITTY_STAT(expr) ((void)sizeof((expr), 0))  // unevaluated: no code, no unused warnings
+#else
+#define KITTY_STATS_ENABLED 1
+#define KITTY_STAT(expr) ((void)(expr))
+#endif
+
+// Match finder counters, accumulated by LZ77StreamCompressor
+struct LZ77MatchStats {
+    uint64_t positions = 0;       // positions the match finder searched
+    uint64_t probes = 0;          // hash chain candidates compared
+    uint64_t depthLimitHits = 0;  // searches cut off by the level's chain depth
+    uint64_t literals = 0;
+    uint64_t matches = 0;
+    uint64_t matchBytes = 0;      // bytes covered by matches
+    std::array<uint64_t, 17> offsetBuckets{};  // matches per offset bit length (offset_bucket)
+
+    void add(const LZ77MatchStats &o);
+};
+
+// Per-stage wall time in seconds
+struct KittyStageTimes {
+    double probe = 0;         // entropy and match probes (whole input and per block)
+    double lz77 = 0;          // LZ77StreamCompressor
+    double histogram = 0;     // token byte statistics
+    double huffmanBuild = 0;  // tree + code table
+    double encode = 0;        // header + bitstream
+    double decode = 0;        // full decompression
+};
+
+// Everything --stats reports; summed over all files of a run
+struct KittyStats {
+    uint64_t files = 0;           // files compressed (or attempted)
+    uint64_t storedRaw = 0;       // files kept as raw payloads
+    uint64_t entropySkips = 0;    // of those, skipped by the entropy probe
+    double entropySum = 0;        // probe entropy (bits/byte) summed over probed files
+    uint64_t probedFiles = 0;
+    std::array<uint64_t, 3> probeBlocks{};  // blocks / pieces the probe stored / matched fast / strong (ProbeMode)
+    uint64_t filteredBlocks = 0;  // input blocks passed through a filter.h filter before LZ77
+    uint64_t dedupFiles = 0;      // archive members stored as references to an identical member
+    uint64_t dedupBytes = 0;      // their original bytes
+    uint64_t chunks = 0;          // content-defined chunks cut (--chunk-dedup)
+    uint64_t chunkHits = 0;       // of those, stored as references to an identical chunk
+    uint64_t chunkHitBytes = 0;
+    uint64_t baseFiles = 0;       // archive members copied from a --base archive without recompressing
+    uint64_t baseBytes = 0;       // their original bytes
+
+    uint64_t bytesIn = 0;         // original bytes
+    uint64_t lzBytes = 0;         // serialized LZ77 token bytes (Huffman input)
+    uint64_t bytesOut = 0;        // final payload bytes (raw or encoded)
+
+    LZ77MatchStats lz;
+    uint64_t huffmanTables = 0;   // code tables built
+    uint64_t huffmanSymbols = 0;  // code table entries, summed over tables
+    uint64_t encodedBits = 0;     // Huffman output bits
+
+    KittyStageTimes times;
+
+    // accounted buffer peaks (process-wide, see memtrack.h) and the OS view
+    uint64_t memoryBudget = 0;
+    uint64_t memoryPeak = 0;
+    std::array<uint64_t, MEM_SUBSYSTEMS> memoryPeakBy{};
+    uint64_t processPeakRss = 0;
+
+    // Sums counters and times; memory fields keep the larger value
+    void add(const KittyStats &o);
+};
+
+// Copies the current memory peaks into s
+void stats_capture_memory(KittyStats &s);
+
+void stats_print(std::ostream &os, const KittyStats &s);       // human-readable
+void stats_write_json(std::ostream &os, const KittyStats &s);
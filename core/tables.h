@@ -0,0 +1,39 @@
+// tables.h
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Lookup tables generated at compile time
+
+// Bit length of v (0 for 0): the bucket of a match length or offset byte
+constexpr std::array<uint8_t, 256> make_bitlen_table() {
+    std::array<uint8_t, 256> t{};
+    for (unsigned v = 1; v < 256; ++v) {
+        uint8_t n = 0;
+        for (unsigned x = v; x; x >>= 1) ++n;
+        t[v] = n;
+    }
+    return t;
+}
+constexpr std::array<uint8_t, 256> LENGTH_BUCKET = make_bitlen_table();
+
+// Bucket (bit length, 0..16) of a 16-bit match offset
+constexpr unsigned offset_bucket(uint32_t offset) {
+    return (offset >> 8) ? 8u + LENGTH_BUCKET[(offset >> 8) & 0xFF] : LENGTH_BUCKET[offset & 0xFF];
+}
+
+// CRC32C (Castagnoli, reflected polynomial 0x82F63B78), one byte per step
+constexpr std::array<uint32_t, 256> make_crc32c_table() {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+        t[i] = c;
+    }
+    return t;
+}
+constexpr std::array<uint32_t, 256> CRC32C_TABLE = make_crc32c_table();
+
+static_assert(CRC32C_TABLE[1] == 0xF26B8303u, "CRC32C table");
+static_assert(offset_bucket(4096) == 13 && offset_bucket(65535) == 16, "offset buckets");
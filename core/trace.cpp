@@ -0,0 +1,109 @@
+// trace.cpp
+#include "trace.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+atomic<bool> g_traceEnabled{ false };
+
+namespace {
+
+struct TraceEvent {
+    const char *name;
+    int64_t start;
+    int64_t duration;
+    string detail;
+};
+
+// Owned by the registry so spans outlive the thread that recorded them;
+// only the owning thread appends
+struct TraceBuffer {
+    unsigned tid;
+    vector<TraceEvent> events;
+};
+
+mutex g_registryMutex;
+vector<unique_ptr<TraceBuffer>> g_buffers;
+chrono::steady_clock::time_point g_origin = chrono::steady_clock::now();
+
+TraceBuffer &threadBuffer() {
+    thread_local TraceBuffer *buffer = nullptr;
+    if (!buffer) {
+        lock_guard<mutex> lock(g_registryMutex);
+        g_buffers.push_back(make_unique<TraceBuffer>());
+        buffer = g_buffers.back().get();
+        buffer->tid = (unsigned)g_buffers.size();
+        buffer->events.reserve(1024);
+    }
+    return *buffer;
+}
+
+void writeJsonString(ostream &os, const char *s) {
+    os << '"';
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') os << '\\' << (char)c;
+        else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            os << buf;
+        } else os << (char)c;
+    }
+    os << '"';
+}
+
+} // namespace
+
+int64_t TraceSpan::now() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - g_origin).count();
+}
+
+TraceSpan::TraceSpan(const char *name, const string &detail)
+    : name(name), start(trace_enabled() ? now() : -1) {
+    if (start >= 0) this->detail = detail;
+}
+
+void TraceSpan::finish() {
+    threadBuffer().events.push_back({ name, start, now() - start, move(detail) });
+}
+
+void trace_start() {
+    g_origin = chrono::steady_clock::now();
+    g_traceEnabled.store(true, memory_order_relaxed);
+}
+
+void trace_write(const string &path) {
+    g_traceEnabled.store(false, memory_order_relaxed);
+    ofstream out(path);
+    if (!out) throw runtime_error("Cannot open trace file " + path);
+
+    lock_guard<mutex> lock(g_registryMutex);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    for (auto &buf : g_buffers) {
+        out << (first ? "" : ",\n")
+            << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buf->tid
+            << ", \"args\": {\"name\": \"thread " << buf->tid << "\"}}";
+        first = false;
+        for (auto &e : buf->events) {
+            out << ",\n{\"name\": ";
+            writeJsonString(out, e.name);
+            out << ", \"cat\": \"kittypress\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buf->tid
+                << ", \"ts\": " << e.start << ", \"dur\": " << e.duration;
+            if (!e.detail.empty()) {
+                out << ", \"args\": {\"detail\": ";
+                writeJsonString(out, e.detail.c_str());
+                out << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    if (!out) throw runtime_error("Failed to write trace file " + path);
+}
@@ -0,0 +1,41 @@
+// trace.h
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Timeline recorder for --trace: RAII spans go to a per-thread buffer (no
+// locks after a thread's first span) and trace_write() dumps them as Chrome
+// trace JSON (chrome://tracing, ui.perfetto.dev). While tracing is off a
+// span costs one relaxed atomic load.
+
+extern std::atomic<bool> g_traceEnabled;
+
+inline bool trace_enabled() { return g_traceEnabled.load(std::memory_order_relaxed); }
+
+void trace_start();                         // enable recording, t=0 is now
+void trace_write(const std::string &path);  // write every thread's spans; throws on I/O errors
+
+class TraceSpan {
+public:
+    // name must be a string literal (stored by pointer); detail is copied
+    explicit TraceSpan(const char *name) : name(name), start(trace_enabled() ? now() : -1) {}
+    TraceSpan(const char *name, const std::string &detail);
+    ~TraceSpan() { if (start >= 0) finish(); }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *name;
+    int64_t start;  // microseconds since trace_start, -1 = not recording
+    std::string detail;
+
+    static int64_t now();
+    void finish();
+};
+
+#define KITTY_TRACE_CAT2(a, b) a##b
+#define KITTY_TRACE_CAT(a, b) KITTY_TRACE_CAT2(a, b)
+// Records the enclosing scope as a span: KITTY_TRACE("lz77 block");
+#define KITTY_TRACE(...) TraceSpan KITTY_TRACE_CAT(kittyTraceSpan_, __LINE__)(__VA_ARGS__)
@@ -0,0 +1,98 @@
+// xxhash.cpp  (reference XXH64 algorithm, little-endian loads)
+#include "xxhash.h"
+#include <cstring>
+
+static const uint64_t P1 = 11400714785074694791ULL;
+static const uint64_t P2 = 14029467366897019727ULL;
+static const uint64_t P3 = 1609587929392839161ULL;
+static const uint64_t P4 = 9650029242287828579ULL;
+static const uint64_t P5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint32_t load32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input) {
+    acc += input * P2;
+    return rotl(acc, 31) * P1;
+}
+
+static inline uint64_t merge64(uint64_t h, uint64_t acc) {
+    h ^= round64(0, acc);
+    return h * P1 + P4;
+}
+
+XXH64::XXH64(uint64_t seed) : seed(seed) {
+    acc[0] = seed + P1 + P2;
+    acc[1] = seed + P2;
+    acc[2] = seed;
+    acc[3] = seed - P1;
+}
+
+void XXH64::update(const uint8_t *data, size_t size) {
+    total += size;
+    if (bufLen) {
+        size_t take = size < 32 - bufLen ? size : 32 - bufLen;
+        memcpy(buf + bufLen, data, take);
+        bufLen += take;
+        data += take;
+        size -= take;
+        if (bufLen < 32) return;
+        for (int i = 0; i < 4; ++i) acc[i] = round64(acc[i], load64(buf + 8 * i));
+        bufLen = 0;
+    }
+    uint64_t a0 = acc[0], a1 = acc[1], a2 = acc[2], a3 = acc[3];
+    for (; size >= 32; data += 32, size -= 32) {
+        a0 = round64(a0, load64(data));
+        a1 = round64(a1, load64(data + 8));
+        a2 = round64(a2, load64(data + 16));
+        a3 = round64(a3, load64(data + 24));
+    }
+    acc[0] = a0; acc[1] = a1; acc[2] = a2; acc[3] = a3;
+    memcpy(buf, data, size);
+    bufLen = size;
+}
+
+uint64_t XXH64::digest() const {
+    uint64_t h;
+    if (total >= 32) {
+        h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+        for (int i = 0; i < 4; ++i) h = merge64(h, acc[i]);
+    } else {
+        h = seed + P5;
+    }
+    h += total;
+
+    const uint8_t *p = buf;
+    size_t n = bufLen;
+    for (; n >= 8; p += 8, n -= 8) h = rotl(h ^ round64(0, load64(p)), 27) * P1 + P4;
+    if (n >= 4) {
+        h = rotl(h ^ (uint64_t)load32(p) * P1, 23) * P2 + P3;
+        p += 4;
+        n -= 4;
+    }
+    for (; n > 0; ++p, --n) h = rotl(h ^ *p * P5, 11) * P1;
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t xxh64(const uint8_t *data, size_t size, uint64_t seed) {
+    XXH64 h(seed);
+    h.update(data, size);
+    return h.digest();
+}
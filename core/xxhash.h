@@ -0,0 +1,23 @@
+// xxhash.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// XXH64 (64-bit xxHash): fast non-cryptographic hash used to find identical
+// content. Equal hashes only nominate candidates; callers confirm byte by byte.
+class XXH64 {
+public:
+    explicit XXH64(uint64_t seed = 0);
+
+    void update(const uint8_t *data, size_t size);
+    uint64_t digest() const;  // hash of everything so far; update() may continue
+
+private:
+    uint64_t acc[4];
+    uint64_t seed;
+    uint64_t total = 0;
+    uint8_t buf[32];
+    size_t bufLen = 0;
+};
+
+uint64_t xxh64(const uint8_t *data, size_t size, uint64_t seed = 0);